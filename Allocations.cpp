@@ -0,0 +1,212 @@
+#include "Allocations.h"
+#include "Arena.h"
+#include "Game.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+AllocationTracker allocations;
+
+static const char* ALLOCATIONREPORTFILE = "Allocations.txt";
+static const char* SLOT_NAMES[] = { "INPUT", "UPDATE", "PHYSICS", "NETWORK", "DRAW", "OTHER" };
+
+// Totals since the start, written by the hooks on any thread. Static storage is zeroed
+// before any constructor runs, so allocations of static objects are counted safely too.
+static std::atomic<uint64_t> totalCounts[ALLOCATION_NOPHASE + 1];
+static std::atomic<uint64_t> totalBytes[ALLOCATION_NOPHASE + 1];
+static std::atomic<uint64_t> totalFrees;
+// Totals at the start of the current frame
+static uint64_t startCounts[ALLOCATION_NOPHASE + 1], startBytes[ALLOCATION_NOPHASE + 1], startFrees;
+
+#if defined(TRACK_ALLOCATIONS) || defined(STRICT_ALLOCATIONS)
+static void Record(size_t size) {
+    int slot = static_cast<int>(ScopedTimer::GetCurrent());
+    totalCounts[slot].fetch_add(1, std::memory_order_relaxed);
+    totalBytes[slot].fetch_add(size, std::memory_order_relaxed);
+    return;
+}
+
+static void Release(void* p) {
+    if (p) {
+        totalFrees.fetch_add(1, std::memory_order_relaxed);
+        std::free(p);
+    }
+    return;
+}
+
+void* operator new(size_t size) {
+    Record(size);
+    void* p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    Record(size);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* p) noexcept {
+    Release(p);
+    return;
+}
+
+void operator delete[](void* p) noexcept {
+    Release(p);
+    return;
+}
+
+void operator delete(void* p, size_t) noexcept {
+    Release(p);
+    return;
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    Release(p);
+    return;
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    Release(p);
+    return;
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    Release(p);
+    return;
+}
+#endif
+
+// Class AllocationTracker
+// Public AllocationTracker
+AllocationTracker::AllocationTracker() {
+    std::fill(std::begin(counts), std::end(counts), 0);
+    std::fill(std::begin(bytes), std::end(bytes), 0);
+    frees = 0;
+    streak = 0;
+    steadyFrames = 0;
+    failedFrames = 0;
+    strict = false;
+    return;
+}
+
+// Public AllocationTracker info
+bool AllocationTracker::IsHooked() const {
+#if defined(TRACK_ALLOCATIONS) || defined(STRICT_ALLOCATIONS)
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint64_t AllocationTracker::GetCount(int slot) const {
+    return counts[slot];
+}
+
+uint64_t AllocationTracker::GetBytes(int slot) const {
+    return bytes[slot];
+}
+
+uint64_t AllocationTracker::GetFrameCount() const {
+    uint64_t count = 0;
+    for (uint64_t x : counts) {
+        count += x;
+    }
+    return count;
+}
+
+uint64_t AllocationTracker::GetFrees() const {
+    return frees;
+}
+
+uint64_t AllocationTracker::GetSteadyFrames() const {
+    return steadyFrames;
+}
+
+uint64_t AllocationTracker::GetFailedFrames() const {
+    return failedFrames;
+}
+
+void AllocationTracker::Draw(uint32_t buff[], uint32_t x, uint32_t y) const {
+    DrawString(buff, IsHooked() ? "ALLOCATIONS" : "ALLOCATIONS NOT TRACKED", x, y, 2);
+    ArenaString text(frameArena);
+    for (int i = 0; i <= ALLOCATION_NOPHASE; i++) {
+        y += 20;
+        text.assign(SLOT_NAMES[i]);
+        text += ": ";
+        text += std::to_string(counts[i]).c_str();
+        text += " ";
+        text += std::to_string(bytes[i]).c_str();
+        text += "B";
+        DrawString(buff, text.c_str(), x, y, 2);
+    }
+    y += 20;
+    text.assign("STEADY: ");
+    text += std::to_string(steadyFrames).c_str();
+    text += " FAILED: ";
+    text += std::to_string(failedFrames).c_str();
+    DrawString(buff, text.c_str(), x, y, 2);
+    return;
+}
+
+// Public AllocationTracker update
+void AllocationTracker::BeginFrame(bool steady) {
+    for (int i = 0; i <= ALLOCATION_NOPHASE; i++) {
+        uint64_t count = totalCounts[i].load(std::memory_order_relaxed);
+        uint64_t size = totalBytes[i].load(std::memory_order_relaxed);
+        counts[i] = count - startCounts[i];
+        bytes[i] = size - startBytes[i];
+        startCounts[i] = count;
+        startBytes[i] = size;
+    }
+    uint64_t freed = totalFrees.load(std::memory_order_relaxed);
+    frees = freed - startFrees;
+    startFrees = freed;
+    // The frame that ends is judged once it and the warmup before it stayed in play
+    streak = steady ? streak + 1 : 0;
+    if (streak > ALLOCATION_WARMUP) {
+        steadyFrames++;
+        if (GetFrameCount()) {
+            failedFrames++;
+            if (strict) {
+                Fail();
+            }
+        }
+    }
+    return;
+}
+
+void AllocationTracker::SetStrict(bool argStrict) {
+    strict = argStrict;
+    return;
+}
+
+// Private AllocationTracker
+void AllocationTracker::Fail() const {
+    FILE* files[] = { stderr, std::fopen(ALLOCATIONREPORTFILE, "w") };
+    for (FILE* file : files) {
+        if (!file) {
+            continue;
+        }
+        std::fprintf(file, "steady frame %llu allocated\n", static_cast<unsigned long long>(steadyFrames));
+        for (int i = 0; i <= ALLOCATION_NOPHASE; i++) {
+            std::fprintf(file, "%s %llu %lluB\n", SLOT_NAMES[i], static_cast<unsigned long long>(counts[i]), static_cast<unsigned long long>(bytes[i]));
+        }
+    }
+    if (files[1]) {
+        std::fclose(files[1]);
+    }
+    std::abort();
+}
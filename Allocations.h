@@ -0,0 +1,47 @@
+#pragma once
+#include "Instrumentation.h"
+#include <stdint.h>
+
+// Allocation constants
+// GAME frames in a row before a frame counts as steady state
+constexpr uint32_t ALLOCATION_WARMUP = 120;
+// Slot of allocations made outside any timed phase, on the main thread or a worker
+constexpr int ALLOCATION_NOPHASE = static_cast<int>(Phase::COUNT);
+
+// Counts heap allocations and their bytes per frame phase. The counting operator new and
+// delete are only compiled in with TRACK_ALLOCATIONS or STRICT_ALLOCATIONS defined,
+// otherwise every count stays zero. An allocation is charged to the innermost ScopedTimer
+// of the thread that made it. A frame is steady once ALLOCATION_WARMUP GAME frames passed
+// without a state or level change; in strict mode a steady frame that allocates ends the
+// run with a report of where.
+class AllocationTracker {
+public:
+    AllocationTracker();
+
+    // Info
+    bool IsHooked() const;
+    // Of the previous frame, ALLOCATION_NOPHASE for the ones outside the phases
+    uint64_t GetCount(int slot) const;
+    uint64_t GetBytes(int slot) const;
+    uint64_t GetFrameCount() const;
+    uint64_t GetFrees() const;
+    uint64_t GetSteadyFrames() const;
+    // Steady frames that allocated
+    uint64_t GetFailedFrames() const;
+    void Draw(uint32_t buff[], uint32_t x, uint32_t y) const;
+
+    // Update
+    // Closes the previous frame, steady if it stayed in GAME on one level throughout
+    void BeginFrame(bool steady);
+    void SetStrict(bool argStrict);
+private:
+    uint64_t counts[ALLOCATION_NOPHASE + 1], bytes[ALLOCATION_NOPHASE + 1];
+    uint64_t frees;
+    uint32_t streak;
+    uint64_t steadyFrames, failedFrames;
+    bool strict;
+
+    void Fail() const;
+};
+
+extern AllocationTracker allocations;
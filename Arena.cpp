@@ -0,0 +1,68 @@
+#include "Arena.h"
+#include <algorithm>
+
+Arena frameArena;
+
+// Class Arena
+// Public Arena
+Arena::Arena(size_t argBlockSize) {
+    blockSize = argBlockSize;
+    current = 0;
+    offset = 0;
+    used = 0;
+    peak = 0;
+    return;
+}
+
+Arena::~Arena() {
+    for (auto& x : blocks) {
+        delete[] x.data;
+    }
+    return;
+}
+
+// Public Arena info
+size_t Arena::GetCapacity() const {
+    size_t capacity = 0;
+    for (const auto& x : blocks) {
+        capacity += x.size;
+    }
+    return capacity;
+}
+
+size_t Arena::GetPeak() const {
+    return peak;
+}
+
+size_t Arena::GetUsed() const {
+    return used;
+}
+
+// Public Arena allocation
+void* Arena::Allocate(size_t size, size_t align) {
+    // The rest of a block that is too small is skipped, the next kept one may fit
+    for (; current < blocks.size(); current++, offset = 0) {
+        size_t start = (reinterpret_cast<uintptr_t>(blocks[current].data) + offset + align - 1) / align * align
+            - reinterpret_cast<uintptr_t>(blocks[current].data);
+        if (start + size <= blocks[current].size) {
+            used += start + size - offset;
+            offset = start + size;
+            peak = std::max(peak, used);
+            return blocks[current].data + start;
+        }
+    }
+    // new[] returns memory aligned for any fundamental type, so the block start fits
+    Block block = { new uint8_t[std::max(blockSize, size)], std::max(blockSize, size) };
+    blocks.push_back(block);
+    offset = size;
+    used += size;
+    peak = std::max(peak, used);
+    return block.data;
+}
+
+void Arena::Reset() {
+    current = 0;
+    offset = 0;
+    used = 0;
+    return;
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <stdint.h>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Arena constants
+constexpr size_t ARENA_BLOCKSIZE = 64 * 1024;
+
+// Bump allocator: an allocation moves a pointer, nothing is freed on its own and Reset
+// drops everything at once without running a destructor. The blocks stay over resets, so
+// once an arena reached its peak it does not touch the heap any more. One owner thread.
+class Arena {
+public:
+    explicit Arena(size_t argBlockSize = ARENA_BLOCKSIZE);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Info
+    size_t GetCapacity() const;
+    size_t GetPeak() const;
+    size_t GetUsed() const;
+
+    // Allocation
+    void* Allocate(size_t size, size_t align);
+    // Default-initialized, Reset does not destroy them so they must not need it
+    template <class T>
+    T* Create(size_t count = 1);
+    void Reset();
+private:
+    struct Block {
+        uint8_t* data;
+        size_t size;
+    };
+    std::vector<Block> blocks;
+    size_t blockSize, current, offset, used, peak;
+};
+
+// Standard allocator over an arena for containers and strings; deallocate does nothing.
+// A copied container goes to the heap, so it may outlive the arena of the original.
+template <class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::false_type propagate_on_container_move_assignment;
+    typedef std::false_type propagate_on_container_swap;
+
+    ArenaAllocator();
+    ArenaAllocator(Arena& argArena);
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& x);
+
+    T* allocate(size_t count);
+    void deallocate(T* p, size_t count);
+    ArenaAllocator select_on_container_copy_construction() const;
+
+    Arena* arena;
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b);
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b);
+
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> ArenaString;
+
+// Text and scratch of the current frame on the main thread, dropped at the end of draw()
+extern Arena frameArena;
+
+// Class Arena
+template <class T>
+T* Arena::Create(size_t count) {
+    static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+    T* p = static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+    for (size_t i = 0; i < count; i++) {
+        new (p + i) T;
+    }
+    return p;
+}
+
+// Class ArenaAllocator
+template <class T>
+ArenaAllocator<T>::ArenaAllocator() : arena(nullptr) {
+}
+
+template <class T>
+ArenaAllocator<T>::ArenaAllocator(Arena& argArena) : arena(&argArena) {
+}
+
+template <class T>
+template <class U>
+ArenaAllocator<T>::ArenaAllocator(const ArenaAllocator<U>& x) : arena(x.arena) {
+}
+
+template <class T>
+T* ArenaAllocator<T>::allocate(size_t count) {
+    if (!arena) {
+        return static_cast<T*>(::operator new(sizeof(T) * count));
+    }
+    return static_cast<T*>(arena->Allocate(sizeof(T) * count, alignof(T)));
+}
+
+template <class T>
+void ArenaAllocator<T>::deallocate(T* p, size_t count) {
+    if (!arena) {
+        ::operator delete(p);
+    }
+    return;
+}
+
+template <class T>
+ArenaAllocator<T> ArenaAllocator<T>::select_on_container_copy_construction() const {
+    return ArenaAllocator();
+}
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.arena == b.arena;
+}
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.arena != b.arena;
+}
@@ -0,0 +1,454 @@
+#include "Audio.h"
+#include "Arena.h"
+#include "Engine.h"
+#include "Random.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AUDIO_SSE2
+#endif
+
+// Headroom of the mix, a handful of full voices clip rather than every pair of them
+constexpr float AUDIO_MASTER = 0.5f;
+// A looping voice stops this long after its last trigger, a bit more than two ticks
+constexpr uint32_t AUDIO_HOLD = AUDIO_RATE / 24;
+constexpr float AUDIO_SHOTLENGTH = 0.12f;
+constexpr float AUDIO_EXPLOSIONLENGTH = 0.9f;
+constexpr float AUDIO_THRUSTLENGTH = 0.25f;
+constexpr float AUDIO_SHOTGAIN = 0.5f;
+constexpr float AUDIO_DEBRISGAIN = 0.15f;
+constexpr float AUDIO_THRUSTGAIN = 0.4f;
+
+// Deterministic noise, the clips are the same on every run
+static float Noise(uint32_t& state) {
+    return static_cast<float>(XorShift32(state)) / 2147483648.0f - 1.0f;
+}
+
+// Square wave sweeping down from a high pitch, fading out
+static void MakeShot(std::vector<float>& clip) {
+    clip.resize(static_cast<size_t>(AUDIO_SHOTLENGTH * AUDIO_RATE));
+    float phase = 0;
+    for (size_t i = 0; i < clip.size(); i++) {
+        float t = static_cast<float>(i) / clip.size();
+        phase += (1400.0f - 1100.0f * t) / AUDIO_RATE;
+        phase -= floorf(phase);
+        clip[i] = (phase < 0.5f ? 0.6f : -0.6f) * (1 - t) * (1 - t);
+    }
+    return;
+}
+
+// Noise through a low pass that closes while it decays
+static void MakeExplosion(std::vector<float>& clip) {
+    clip.resize(static_cast<size_t>(AUDIO_EXPLOSIONLENGTH * AUDIO_RATE));
+    uint32_t state = 0x12345678;
+    float low = 0;
+    for (size_t i = 0; i < clip.size(); i++) {
+        float t = static_cast<float>(i) / clip.size();
+        low += (0.25f - 0.23f * t) * (Noise(state) - low);
+        clip[i] = std::min(1.0f, 3.0f * low) * expf(-4.0f * t);
+    }
+    return;
+}
+
+// Steady rumble, played in a loop
+static void MakeThrust(std::vector<float>& clip) {
+    clip.resize(static_cast<size_t>(AUDIO_THRUSTLENGTH * AUDIO_RATE));
+    uint32_t state = 0x9E3779B9;
+    float low = 0;
+    for (size_t i = 0; i < clip.size(); i++) {
+        low += 0.04f * (Noise(state) - low);
+        clip[i] = std::max(-1.0f, std::min(1.0f, 4.0f * low));
+    }
+    // Faded in and out over a few milliseconds so the loop does not click
+    size_t fade = AUDIO_RATE / 200;
+    for (size_t i = 0; i < fade; i++) {
+        float gain = static_cast<float>(i) / fade;
+        clip[i] *= gain;
+        clip[clip.size() - 1 - i] *= gain;
+    }
+    return;
+}
+
+// Adds frames of a clip times a gain to a planar channel pair
+static void MixSpan(float left[], float right[], const float clip[], uint32_t count, float gainLeft, float gainRight) {
+    uint32_t i = 0;
+#ifdef AUDIO_SSE2
+    const __m128 gl = _mm_set1_ps(gainLeft);
+    const __m128 gr = _mm_set1_ps(gainRight);
+    for (; i + 4 <= count; i += 4) {
+        __m128 s = _mm_loadu_ps(clip + i);
+        _mm_storeu_ps(left + i, _mm_add_ps(_mm_loadu_ps(left + i), _mm_mul_ps(s, gl)));
+        _mm_storeu_ps(right + i, _mm_add_ps(_mm_loadu_ps(right + i), _mm_mul_ps(s, gr)));
+    }
+#endif
+    for (; i < count; i++) {
+        left[i] += clip[i] * gainLeft;
+        right[i] += clip[i] * gainRight;
+    }
+    return;
+}
+
+// Planar float to interleaved 16-bit, saturated
+static void Interleave(const float left[], const float right[], int16_t output[], uint32_t count) {
+    uint32_t i = 0;
+#ifdef AUDIO_SSE2
+    const __m128 scale = _mm_set1_ps(32767.0f * AUDIO_MASTER);
+    for (; i + 4 <= count; i += 4) {
+        __m128i l = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(left + i), scale));
+        __m128i r = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(right + i), scale));
+        __m128i lo = _mm_unpacklo_epi32(l, r);
+        __m128i hi = _mm_unpackhi_epi32(l, r);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i * 2), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for (; i < count; i++) {
+        float l = std::max(-32768.0f, std::min(32767.0f, left[i] * 32767.0f * AUDIO_MASTER));
+        float r = std::max(-32768.0f, std::min(32767.0f, right[i] * 32767.0f * AUDIO_MASTER));
+        output[i * 2] = static_cast<int16_t>(lrintf(l));
+        output[i * 2 + 1] = static_cast<int16_t>(lrintf(r));
+    }
+    return;
+}
+
+static void WriteLE(std::ofstream& output, uint32_t value, uint32_t size) {
+    for (uint32_t i = 0; i < size; i++) {
+        output.put(static_cast<char>(value >> (i * 8) & 0xFF));
+    }
+    return;
+}
+
+// Class AudioSink
+AudioSink::~AudioSink() {
+    return;
+}
+
+// Class NullAudioSink
+// Public NullAudioSink
+NullAudioSink::NullAudioSink() {
+    rate = AUDIO_RATE;
+    return;
+}
+
+bool NullAudioSink::Open(uint32_t argRate) {
+    rate = argRate;
+    next = std::chrono::steady_clock::now();
+    return true;
+}
+
+void NullAudioSink::Close() {
+    return;
+}
+
+// Sleeps as long as the frames would play; the timer of the system decides how evenly
+void NullAudioSink::Write(const int16_t samples[], uint32_t frames) {
+    next += std::chrono::microseconds(static_cast<int64_t>(frames) * 1000000 / rate);
+    auto now = std::chrono::steady_clock::now();
+    // A mixer held up for long starts again from now instead of catching up in a burst
+    if (now > next + std::chrono::milliseconds(100)) {
+        next = now;
+    }
+    std::this_thread::sleep_until(next);
+    return;
+}
+
+// Class WavAudioSink
+// Public WavAudioSink
+WavAudioSink::WavAudioSink(const std::string& argName) : NullAudioSink() {
+    name = argName;
+    bytes = 0;
+    return;
+}
+
+bool WavAudioSink::Open(uint32_t rate) {
+    output.open(name, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        return false;
+    }
+    // Sizes are patched in Close
+    bytes = 0;
+    output.write("RIFF", 4);
+    WriteLE(output, 0, 4);
+    output.write("WAVEfmt ", 8);
+    WriteLE(output, 16, 4);
+    WriteLE(output, 1, 2);
+    WriteLE(output, 2, 2);
+    WriteLE(output, rate, 4);
+    WriteLE(output, rate * 4, 4);
+    WriteLE(output, 4, 2);
+    WriteLE(output, 16, 2);
+    output.write("data", 4);
+    WriteLE(output, 0, 4);
+    return NullAudioSink::Open(rate);
+}
+
+void WavAudioSink::Close() {
+    if (!output.is_open()) {
+        return;
+    }
+    output.seekp(4);
+    WriteLE(output, 36 + bytes, 4);
+    output.seekp(40);
+    WriteLE(output, bytes, 4);
+    output.close();
+    NullAudioSink::Close();
+    return;
+}
+
+// Samples are little-endian like every platform the game runs on
+void WavAudioSink::Write(const int16_t samples[], uint32_t frames) {
+    output.write(reinterpret_cast<const char*>(samples), frames * 2 * sizeof(int16_t));
+    bytes += frames * 2 * sizeof(int16_t);
+    NullAudioSink::Write(samples, frames);
+    return;
+}
+
+// Class AudioMixer
+// Public AudioMixer
+AudioMixer::AudioMixer() : head(0), tail(0), running(false), blocks(0), activeVoices(0), mixTotal(0), mixMax(0), jitterMax(0), mixBlocks(0) {
+    MakeShot(clips[static_cast<int>(Sound::SHOT)]);
+    MakeExplosion(clips[static_cast<int>(Sound::EXPLOSION)]);
+    MakeThrust(clips[static_cast<int>(Sound::THRUST)]);
+    voiceCount = 0;
+    mixTime = 0;
+    maxMixTime = 0;
+    maxJitter = 0;
+    dropped = 0;
+    return;
+}
+
+AudioMixer::~AudioMixer() {
+    Stop();
+    return;
+}
+
+// Public AudioMixer info
+uint32_t AudioMixer::GetBlocks() const {
+    return blocks.load(std::memory_order_relaxed);
+}
+
+uint32_t AudioMixer::GetDropped() const {
+    return dropped;
+}
+
+float AudioMixer::GetMixTime() const {
+    return mixTime;
+}
+
+float AudioMixer::GetMaxMixTime() const {
+    return maxMixTime;
+}
+
+float AudioMixer::GetMaxJitter() const {
+    return maxJitter;
+}
+
+uint32_t AudioMixer::GetVoices() const {
+    return activeVoices.load(std::memory_order_relaxed);
+}
+
+bool AudioMixer::IsRunning() const {
+    return running.load();
+}
+
+void AudioMixer::Draw(uint32_t buff[], uint32_t x, uint32_t y) const {
+    if (!IsRunning()) {
+        return;
+    }
+    ArenaString text(frameArena);
+    text.assign("AUDIO VOICES: ");
+    text += std::to_string(GetVoices()).c_str();
+    DrawString(buff, text.c_str(), x, y, 2);
+    text.assign("MIX US: ");
+    text += std::to_string(static_cast<uint64_t>(mixTime)).c_str();
+    text += " MAX ";
+    text += std::to_string(static_cast<uint64_t>(maxMixTime)).c_str();
+    DrawString(buff, text.c_str(), x, y + 20, 2);
+    text.assign("JITTER US: ");
+    text += std::to_string(static_cast<uint64_t>(maxJitter)).c_str();
+    DrawString(buff, text.c_str(), x, y + 40, 2);
+    return;
+}
+
+// Public AudioMixer update
+void AudioMixer::Play(const std::vector<Effect>& effects, Point listener, Point field) {
+    for (const auto& effect : effects) {
+        Point delta = ShortestDelta(listener, effect.pos, field);
+        if (std::fabs(delta.x) > SCREEN_WIDTH || std::fabs(delta.y) > SCREEN_HEIGHT) {
+            continue;
+        }
+        float pan = std::max(-1.0f, std::min(1.0f, delta.x / (SCREEN_WIDTH / 2)));
+        switch (effect.type) {
+        case EffectType::SHOT:
+            Play(Sound::SHOT, AUDIO_SHOTGAIN, pan);
+            break;
+        case EffectType::EXPLOSION:
+            Play(Sound::EXPLOSION, 1.0f, pan);
+            break;
+        case EffectType::DEBRIS:
+            // Bigger asteroids break louder
+            Play(Sound::EXPLOSION, std::min(1.0f, AUDIO_DEBRISGAIN * effect.size / 10), pan);
+            break;
+        case EffectType::THRUST:
+            Play(Sound::THRUST, AUDIO_THRUSTGAIN, pan);
+            break;
+        }
+    }
+    return;
+}
+
+bool AudioMixer::Play(Sound sound, float gain, float pan) {
+    uint32_t slot = head.load(std::memory_order_relaxed);
+    if (slot - tail.load(std::memory_order_acquire) == AUDIO_QUEUESIZE) {
+        dropped++;
+        return false;
+    }
+    ring[slot % AUDIO_QUEUESIZE] = { sound, gain, pan };
+    head.store(slot + 1, std::memory_order_release);
+    return true;
+}
+
+void AudioMixer::Measure() {
+    uint64_t count = mixBlocks.exchange(0, std::memory_order_relaxed);
+    uint64_t total = mixTotal.exchange(0, std::memory_order_relaxed);
+    // Keeps the last values over a frame without a block
+    if (count == 0) {
+        return;
+    }
+    mixTime = total / 1000.0f / count;
+    maxMixTime = mixMax.exchange(0, std::memory_order_relaxed) / 1000.0f;
+    maxJitter = jitterMax.exchange(0, std::memory_order_relaxed) / 1000.0f;
+    return;
+}
+
+bool AudioMixer::Start(std::unique_ptr<AudioSink> argSink) {
+    Stop();
+    if (!argSink || !argSink->Open(AUDIO_RATE)) {
+        return false;
+    }
+    sink = std::move(argSink);
+    running.store(true);
+    mixer = std::thread(&AudioMixer::MixLoop, this);
+    return true;
+}
+
+void AudioMixer::Stop() {
+    running.store(false);
+    if (mixer.joinable()) {
+        mixer.join();
+    }
+    if (sink) {
+        sink->Close();
+        sink.reset();
+    }
+    return;
+}
+
+const int16_t* AudioMixer::MixBlock() {
+    for (uint32_t slot = tail.load(std::memory_order_relaxed); slot != head.load(std::memory_order_acquire); slot++) {
+        Take(ring[slot % AUDIO_QUEUESIZE]);
+        tail.store(slot + 1, std::memory_order_release);
+    }
+    std::memset(mixLeft, 0, sizeof(mixLeft));
+    std::memset(mixRight, 0, sizeof(mixRight));
+    for (uint32_t i = 0; i < voiceCount;) {
+        Voice& x = voices[i];
+        uint32_t done = 0;
+        while (done < AUDIO_BLOCK) {
+            uint32_t count = std::min(AUDIO_BLOCK - done, x.length - x.position);
+            if (x.loop) {
+                count = std::min(count, x.remaining);
+            }
+            if (count == 0) {
+                break;
+            }
+            MixSpan(mixLeft + done, mixRight + done, x.clip + x.position, count, x.left, x.right);
+            done += count;
+            x.position += count;
+            if (x.loop) {
+                x.remaining -= count;
+                if (x.position == x.length) {
+                    x.position = 0;
+                }
+            }
+        }
+        // Finished voices are replaced by the last one
+        if (x.position == x.length || (x.loop && x.remaining == 0)) {
+            x = voices[--voiceCount];
+            continue;
+        }
+        i++;
+    }
+    Interleave(mixLeft, mixRight, block, AUDIO_BLOCK);
+    activeVoices.store(voiceCount, std::memory_order_relaxed);
+    return block;
+}
+
+// Private AudioMixer
+void AudioMixer::MixLoop() {
+    const auto period = std::chrono::nanoseconds(static_cast<int64_t>(AUDIO_BLOCK) * 1000000000 / AUDIO_RATE);
+    auto previous = std::chrono::steady_clock::now();
+    bool first = true;
+    while (running.load()) {
+        auto begin = std::chrono::steady_clock::now();
+        if (!first) {
+            uint64_t jitter = static_cast<uint64_t>(std::abs((begin - previous - period).count()));
+            if (jitter > jitterMax.load(std::memory_order_relaxed)) {
+                jitterMax.store(jitter, std::memory_order_relaxed);
+            }
+        }
+        first = false;
+        previous = begin;
+        const int16_t* output = MixBlock();
+        uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+        mixTotal.fetch_add(time, std::memory_order_relaxed);
+        mixBlocks.fetch_add(1, std::memory_order_relaxed);
+        if (time > mixMax.load(std::memory_order_relaxed)) {
+            mixMax.store(time, std::memory_order_relaxed);
+        }
+        blocks.fetch_add(1, std::memory_order_relaxed);
+        sink->Write(output, AUDIO_BLOCK);
+    }
+    return;
+}
+
+// Equal power panning
+void AudioMixer::Take(const AudioCommand& command) {
+    float angle = (command.pan + 1) * GAME_PI / 4;
+    float left = command.gain * cosf(angle);
+    float right = command.gain * sinf(angle);
+    const std::vector<float>& clip = clips[static_cast<int>(command.sound)];
+    bool loop = command.sound == Sound::THRUST;
+    if (loop) {
+        // A thrust every tick keeps one voice going, it follows the ship across the field
+        for (uint32_t i = 0; i < voiceCount; i++) {
+            Voice& x = voices[i];
+            if (x.loop && x.sound == command.sound) {
+                x.remaining = AUDIO_HOLD;
+                x.left = left;
+                x.right = right;
+                return;
+            }
+        }
+    }
+    // With every voice busy the one closest to its end makes room
+    uint32_t index = voiceCount;
+    if (voiceCount == AUDIO_VOICES) {
+        index = 0;
+        for (uint32_t i = 1; i < voiceCount; i++) {
+            const Voice& x = voices[i];
+            const Voice& best = voices[index];
+            uint32_t rest = x.loop ? x.remaining : x.length - x.position;
+            uint32_t bestRest = best.loop ? best.remaining : best.length - best.position;
+            if (rest < bestRest) {
+                index = i;
+            }
+        }
+    }
+    else {
+        voiceCount++;
+    }
+    voices[index] = { clip.data(), static_cast<uint32_t>(clip.size()), 0, left, right, loop ? AUDIO_HOLD : 0, command.sound, loop };
+    return;
+}
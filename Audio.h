@@ -0,0 +1,142 @@
+#pragma once
+#include "Game.h"
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Audio constants
+constexpr uint32_t AUDIO_RATE = 48000;
+// Frames mixed per block, about 5 ms at AUDIO_RATE
+constexpr uint32_t AUDIO_BLOCK = 256;
+constexpr uint32_t AUDIO_VOICES = 32;
+// Commands in flight from the game to the mixer
+constexpr uint32_t AUDIO_QUEUESIZE = 256;
+
+enum class Sound {
+    SHOT,
+    EXPLOSION,
+    THRUST,
+    COUNT
+};
+
+// Request of the game thread: start a sound, or keep a looping one going
+struct AudioCommand {
+    Sound sound;
+    float gain;
+    // -1 left to 1 right
+    float pan;
+};
+
+// Where mixed blocks of interleaved 16-bit stereo go. Write paces the mixer: it returns
+// once the sink wants the next block, like the callback of a device would be called.
+class AudioSink {
+public:
+    virtual ~AudioSink();
+
+    virtual bool Open(uint32_t rate) = 0;
+    virtual void Close() = 0;
+    virtual void Write(const int16_t samples[], uint32_t frames) = 0;
+};
+
+// Plays nothing in real time, for machines without an audio device
+class NullAudioSink : public AudioSink {
+public:
+    NullAudioSink();
+
+    bool Open(uint32_t rate) override;
+    void Close() override;
+    void Write(const int16_t samples[], uint32_t frames) override;
+private:
+    std::chrono::steady_clock::time_point next;
+    uint32_t rate;
+};
+
+// Records what would have been played into a 16-bit stereo WAV file, in real time as well
+class WavAudioSink : public NullAudioSink {
+public:
+    explicit WavAudioSink(const std::string& argName);
+
+    bool Open(uint32_t rate) override;
+    void Close() override;
+    void Write(const int16_t samples[], uint32_t frames) override;
+private:
+    std::string name;
+    std::ofstream output;
+    uint32_t bytes;
+};
+
+// Mixes the sounds of the game on its own thread. The game thread only pushes commands into
+// a single-producer single-consumer ring, a full ring drops them. The mixer takes all
+// pending commands at the start of every block, mixes the voices into planar float with
+// SSE and hands the block to the sink. Sounds are synthesized once at the start.
+class AudioMixer {
+public:
+    AudioMixer();
+    ~AudioMixer();
+    AudioMixer(const AudioMixer&) = delete;
+    AudioMixer& operator=(const AudioMixer&) = delete;
+
+    // Info
+    uint32_t GetBlocks() const;
+    uint32_t GetDropped() const;
+    // Microseconds, averaged over the blocks since the previous call of Measure
+    float GetMixTime() const;
+    float GetMaxMixTime() const;
+    // Largest difference in microseconds between the time from one block start to the next
+    // and the length of a block, which is how late or early the mixer ran
+    float GetMaxJitter() const;
+    uint32_t GetVoices() const;
+    bool IsRunning() const;
+    void Draw(uint32_t buff[], uint32_t x, uint32_t y) const;
+
+    // Update
+    // Sounds of the last tick, panned by their place relative to the listener in the middle of
+    // the screen. What happens further away than a screen is not heard.
+    void Play(const std::vector<Effect>& effects, Point listener, Point field);
+    bool Play(Sound sound, float gain, float pan);
+    // Latches the statistics of the last period for the Get functions, call once per frame
+    void Measure();
+    bool Start(std::unique_ptr<AudioSink> argSink);
+    void Stop();
+
+    // Takes the pending commands and mixes the next block of interleaved frames, as the
+    // mixer thread does while running; without it the benchmark can call it directly
+    const int16_t* MixBlock();
+private:
+    struct Voice {
+        const float* clip;
+        uint32_t length, position;
+        float left, right;
+        // Looping voices play until this many frames from now, every trigger extends it
+        uint32_t remaining;
+        Sound sound;
+        bool loop;
+    };
+
+    std::vector<float> clips[static_cast<int>(Sound::COUNT)];
+    Voice voices[AUDIO_VOICES];
+    uint32_t voiceCount;
+    alignas(16) float mixLeft[AUDIO_BLOCK];
+    alignas(16) float mixRight[AUDIO_BLOCK];
+    int16_t block[AUDIO_BLOCK * 2];
+
+    AudioCommand ring[AUDIO_QUEUESIZE];
+    std::atomic<uint32_t> head, tail;
+    std::atomic<bool> running;
+    std::unique_ptr<AudioSink> sink;
+    std::thread mixer;
+
+    // Nanoseconds written by the mixer, latched by Measure on the game thread
+    std::atomic<uint32_t> blocks, activeVoices;
+    std::atomic<uint64_t> mixTotal, mixMax, jitterMax, mixBlocks;
+    float mixTime, maxMixTime, maxJitter;
+    uint32_t dropped;
+
+    void MixLoop();
+    void Take(const AudioCommand& command);
+};
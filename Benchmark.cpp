@@ -0,0 +1,819 @@
+#include "Benchmark.h"
+#include "Allocations.h"
+#include "Arena.h"
+#include "Audio.h"
+#include "Bot.h"
+#include "Compositor.h"
+#include "Engine.h"
+#include "Env.h"
+#include "Particles.h"
+#include "Starfield.h"
+#include "Game.h"
+#include "Hash.h"
+#include "Input.h"
+#include "Instrumentation.h"
+#include "Jobs.h"
+#include "Latency.h"
+#include "Net.h"
+#include "Random.h"
+#include "Rollback.h"
+#include "Scalar.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <thread>
+
+// Frame budget at 60 Hz in microseconds
+constexpr double FRAMEBUDGET = 1e6 / 60;
+constexpr float TICK = 1.0f / 60;
+
+static double Elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Last level of the game with extra small asteroids on top of it
+static GameManager MakeWave(uint32_t extra) {
+    GameManager game;
+    game.StartGame(GameType::MULTIPLAYER);
+    for (int i = 0; i < 3; i++) {
+        game.asteroids.clear();
+        game.NextLevel();
+    }
+    for (uint32_t i = 0; i < extra; i++) {
+        game.asteroids.push_back(Asteroid(static_cast<Asteroid::AsteroidSpeed>(i % 3), Asteroid::AsteroidSize::SMALL, game.GetField(), game.GetTime()));
+    }
+    return game;
+}
+
+// Rewinds 8 ticks on every frame, the worst case the window is sized for
+static void BenchRollback(std::ofstream& output) {
+    const uint32_t DEPTH = 8;
+    const uint32_t FRAMES = 200;
+    for (uint32_t extra : { 0u, 100u, 500u }) {
+        GameManager game = MakeWave(extra);
+        Rollback rollback;
+        for (uint32_t i = 0; i < DEPTH; i++) {
+            rollback.Advance(game, TICK);
+        }
+        double total = 0, worst = 0;
+        for (uint32_t i = 0; i < FRAMES; i++) {
+            rollback.SetInput(rollback.GetTick() - DEPTH, 1, static_cast<uint8_t>((i & 1) ? INPUT_LEFT | INPUT_SHOOT : INPUT_UP));
+            auto start = std::chrono::steady_clock::now();
+            rollback.Advance(game, TICK);
+            double us = Elapsed(start);
+            total += us;
+            worst = std::max(worst, us);
+        }
+        output << "rollback depth=" << DEPTH << " asteroids=" << game.asteroids.size() << " avg_us=" << total / FRAMES
+            << " worst_us=" << worst << " budget_pct=" << 100 * total / FRAMES / FRAMEBUDGET << "\n";
+    }
+
+    // A late input must end in exactly the state of having known it in time
+    GameManager reference = MakeWave(100), late = reference;
+    Rollback onTime, rewound;
+    for (uint32_t i = 0; i < 12; i++) {
+        onTime.SetInput(onTime.GetTick(), 0, INPUT_UP | INPUT_RIGHT);
+        onTime.Advance(reference, TICK);
+        rewound.Advance(late, TICK);
+    }
+    rewound.SetInput(0, 0, INPUT_UP | INPUT_RIGHT);
+    rewound.Advance(late, TICK);
+    onTime.Advance(reference, TICK);
+    std::vector<uint8_t> a, b;
+    reference.SaveSnapshot(a);
+    late.SaveSnapshot(b);
+    output << "rollback deterministic=" << (a == b ? "yes" : "no") << "\n";
+    return;
+}
+
+// Saving and restoring waves of growing size. Restores alternate between two states half a
+// second apart into the same manager, the way a rollback goes back and forth; once both have
+// been seen neither side may allocate. The count comes from the tracker in a build that hooks
+// the heap, every build checks that the buffer and the asteroids stayed where they were.
+static void BenchSnapshot(std::ofstream& output) {
+    const uint32_t ROUNDS = 200;
+    for (uint32_t extra : { 0u, 400u, 4000u }) {
+        GameManager game = MakeWave(extra);
+        for (uint32_t i = 0; i < 30; i++) {
+            for (auto& x : game.players) {
+                ApplyPlayerInput(x, (i & 1) ? INPUT_LEFT | INPUT_SHOOT : INPUT_UP, TICK);
+            }
+            game.UpdateTimeGame(TICK);
+        }
+        std::vector<uint8_t> early, late, data;
+        game.SaveSnapshot(early);
+        for (uint32_t i = 0; i < 30; i++) {
+            game.UpdateTimeGame(TICK);
+        }
+        game.SaveSnapshot(late);
+        GameManager restored = game;
+        restored.LoadSnapshot(early.data(), early.size());
+        restored.SaveSnapshot(data);
+        restored.LoadSnapshot(late.data(), late.size());
+        restored.SaveSnapshot(data);
+        const uint8_t* buffer = data.data();
+        const Asteroid* asteroids = restored.asteroids.data();
+        allocations.BeginFrame(false);
+        double saveTime = 0, loadTime = 0;
+        bool loaded = true;
+        for (uint32_t i = 0; i < ROUNDS; i++) {
+            auto start = std::chrono::steady_clock::now();
+            restored.SaveSnapshot(data);
+            saveTime += Elapsed(start);
+            const std::vector<uint8_t>& from = (i & 1) ? late : early;
+            start = std::chrono::steady_clock::now();
+            loaded = restored.LoadSnapshot(from.data(), from.size()) && loaded;
+            loadTime += Elapsed(start);
+        }
+        allocations.BeginFrame(false);
+        restored.SaveSnapshot(data);
+        bool reused = data.data() == buffer && restored.asteroids.data() == asteroids;
+        output << "snapshot asteroids=" << game.asteroids.size() << " bytes=" << late.size() << " save_us=" << saveTime / ROUNDS
+            << " load_us=" << loadTime / ROUNDS << " identical=" << (loaded && data == late ? "yes" : "no") << " reused=" << (reused ? "yes" : "no");
+        if (allocations.IsHooked()) {
+            output << " allocations=" << allocations.GetFrameCount();
+        }
+        output << "\n";
+    }
+    return;
+}
+
+// A host and its clients over localhost with the game running, at growing numbers of
+// asteroids and bullets in a field of the same density and on every preset of the
+// conditioner. The bytes are the snapshots of the server: a full one is what a joining
+// client gets, a delta what each client gets per tick after that. Send and receive are the
+// server's own cost per tick.
+static void BenchNet(std::ofstream& output) {
+    const uint32_t FRAMES = 240;
+    const uint16_t PORT = NET_PORT + 1;
+    const float PERSCREEN = 20.0f;
+    uint32_t random = 0x2F6B1A3D;
+    auto next = [&random]() {
+        return XorShiftUnit(random);
+    };
+    for (uint32_t preset = 0; preset < NET_LINKPRESETCOUNT; preset++) {
+        for (uint32_t clients : { 1u, 4u }) {
+            // The largest ones do not fit into one datagram and go out in fragments
+            for (uint32_t count : { 100u, 500u, 2000u, 8000u }) {
+                float side = std::sqrt(count * static_cast<float>(SCREEN_WIDTH * SCREEN_HEIGHT) / PERSCREEN);
+                GameManager game;
+                game.SetField({ side, side });
+                game.StartGame(GameType::ARENA, 23, clients + 1);
+                Point field = game.GetField();
+                game.asteroids.clear();
+                for (uint32_t i = 0; i < count; i++) {
+                    game.asteroids.push_back(Asteroid(static_cast<Asteroid::AsteroidSpeed>(i % 3), static_cast<Asteroid::AsteroidSize>(i % 3),
+                        { next() * field.x, next() * field.y }, next() * 2 * GAME_PI, game.GetTime()));
+                    game.asteroids.back().SetId(1u << 24 | i);
+                }
+                game.BuildAsteroidGrid();
+                NetServer server;
+                std::vector<std::unique_ptr<NetClient>> remotes;
+                if (!server.Start(PORT, clients + 1)) {
+                    output << "net port=" << PORT << " unavailable\n";
+                    return;
+                }
+                server.GetConditioner().Configure(NET_LINKPRESETS[preset][0], NET_LINKPRESETS[preset][1], NET_LINKPRESETS[preset][2]);
+                for (uint32_t i = 0; i < clients; i++) {
+                    remotes.emplace_back(new NetClient());
+                    remotes.back()->Connect({ NET_LOCALHOST, PORT });
+                    remotes.back()->GetConditioner().Configure(NET_LINKPRESETS[preset][0], NET_LINKPRESETS[preset][1], NET_LINKPRESETS[preset][2]);
+                }
+                double sendTime = 0, receiveTime = 0;
+                uint64_t deltaBytes = 0, asteroids = 0, bullets = 0;
+                uint32_t deltaCount = 0, shots = 0, tick = 0, frame = 0, settled = 0;
+                // Joining takes a few round trips, only the ticks after everyone is in are measured
+                for (; frame < FRAMES && tick < FRAMES * 4; tick++) {
+                    settled = (server.GetClientCount() == clients) ? settled + 1 : 0;
+                    bool measured = settled > 30;
+                    if (measured && frame++ == 0) {
+                        deltaBytes = server.GetTraffic().deltaBytes;
+                        deltaCount = server.GetTraffic().deltaCount;
+                    }
+                    auto start = std::chrono::steady_clock::now();
+                    server.Receive(TICK);
+                    double receiveUs = Elapsed(start);
+                    // The host keeps about a bullet for every four asteroids in the air
+                    Player& host = game.players[0];
+                    while (host.bullets.size() < count / 4) {
+                        host.AddBullet(Player::Bullet({ next() * field.x, next() * field.y }, next() * 2 * GAME_PI));
+                        host.bullets.back().SetId(shots++);
+                    }
+                    game.UpdateTimeGame(TICK);
+                    start = std::chrono::steady_clock::now();
+                    server.SendSnapshots(game, tick);
+                    double sendUs = Elapsed(start);
+                    for (uint32_t i = 0; i < clients; i++) {
+                        remotes[i]->Update(TICK, static_cast<uint8_t>(((tick + i) / 30 & 1) ? INPUT_UP : INPUT_LEFT));
+                    }
+                    if (measured) {
+                        sendTime += sendUs;
+                        receiveTime += receiveUs;
+                        asteroids += game.asteroids.size();
+                        bullets += host.bullets.size();
+                    }
+                }
+                const NetTraffic& traffic = server.GetTraffic();
+                deltaBytes = traffic.deltaBytes - deltaBytes;
+                deltaCount = traffic.deltaCount - deltaCount;
+                frame = std::max(frame, 1u);
+                output << "net preset=" << preset << " clients=" << clients << " asteroids=" << asteroids / frame << " bullets=" << bullets / frame
+                    << " frames=" << frame << " full_bytes=" << traffic.fullBytes / std::max(traffic.fullCount, 1u)
+                    << " delta_bytes=" << deltaBytes / std::max(deltaCount, 1u) << " bytes_per_client_tick=" << deltaBytes / clients / frame
+                    << " full_sent=" << traffic.fullCount << " fragmented=" << traffic.fragmentedCount << " dropped=" << traffic.droppedCount
+                    << " send_us=" << sendTime / frame << " receive_us=" << receiveTime / frame << "\n";
+            }
+        }
+    }
+    return;
+}
+
+// Translucent full-screen span against the same blend done one pixel at a time
+static void BenchCompositor(std::ofstream& output) {
+    const uint32_t COUNT = SCREEN_WIDTH * SCREEN_HEIGHT;
+    const uint32_t FRAMES = 100;
+    const uint32_t COLOR = 0x80402010;
+    std::vector<uint32_t> spans(COUNT), pixels(COUNT);
+    for (uint32_t i = 0; i < COUNT; i++) {
+        spans[i] = pixels[i] = i * 2654435761u;
+    }
+    double spanTime = 0, pixelTime = 0;
+    for (uint32_t i = 0; i < FRAMES; i++) {
+        auto start = std::chrono::steady_clock::now();
+        BlendSpan(spans.data(), COUNT, COLOR);
+        spanTime += Elapsed(start);
+        start = std::chrono::steady_clock::now();
+        for (auto& x : pixels) {
+            BlendPixel(x, COLOR);
+        }
+        pixelTime += Elapsed(start);
+    }
+    output << "compositor pixels=" << COUNT << " span_us=" << spanTime / FRAMES << " pixel_us=" << pixelTime / FRAMES
+        << " identical=" << (spans == pixels ? "yes" : "no") << "\n";
+    return;
+}
+
+// 100k live particles updated and drawn every frame, a burst replacing the ones that died
+static void BenchParticles(std::ofstream& output) {
+    const uint32_t LIVE = 100000;
+    const uint32_t FRAMES = 200;
+    std::unique_ptr<ParticleSystem> particles(new ParticleSystem());
+    std::vector<uint32_t> pixels(SCREEN_WIDTH * SCREEN_HEIGHT);
+    double updateTime = 0, drawTime = 0;
+    uint32_t i = 0;
+    for (; i < FRAMES; i++) {
+        particles->Emit({ SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 }, { 0, 0 }, 300.0f, LIVE - particles->GetCount(), 2.0f, 0x00FFA040);
+        auto start = std::chrono::steady_clock::now();
+        particles->Update(TICK, { SCREEN_WIDTH, SCREEN_HEIGHT });
+        updateTime += Elapsed(start);
+        start = std::chrono::steady_clock::now();
+        particles->Draw({ pixels.data(), SCREEN_WIDTH, SCREEN_HEIGHT, 1.0f });
+        drawTime += Elapsed(start);
+    }
+    output << "particles live=" << LIVE << " update_us=" << updateTime / FRAMES << " draw_us=" << drawTime / FRAMES << "\n";
+    return;
+}
+
+// Drawing a crowded field at each internal resolution, including the upscale
+static void BenchUpscale(std::ofstream& output) {
+    const uint32_t FRAMES = 100;
+    GameManager game = MakeWave(500);
+    std::vector<uint32_t> screen(SCREEN_WIDTH * SCREEN_HEIGHT), world(SCREEN_WIDTH * SCREEN_HEIGHT);
+    for (uint32_t factor : { 1u, 2u, 4u }) {
+        for (bool bilinear : { false, true }) {
+            if (factor == 1 && bilinear) {
+                continue;
+            }
+            Canvas canvas = { factor > 1 ? world.data() : screen.data(), SCREEN_WIDTH / static_cast<int>(factor), SCREEN_HEIGHT / static_cast<int>(factor), 1.0f / factor };
+            double drawTime = 0, upscaleTime = 0;
+            for (uint32_t i = 0; i < FRAMES; i++) {
+                auto start = std::chrono::steady_clock::now();
+                std::fill(canvas.pixels, canvas.pixels + canvas.width * canvas.height, 0);
+                for (const auto& x : game.asteroids) {
+                    x.Draw(canvas, game.GetTime(), game.GetField());
+                }
+                drawTime += Elapsed(start);
+                start = std::chrono::steady_clock::now();
+                if (factor > 1) {
+                    Upscale(canvas, screen.data(), factor, bilinear);
+                }
+                upscaleTime += Elapsed(start);
+            }
+            output << "upscale factor=" << factor << " bilinear=" << bilinear << " asteroids=" << game.asteroids.size()
+                << " draw_us=" << drawTime / FRAMES << " upscale_us=" << upscaleTime / FRAMES << "\n";
+        }
+    }
+    return;
+}
+
+// Clearing and drawing the starfield against copying the full-screen background image
+static void BenchBackground(std::ofstream& output) {
+    const uint32_t FRAMES = 200;
+    Starfield starfield(1);
+    std::vector<uint32_t> screen(SCREEN_WIDTH * SCREEN_HEIGHT), image(SCREEN_WIDTH * SCREEN_HEIGHT, 0x00102030);
+    Canvas canvas = { screen.data(), SCREEN_WIDTH, SCREEN_HEIGHT, 1.0f };
+    double starTime = 0, imageTime = 0;
+    for (uint32_t i = 0; i < FRAMES; i++) {
+        auto start = std::chrono::steady_clock::now();
+        std::fill(screen.begin(), screen.end(), 0);
+        starfield.Draw(canvas, { i * 3.0f, i * 1.0f });
+        starTime += Elapsed(start);
+        start = std::chrono::steady_clock::now();
+        std::copy(image.begin(), image.end(), screen.begin());
+        imageTime += Elapsed(start);
+    }
+    output << "background stars=" << starfield.GetCount() << " stars_us=" << starTime / FRAMES << " image_us=" << imageTime / FRAMES
+        << " stars_bytes=" << starfield.GetCount() * 12 << " image_bytes=" << image.size() * sizeof(uint32_t) << "\n";
+    return;
+}
+
+// Whole frames of a typical and a dense wave rendered with the field in rows and in tiles,
+// at the native resolution and at half of it; both layouts have to give the same pixels
+static void BenchTiles(std::ofstream& output) {
+    const uint32_t FRAMES = 100;
+    std::vector<uint32_t> screen(SCREEN_WIDTH * SCREEN_HEIGHT);
+    for (uint32_t extra : { 0u, 500u }) {
+        GameManager game = MakeWave(extra);
+        ParticleSystem particles;
+        for (uint32_t i = 0; i < 30; i++) {
+            for (auto& x : game.players) {
+                ApplyPlayerInput(x, INPUT_UP | INPUT_SHOOT, TICK);
+            }
+            game.UpdateTimeGame(TICK);
+            particles.Emit(game.effects);
+            particles.Update(TICK, game.GetField());
+        }
+        for (uint32_t preset : { 0u, 2u }) {
+            double times[2] = {};
+            uint64_t hashes[2] = {};
+            for (bool tiled : { false, true }) {
+                RenderSettings settings = { preset, true, nullptr, false, tiled };
+                for (uint32_t i = 0; i < FRAMES; i++) {
+                    auto start = std::chrono::steady_clock::now();
+                    RenderFrame(screen.data(), game, particles, settings, { i * 3.0f, i * 1.0f });
+                    times[tiled] += Elapsed(start);
+                    frameArena.Reset();
+                }
+                hashes[tiled] = HashWords(screen.data(), screen.size());
+            }
+            output << "tiles preset=" << preset << " asteroids=" << game.asteroids.size() << " particles=" << particles.GetCount()
+                << " linear_us=" << times[0] / FRAMES << " tiled_us=" << times[1] / FRAMES
+                << " identical=" << (hashes[0] == hashes[1] ? "yes" : "no") << "\n";
+        }
+    }
+    return;
+}
+
+// Cost of a block with a growing number of voices against the time the block plays, then
+// a second of the mixer thread on the null sink fed like a game in play would feed it
+static void BenchAudio(std::ofstream& output) {
+    const uint32_t BLOCKS = 100;
+    const double blockTime = 1e6 * AUDIO_BLOCK / AUDIO_RATE;
+    for (uint32_t voices : { 1u, 8u, AUDIO_VOICES }) {
+        AudioMixer mixer;
+        for (uint32_t i = 0; i < voices; i++) {
+            mixer.Play(Sound::EXPLOSION, 1.0f, i * 2.0f / voices - 1);
+        }
+        int64_t check = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < BLOCKS; i++) {
+            check += mixer.MixBlock()[i];
+        }
+        double time = Elapsed(start) / BLOCKS;
+        output << "audio voices=" << voices << " block_us=" << time << " budget=" << time / blockTime * 100 << "% check=" << check << "\n";
+    }
+    AudioMixer mixer;
+    mixer.Start(std::unique_ptr<AudioSink>(new NullAudioSink()));
+    for (uint32_t i = 0; i < 60; i++) {
+        mixer.Play(Sound::THRUST, 0.4f, 0);
+        if (i % 6 == 0) {
+            mixer.Play(Sound::SHOT, 0.5f, 0);
+        }
+        if (i % 20 == 0) {
+            mixer.Play(Sound::EXPLOSION, 1.0f, 0);
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(FRAMEBUDGET)));
+    }
+    mixer.Measure();
+    output << "audio thread blocks=" << mixer.GetBlocks() << " mix_us=" << mixer.GetMixTime() << " max_mix_us=" << mixer.GetMaxMixTime()
+        << " max_jitter_us=" << mixer.GetMaxJitter() << " dropped=" << mixer.GetDropped() << "\n";
+    mixer.Stop();
+    return;
+}
+
+// The same dense wave simulated on the caller alone and with the worker threads,
+// both runs have to end in byte-identical states
+static void BenchJobs(std::ofstream& output) {
+    const uint32_t FRAMES = 120;
+    uint32_t workers = jobs.GetWorkerCount();
+    for (uint32_t extra : { 500u, 2000u }) {
+        GameManager initial = MakeWave(extra);
+        std::vector<uint8_t> states[2];
+        double times[2] = { 0, 0 };
+        for (uint32_t run = 0; run < 2; run++) {
+            jobs.SetWorkerCount(run ? workers : 0);
+            GameManager game = initial;
+            for (uint32_t i = 0; i < FRAMES; i++) {
+                for (auto& x : game.players) {
+                    ApplyPlayerInput(x, static_cast<uint8_t>((i & 1) ? INPUT_LEFT | INPUT_SHOOT : INPUT_UP), TICK);
+                }
+                auto start = std::chrono::steady_clock::now();
+                game.UpdateTimeGame(TICK);
+                times[run] += Elapsed(start);
+            }
+            game.SaveSnapshot(states[run]);
+        }
+        output << "jobs asteroids=" << initial.asteroids.size() << " workers=" << workers << " serial_us=" << times[0] / FRAMES
+            << " parallel_us=" << times[1] / FRAMES << " identical=" << (states[0] == states[1] ? "yes" : "no") << "\n";
+    }
+    jobs.SetWorkerCount(workers);
+    return;
+}
+
+// Worlds of growing size with the same number of asteroids per screen, up to a million, seen
+// through a camera that flies across them. The tick and the frame should cost about the same
+// in all of them: only the asteroids near the ship and the cells around the window are looked
+// at. The first index is built at once, index_us is what a later one would cost in a single
+// tick; those are built a part per tick instead, the worst tick shows it.
+static void BenchWorld(std::ofstream& output) {
+    const uint32_t FRAMES = 200;
+    const float PERSCREEN = 40.0f;
+    std::vector<uint32_t> screen(SCREEN_WIDTH * SCREEN_HEIGHT);
+    RenderSettings settings = { 0, true, nullptr, false, false };
+    ParticleSystem particles;
+    uint32_t random = 0x51ED270B;
+    auto next = [&random]() {
+        return XorShiftUnit(random);
+    };
+    for (uint32_t count : { 10000u, 100000u, 1000000u }) {
+        float side = std::floor(std::sqrt(count * static_cast<float>(SCREEN_WIDTH * SCREEN_HEIGHT) / PERSCREEN));
+        GameManager game;
+        game.SetField({ side, side });
+        game.StartGame(GameType::SIGLEPLAYER, 22);
+        side = game.GetField().x;
+        game.asteroids.clear();
+        game.asteroids.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            game.asteroids.push_back(Asteroid(static_cast<Asteroid::AsteroidSpeed>(i % 3), static_cast<Asteroid::AsteroidSize>(i % 3),
+                { next() * side, next() * side }, next() * 2 * GAME_PI, game.GetTime()));
+        }
+        auto start = std::chrono::steady_clock::now();
+        game.BuildAsteroidGrid();
+        double indexTime = Elapsed(start);
+        double tickTime = 0, worstTick = 0, drawTime = 0;
+        uint64_t drawn = 0;
+        for (uint32_t i = 0; i < FRAMES; i++) {
+            // A screen and a half per frame on a diagonal, so the window keeps finding new cells
+            game.players[0].Place({ std::fmod(i * 1.5f * SCREEN_WIDTH, side), std::fmod(i * 1.5f * SCREEN_HEIGHT, side) }, 0);
+            start = std::chrono::steady_clock::now();
+            game.UpdateTimeGame(TICK);
+            double us = Elapsed(start);
+            tickTime += us;
+            worstTick = std::max(worstTick, us);
+            start = std::chrono::steady_clock::now();
+            RenderFrame(screen.data(), game, particles, settings, { 0, 0 });
+            drawTime += Elapsed(start);
+            // Latches the counters of the frame
+            instrumentation.BeginFrame();
+            drawn += instrumentation.GetCount(Counter::DRAWN);
+            frameArena.Reset();
+        }
+        output << "world asteroids=" << count << " side=" << side << " drawn=" << drawn / FRAMES << " draw_us=" << drawTime / FRAMES
+            << " tick_us=" << tickTime / FRAMES << " worst_tick_us=" << worstTick << " index_us=" << indexTime << "\n";
+    }
+    return;
+}
+
+// Arenas of growing size, every ship a bot, with the tick and the frame timed apart. Per ship
+// both should stay about flat: bullets only test the ships in the cells around them.
+static void BenchArena(std::ofstream& output) {
+    const uint32_t FRAMES = 300;
+    std::vector<uint32_t> screen(SCREEN_WIDTH * SCREEN_HEIGHT);
+    RenderSettings settings = { 0, true, nullptr, false, false };
+    ParticleSystem particles;
+    for (uint32_t count : { 2u, 16u, GAME_MAXPLAYERS }) {
+        GameManager game;
+        game.StartGame(GameType::ARENA, 21, count);
+        std::vector<BotController> bots(count);
+        ThreatIndex index;
+        double tickTime = 0, drawTime = 0;
+        uint64_t bullets = 0;
+        uint32_t frame = 0;
+        for (; frame < FRAMES && game.GetState() == GameState::GAME; frame++) {
+            index.Build(game);
+            for (uint32_t i = 0; i < game.players.size(); i++) {
+                if (game.players[i].IsAlive()) {
+                    ApplyPlayerInput(game.players[i], bots[i].Think(index, game.players[i], TICK), TICK);
+                }
+            }
+            auto start = std::chrono::steady_clock::now();
+            game.UpdateTimeGame(TICK);
+            tickTime += Elapsed(start);
+            for (const auto& x : game.players) {
+                bullets += x.bullets.size();
+            }
+            start = std::chrono::steady_clock::now();
+            RenderFrame(screen.data(), game, particles, settings, { 0, 0 });
+            drawTime += Elapsed(start);
+            frameArena.Reset();
+        }
+        uint64_t points = 0;
+        for (const auto& x : game.players) {
+            points += x.GetPoints();
+        }
+        frame = std::max(frame, 1u);
+        output << "arena players=" << count << " frames=" << frame << " bullets=" << bullets / frame << " tick_us=" << tickTime / frame
+            << " draw_us=" << drawTime / frame << " points=" << points << "\n";
+    }
+    return;
+}
+
+// Hundreds of bots flying through a dense wave, their thinking timed apart from the tick.
+// Tests per bot show how few asteroids each query looks at.
+static void BenchBots(std::ofstream& output) {
+    const uint32_t BOTS = 100;
+    const uint32_t FRAMES = 600;
+    GameManager game = MakeWave(150);
+    while (game.players.size() < BOTS) {
+        game.players.push_back(Player(GameType::MULTIPLAYER, 1, 2));
+    }
+    std::vector<BotController> bots(BOTS);
+    ThreatIndex index;
+    double thinkTime = 0;
+    uint64_t tests = 0, shots = 0;
+    uint32_t frame = 0;
+    for (; frame < FRAMES && game.GetState() == GameState::GAME; frame++) {
+        auto start = std::chrono::steady_clock::now();
+        index.Build(game);
+        for (uint32_t i = 0; i < game.players.size(); i++) {
+            uint8_t input = bots[i].Think(index, game.players[i], TICK);
+            shots += (input & INPUT_SHOOT) ? 1 : 0;
+            ApplyPlayerInput(game.players[i], input, TICK);
+        }
+        thinkTime += Elapsed(start);
+        tests += index.GetTests();
+        game.UpdateTimeGame(TICK);
+    }
+    uint64_t points = 0;
+    uint32_t alive = 0;
+    for (const auto& x : game.players) {
+        points += x.GetPoints();
+        alive += x.IsAlive() ? 1 : 0;
+    }
+    output << "bots count=" << BOTS << " frames=" << frame << " think_us=" << thinkTime / std::max(frame, 1u)
+        << " tests_per_bot=" << static_cast<double>(tests) / std::max(frame, 1u) / BOTS << " asteroids_left=" << game.asteroids.size()
+        << " alive=" << alive << " shots=" << shots << " points=" << points << "\n";
+    return;
+}
+
+// A batch of environments stepped with random actions through the C interface, on the
+// caller alone and with the workers; the observations have to match
+static void BenchEnv(std::ofstream& output) {
+    const uint32_t COUNT = 64;
+    const uint32_t STEPS = 300;
+    const uint32_t DOWNSAMPLE = 4;
+    uint32_t workers = jobs.GetWorkerCount();
+    std::vector<float> features[2];
+    std::vector<uint32_t> frames[2];
+    double times[2] = { 0, 0 };
+    uint32_t episodes = 0;
+    for (uint32_t run = 0; run < 2; run++) {
+        jobs.SetWorkerCount(run ? workers : 0);
+        EnvBatch* batch = env_create(COUNT, 1, DOWNSAMPLE, 12345);
+        uint32_t width = 0, height = 0;
+        env_frame_size(batch, &width, &height);
+        features[run].resize(COUNT * env_feature_count(batch));
+        frames[run].resize(COUNT * width * height);
+        std::vector<float> rewards(COUNT);
+        std::vector<uint8_t> actions(COUNT), dones(COUNT);
+        env_reset(batch, features[run].data(), frames[run].data());
+        uint32_t random = 1;
+        episodes = 0;
+        for (uint32_t i = 0; i < STEPS; i++) {
+            for (auto& x : actions) {
+                x = static_cast<uint8_t>(XorShift32(random) & 15);
+            }
+            auto start = std::chrono::steady_clock::now();
+            env_step(batch, actions.data(), features[run].data(), frames[run].data(), rewards.data(), dones.data());
+            times[run] += Elapsed(start);
+            for (auto x : dones) {
+                episodes += x;
+            }
+        }
+        env_destroy(batch);
+    }
+    jobs.SetWorkerCount(workers);
+    output << "env count=" << COUNT << " downsample=" << DOWNSAMPLE << " workers=" << workers
+        << " serial_steps_per_s=" << COUNT * STEPS / times[0] * 1e6 << " parallel_steps_per_s=" << COUNT * STEPS / times[1] * 1e6
+        << " episodes=" << episodes << " identical=" << (features[0] == features[1] && frames[0] == frames[1] ? "yes" : "no") << "\n";
+    return;
+}
+
+// The frame loop of the engine paced at 60 Hz with synthetic presses landing anywhere in
+// the frame before the tick that reads them; the present is a copy of the frame
+static void BenchLatency(std::ofstream& output) {
+    const uint32_t FRAMES = 180;
+    InputSystem input;
+    LatencyTracer tracer;
+    GameManager game = MakeWave(100);
+    std::vector<uint32_t> pixels(SCREEN_WIDTH * SCREEN_HEIGHT), screen(SCREEN_WIDTH * SCREEN_HEIGHT);
+    Canvas canvas = { pixels.data(), SCREEN_WIDTH, SCREEN_HEIGHT, 1.0f };
+    auto deadline = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < FRAMES; i++) {
+        uint64_t now = input.Now();
+        if (i % 6 == 1) {
+            input.Push({ now - (i * 7919) % static_cast<uint32_t>(TICK * 1e6), VK_SPACE, true });
+        }
+        else if (i % 6 == 3) {
+            input.Push({ now, VK_SPACE, false });
+        }
+        const InputSnapshot& keys = input.Consume(InputLayout::SHARED, input.Now());
+        if (keys.HasPress()) {
+            tracer.Input(keys.GetFirstPress());
+        }
+        if (game.GetState() == GameState::GAME) {
+            ApplyPlayerInput(game.players[0], keys.GetPlayerInput(0), TICK);
+            game.UpdateTimeGame(TICK);
+        }
+        tracer.Mark(LatencyStage::SIMULATE, input.Now());
+        std::fill(pixels.begin(), pixels.end(), 0);
+        for (const auto& player : game.players) {
+            player.Draw(canvas);
+            for (const auto& x : player.bullets) {
+                x.Draw(canvas);
+            }
+        }
+        for (const auto& x : game.asteroids) {
+            x.Draw(canvas, game.GetTime(), game.GetField());
+        }
+        tracer.Mark(LatencyStage::RASTER, input.Now());
+        std::copy(pixels.begin(), pixels.end(), screen.begin());
+        tracer.Mark(LatencyStage::PRESENT, input.Now());
+        deadline += std::chrono::microseconds(static_cast<int64_t>(TICK * 1e6));
+        std::this_thread::sleep_until(deadline);
+    }
+    output << "latency samples=" << tracer.GetCount() << " p50_us=" << tracer.GetPercentile(50) << " p90_us=" << tracer.GetPercentile(90)
+        << " p99_us=" << tracer.GetPercentile(99) << " simulate_p50_us=" << tracer.GetPercentile(LatencyStage::SIMULATE, 50)
+        << " raster_p50_us=" << tracer.GetPercentile(LatencyStage::RASTER, 50) << " present_p50_us=" << tracer.GetPercentile(LatencyStage::PRESENT, 50) << "\n";
+    return;
+}
+
+// Field of discs moved and collided with the kinematics of the game on one scalar type.
+// Pairs come from 64 pixel cells visited in a fixed order, so a run depends only on the
+// arithmetic of the scalar.
+template <class T>
+static uint64_t StepField(std::vector<Disc<T>>& discs, uint32_t ticks, double& time) {
+    typedef ScalarMath<T> M;
+    const int CELL = 64;
+    const int COLS = SCREEN_WIDTH / CELL, ROWS = SCREEN_HEIGHT / CELL;
+    const Vec2<T> field = { SCREEN_WIDTH, SCREEN_HEIGHT };
+    const T dt = M::FromFloat(TICK);
+    std::vector<uint32_t> cellStart(COLS * ROWS + 1), order(discs.size()), cellOf(discs.size());
+    std::vector<uint32_t> fill(COLS * ROWS);
+    uint64_t contacts = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t tick = 0; tick < ticks; tick++) {
+        for (auto& x : discs) {
+            x.pos = Advance(x.pos, x.speed, x.dir, dt, field);
+        }
+        std::fill(cellStart.begin(), cellStart.end(), 0);
+        for (uint32_t i = 0; i < discs.size(); i++) {
+            cellOf[i] = (M::ToInt(discs[i].pos.y) / CELL % ROWS) * COLS + M::ToInt(discs[i].pos.x) / CELL % COLS;
+            cellStart[cellOf[i] + 1]++;
+        }
+        for (int i = 0; i < COLS * ROWS; i++) {
+            cellStart[i + 1] += cellStart[i];
+        }
+        std::copy(cellStart.begin(), cellStart.end() - 1, fill.begin());
+        for (uint32_t i = 0; i < discs.size(); i++) {
+            order[fill[cellOf[i]]++] = i;
+        }
+        // Own cell, then the right, lower right, lower and lower left neighbours
+        const int NEIGHBOURS[][2] = { { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 } };
+        for (int cell = 0; cell < COLS * ROWS; cell++) {
+            int cx = cell % COLS, cy = cell / COLS;
+            for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; i++) {
+                for (uint32_t j = i + 1; j < cellStart[cell + 1]; j++) {
+                    contacts += ResolveContact(discs[order[i]], discs[order[j]], field) != ContactResult::NONE;
+                }
+                for (const auto& d : NEIGHBOURS) {
+                    int other = (cy + d[1]) % ROWS * COLS + (cx + d[0] + COLS) % COLS;
+                    for (uint32_t j = cellStart[other]; j < cellStart[other + 1]; j++) {
+                        contacts += ResolveContact(discs[order[i]], discs[order[j]], field) != ContactResult::NONE;
+                    }
+                }
+            }
+        }
+    }
+    time = Elapsed(start) / ticks;
+    return contacts;
+}
+
+// The same field on float and on Q16.16 with table trig. The fixed run prints a hash of
+// its end state, which has to be the same on every machine and build.
+static void BenchScalar(std::ofstream& output) {
+    const uint32_t COUNT = 1500;
+    const uint32_t TICKS = 600;
+    std::vector<Disc<float>> floats(COUNT);
+    std::vector<Disc<Fixed>> fixeds(COUNT);
+    uint32_t random = 7;
+    auto next = [&random]() {
+        return static_cast<float>(XorShift32(random) % 10000) / 10000;
+    };
+    for (uint32_t i = 0; i < COUNT; i++) {
+        float size = 4 + 10 * next();
+        floats[i] = { { next() * SCREEN_WIDTH, next() * SCREEN_HEIGHT }, 20 + 80 * next(), next() * 2 * GAME_PI, size, size * size / 16 };
+        const Disc<float>& x = floats[i];
+        fixeds[i] = { { Fixed::FromFloat(x.pos.x), Fixed::FromFloat(x.pos.y) }, Fixed::FromFloat(x.speed), Fixed::FromFloat(x.dir),
+            Fixed::FromFloat(x.size), Fixed::FromFloat(x.mass) };
+    }
+    double floatTime = 0, fixedTime = 0;
+    uint64_t floatContacts = StepField(floats, TICKS, floatTime);
+    uint64_t fixedContacts = StepField(fixeds, TICKS, fixedTime);
+    uint64_t hash = HASH_FNVBASIS;
+    for (const auto& x : fixeds) {
+        for (Fixed value : { x.pos.x, x.pos.y, x.speed, x.dir }) {
+            hash = HashWord(hash, static_cast<uint32_t>(value.GetRaw()));
+        }
+    }
+    // Worst error of the fixed trig against libm over a few turns
+    float sinError = 0, atanError = 0;
+    for (int i = -4000; i <= 4000; i++) {
+        float angle = i * 0.003f;
+        sinError = std::max(sinError, fabsf(ScalarMath<Fixed>::Sin(Fixed::FromFloat(angle)).ToFloat() - sinf(angle)));
+        float y = sinf(angle) * (1 + abs(i) % 7), x = cosf(angle) * (1 + abs(i) % 7);
+        float angleError = ScalarMath<Fixed>::Atan2(Fixed::FromFloat(y), Fixed::FromFloat(x)).ToFloat() - atan2f(y, x);
+        // Pi and minus pi are the same heading
+        atanError = std::max(atanError, fabsf(remainderf(angleError, 2 * GAME_PI)));
+    }
+    output << "scalar discs=" << COUNT << " ticks=" << TICKS << " float_us=" << floatTime << " fixed_us=" << fixedTime
+        << " float_contacts=" << floatContacts << " fixed_contacts=" << fixedContacts << " fixed_hash=" << std::hex << hash << std::dec
+        << " sin_error=" << sinError << " atan2_error=" << atanError << "\n";
+    return;
+}
+
+// A scripted single player game, turning and firing on every frame, with the frame of the
+// game loop around it: tick, particles, sound and drawing. Built with STRICT_ALLOCATIONS a
+// steady frame that allocates ends the run, otherwise failed counts them.
+static void BenchSteady(std::ofstream& output) {
+    const uint32_t FRAMES = 1200;
+    std::vector<uint32_t> screen(SCREEN_WIDTH * SCREEN_HEIGHT);
+    RenderSettings settings = { 0, true, nullptr, false, false };
+    ParticleSystem particles;
+    AudioMixer mixer;
+    mixer.Start(std::unique_ptr<AudioSink>(new NullAudioSink()));
+    GameManager game;
+    game.StartGame(GameType::SIGLEPLAYER);
+#ifdef STRICT_ALLOCATIONS
+    allocations.SetStrict(true);
+#endif
+    allocations.BeginFrame(false);
+    uint64_t steadyFrames = allocations.GetSteadyFrames(), failedFrames = allocations.GetFailedFrames();
+    uint32_t level = game.GetLevel();
+    uint64_t shots = 0;
+    uint32_t frame = 0;
+    for (; frame < FRAMES && game.GetState() == GameState::GAME; frame++) {
+        // Mostly a turret turning in place, with a push forward now and then
+        uint8_t input = INPUT_LEFT | INPUT_SHOOT | (frame % 90 < 10 ? INPUT_UP : 0);
+        size_t before = game.players[0].bullets.size();
+        ApplyPlayerInput(game.players[0], input, TICK);
+        shots += game.players[0].bullets.size() > before ? 1 : 0;
+        game.UpdateTimeGame(TICK);
+        particles.Emit(game.effects);
+        particles.Update(TICK, game.GetField());
+        mixer.Play(game.effects, game.players[0].GetPosition(), game.GetField());
+        RenderFrame(screen.data(), game, particles, settings, { 0, 0 });
+        frameArena.Reset();
+        allocations.BeginFrame(game.GetState() == GameState::GAME && game.GetLevel() == level);
+        level = game.GetLevel();
+    }
+    allocations.BeginFrame(false);
+    allocations.SetStrict(false);
+    mixer.Stop();
+    output << "steady frames=" << frame << " hooked=" << allocations.IsHooked() << " steady=" << allocations.GetSteadyFrames() - steadyFrames
+        << " failed=" << allocations.GetFailedFrames() - failedFrames << " shots=" << shots << " points=" << game.players[0].GetPoints() << "\n";
+    return;
+}
+
+void RunBenchmarks(const std::string& name) {
+    std::ofstream output(name);
+    BenchRollback(output);
+    BenchSnapshot(output);
+    BenchNet(output);
+    BenchCompositor(output);
+    BenchParticles(output);
+    BenchUpscale(output);
+    BenchBackground(output);
+    BenchTiles(output);
+    BenchAudio(output);
+    BenchJobs(output);
+    BenchBots(output);
+    BenchArena(output);
+    BenchSteady(output);
+    BenchWorld(output);
+    BenchEnv(output);
+    BenchLatency(output);
+    BenchScalar(output);
+    return;
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <string>
+
+// Benchmarks of the engine subsystems. A build with BENCHMARK defined runs them from
+// initialize(), writes the results to the given file and quits.
+void RunBenchmarks(const std::string& name);
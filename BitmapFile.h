@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// 32-bit BI_RGB bitmap files. The backbuffer is 0x00RRGGBB, which is exactly such a bitmap
+// in memory; a negative height stores the rows top-down like the backbuffer. Kept in the
+// header so the tools can use it without linking the game.
+
+#pragma pack(push, 1)
+struct BitmapFileHeader {
+    uint16_t type;
+    uint32_t size;
+    uint32_t reserved;
+    uint32_t offset;
+};
+
+struct BitmapInfoHeader {
+    uint32_t size;
+    int32_t width, height;
+    uint16_t planes, bitCount;
+    uint32_t compression, imageSize;
+    int32_t xPerMeter, yPerMeter;
+    uint32_t colorsUsed, colorsImportant;
+};
+#pragma pack(pop)
+
+inline bool WriteBitmapFile(const std::string& name, const std::vector<uint32_t>& pixels, uint32_t width, uint32_t height) {
+    std::ofstream output(name, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        return false;
+    }
+    uint32_t imageSize = static_cast<uint32_t>(pixels.size() * sizeof(uint32_t));
+    BitmapFileHeader file = { 0x4D42, static_cast<uint32_t>(sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader)) + imageSize, 0,
+        static_cast<uint32_t>(sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader)) };
+    BitmapInfoHeader info = { static_cast<uint32_t>(sizeof(BitmapInfoHeader)), static_cast<int32_t>(width), -static_cast<int32_t>(height),
+        1, 32, 0, imageSize, 2835, 2835, 0, 0 };
+    output.write(reinterpret_cast<const char*>(&file), sizeof(file));
+    output.write(reinterpret_cast<const char*>(&info), sizeof(info));
+    output.write(reinterpret_cast<const char*>(pixels.data()), imageSize);
+    return output.good();
+}
+
+// Only reads back what WriteBitmapFile wrote, at the given size
+inline bool ReadBitmapFile(const std::string& name, std::vector<uint32_t>& pixels, uint32_t width, uint32_t height) {
+    std::ifstream input(name, std::ios::binary);
+    BitmapFileHeader file;
+    BitmapInfoHeader info;
+    input.read(reinterpret_cast<char*>(&file), sizeof(file));
+    input.read(reinterpret_cast<char*>(&info), sizeof(info));
+    if (!input || file.type != 0x4D42 || info.width != static_cast<int32_t>(width) || info.height != -static_cast<int32_t>(height) || info.bitCount != 32) {
+        return false;
+    }
+    pixels.resize(static_cast<size_t>(width) * height);
+    input.seekg(file.offset);
+    input.read(reinterpret_cast<char*>(pixels.data()), pixels.size() * sizeof(uint32_t));
+    return input.good();
+}
@@ -0,0 +1,189 @@
+#include "Bot.h"
+#include <algorithm>
+#include <cmath>
+
+// Angle from a to b in [-pi, pi)
+static float AngleBetween(float a, float b) {
+    float delta = std::fmod(b - a + GAME_PI, 2 * GAME_PI);
+    return (delta < 0) ? delta + GAME_PI : delta - GAME_PI;
+}
+
+// Class ThreatIndex
+// Public ThreatIndex
+ThreatIndex::ThreatIndex() {
+    field = { SCREEN_WIDTH, SCREEN_HEIGHT };
+    grid.Reset(field.x, field.y, BOT_CELLSIZE);
+    maxSize = 0;
+    maxSpeed = 0;
+    tests = 0;
+    return;
+}
+
+// Public ThreatIndex info
+uint32_t ThreatIndex::GetCount() const {
+    return static_cast<uint32_t>(positions.size());
+}
+
+Point ThreatIndex::GetField() const {
+    return field;
+}
+
+Point ThreatIndex::GetPosition(uint32_t asteroid) const {
+    return positions[asteroid];
+}
+
+uint64_t ThreatIndex::GetTests() const {
+    return tests;
+}
+
+void ThreatIndex::Build(const GameManager& game) {
+    positions.clear();
+    velocities.clear();
+    sizes.clear();
+    if (game.GetField().x != field.x || game.GetField().y != field.y) {
+        field = game.GetField();
+        grid.Reset(field.x, field.y, BOT_CELLSIZE);
+    }
+    grid.Clear();
+    maxSize = 0;
+    maxSpeed = 0;
+    tests = 0;
+    for (const auto& x : game.asteroids) {
+        Point velocity = x.GetVelocity();
+        Point position = game.GetPosition(x);
+        positions.push_back(position);
+        velocities.push_back(velocity);
+        sizes.push_back(x.GetSize());
+        maxSize = std::max(maxSize, x.GetSize());
+        maxSpeed = std::max(maxSpeed, sqrtf(velocity.x * velocity.x + velocity.y * velocity.y));
+        grid.Insert(position.x, position.y);
+    }
+    grid.Build();
+    return;
+}
+
+// Public ThreatIndex queries
+bool ThreatIndex::FindThreat(Point pos, Point velocity, float radius, float horizon, Threat& threat) const {
+    // Nothing outside this reach can close the gap within the horizon
+    float speed = sqrtf(velocity.x * velocity.x + velocity.y * velocity.y);
+    float reach = (speed + maxSpeed) * horizon + radius + maxSize;
+    bool found = false;
+    grid.Query(pos.x, pos.y, reach, [&](uint32_t i) {
+        tests++;
+        Point d = ShortestDelta(pos, positions[i], field);
+        Point w = { velocities[i].x - velocity.x, velocities[i].y - velocity.y };
+        float r = radius + sizes[i];
+        // |d + w t| = r, the first root is where the circles start to touch
+        float c = d.x * d.x + d.y * d.y - r * r;
+        float t = 0;
+        if (c > 0) {
+            float a = w.x * w.x + w.y * w.y;
+            float b = d.x * w.x + d.y * w.y;
+            float disc = b * b - a * c;
+            if (b >= 0 || disc < 0) {
+                return;
+            }
+            t = (-b - sqrtf(disc)) / a;
+        }
+        if (t <= horizon && (!found || t < threat.time)) {
+            threat = { i, t, d };
+            found = true;
+        }
+    });
+    return found;
+}
+
+bool ThreatIndex::FindNearest(Point pos, float range, uint32_t& asteroid) const {
+    float best = range * range;
+    bool found = false;
+    grid.Query(pos.x, pos.y, range, [&](uint32_t i) {
+        tests++;
+        Point d = ShortestDelta(pos, positions[i], field);
+        float dist2 = d.x * d.x + d.y * d.y;
+        if (dist2 < best) {
+            best = dist2;
+            asteroid = i;
+            found = true;
+        }
+    });
+    return found;
+}
+
+bool ThreatIndex::Aim(Point pos, float shotSpeed, uint32_t asteroid, Point& direction, float& time) const {
+    // |d + v t| = s t for the first positive t
+    Point d = ShortestDelta(pos, positions[asteroid], field);
+    Point v = velocities[asteroid];
+    float a = v.x * v.x + v.y * v.y - shotSpeed * shotSpeed;
+    float b = d.x * v.x + d.y * v.y;
+    float c = d.x * d.x + d.y * d.y;
+    if (a >= 0) {
+        return false;
+    }
+    // a < 0 and c >= 0, so the roots have opposite signs and the larger one is the answer
+    float disc = b * b - a * c;
+    time = (-b - sqrtf(disc)) / a;
+    Point hit = { d.x + v.x * time, d.y + v.y * time };
+    float length = sqrtf(hit.x * hit.x + hit.y * hit.y);
+    if (length < 1e-3f) {
+        return false;
+    }
+    direction = { hit.x / length, hit.y / length };
+    return true;
+}
+
+// Class BotController
+BotController::BotController() {
+    evadeTime = 0;
+    evadeDir = 0;
+    return;
+}
+
+uint8_t BotController::Think(const ThreatIndex& index, const Player& player, float dt) {
+    if (!player.IsAlive()) {
+        return 0;
+    }
+    Point pos = player.GetPosition();
+    Point velocity = player.GetSpeed();
+    float want = player.GetDirection();
+    bool thrust = false, shoot = false;
+
+    Threat threat;
+    evadeTime = std::max(evadeTime - dt, 0.0f);
+    if (index.FindThreat(pos, velocity, player.GetSize() * 0.6f + BOT_MARGIN, BOT_HORIZON, threat)) {
+        // Side-on to the line towards the asteroid, on the side the ship already faces
+        float away = atan2f(threat.delta.y, threat.delta.x);
+        float left = away - GAME_PI / 2, right = away + GAME_PI / 2;
+        evadeDir = (std::fabs(AngleBetween(want, left)) < std::fabs(AngleBetween(want, right))) ? left : right;
+        evadeTime = BOT_EVADETIME;
+    }
+    uint32_t target = 0;
+    Point aim;
+    float time = 0;
+    if (evadeTime > 0) {
+        want = evadeDir;
+        thrust = std::fabs(AngleBetween(player.GetDirection(), want)) < GAME_PI / 4;
+    }
+    else if (index.FindNearest(pos, BOT_RANGE, target) && index.Aim(pos, player.GetShotSpeed(), target, aim, time)) {
+        // The shot flies along the ship's heading plus its velocity at the shot speed, so
+        // the heading is the one whose sum points along the aim: |k aim - v| = s
+        float s = player.GetShotSpeed();
+        float along = aim.x * velocity.x + aim.y * velocity.y;
+        float k = along + sqrtf(std::max(along * along - velocity.x * velocity.x - velocity.y * velocity.y + s * s, 0.0f));
+        want = atan2f(k * aim.y - velocity.y, k * aim.x - velocity.x);
+        shoot = std::fabs(AngleBetween(player.GetDirection(), want)) < BOT_AIMTOLERANCE;
+    }
+    else if (index.FindNearest(pos, SCREEN_WIDTH / 2, target)) {
+        // Nothing in range, close in on the nearest one
+        Point d = ShortestDelta(pos, index.GetPosition(target), index.GetField());
+        want = atan2f(d.y, d.x);
+        thrust = std::fabs(AngleBetween(player.GetDirection(), want)) < BOT_AIMTOLERANCE;
+    }
+
+    uint8_t input = 0;
+    float turn = AngleBetween(player.GetDirection(), want);
+    input |= (turn < -BOT_TURNDEADZONE) ? INPUT_LEFT : 0;
+    input |= (turn > BOT_TURNDEADZONE) ? INPUT_RIGHT : 0;
+    input |= thrust ? INPUT_UP : 0;
+    input |= shoot ? INPUT_SHOOT : 0;
+    return input;
+}
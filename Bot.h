@@ -0,0 +1,73 @@
+#pragma once
+#include "Game.h"
+#include "SpatialGrid.h"
+#include <stdint.h>
+#include <vector>
+
+// Bot constants
+constexpr float BOT_CELLSIZE = 96.0f;
+// Seconds ahead a bot looks for asteroids on a collision course
+constexpr float BOT_HORIZON = 0.75f;
+// Kept free around the hull on top of its collision radius
+constexpr float BOT_MARGIN = 12.0f;
+// Targets further away than this are not worth a shot
+constexpr float BOT_RANGE = 350.0f;
+constexpr float BOT_AIMTOLERANCE = 0.06f;
+constexpr float BOT_TURNDEADZONE = 0.03f;
+// Evasion is held for a moment so the bot does not dither between two threats
+constexpr float BOT_EVADETIME = 0.3f;
+
+// Asteroid about to hit a moving circle
+struct Threat {
+    uint32_t asteroid;
+    // Seconds until the circles touch, 0 when they already do
+    float time;
+    // From the circle's center to the asteroid's, wrapped
+    Point delta;
+};
+
+// Positions, velocities and sizes of the asteroids of one tick in a grid. It is built once
+// per tick and shared by every bot, so a query only looks at the cells around the ship
+// instead of all the asteroids. Indices refer to GameManager::asteroids at build time.
+class ThreatIndex {
+public:
+    ThreatIndex();
+
+    // Info
+    uint32_t GetCount() const;
+    Point GetField() const;
+    Point GetPosition(uint32_t asteroid) const;
+    uint64_t GetTests() const;
+
+    void Build(const GameManager& game);
+
+    // Queries
+    // Earliest asteroid to touch the circle within the horizon, the circle keeps its velocity
+    bool FindThreat(Point pos, Point velocity, float radius, float horizon, Threat& threat) const;
+    // Closest asteroid center within range
+    bool FindNearest(Point pos, float range, uint32_t& asteroid) const;
+    // Direction a shot of the given speed has to fly from pos to meet the asteroid, and when
+    bool Aim(Point pos, float shotSpeed, uint32_t asteroid, Point& direction, float& time) const;
+private:
+    SpatialGrid grid;
+    // Of the game of the last build, the grid follows it
+    Point field;
+    std::vector<Point> positions, velocities;
+    std::vector<float> sizes;
+    float maxSize, maxSpeed;
+    // Candidates looked at by the queries since the last build
+    mutable uint64_t tests;
+};
+
+// Flies one ship: dodges what is about to hit it, otherwise turns to lead the nearest
+// asteroid and fires. Its output are the same input bits the keyboard produces, applied
+// with ApplyPlayerInput, so a bot can take any player slot.
+class BotController {
+public:
+    BotController();
+
+    uint8_t Think(const ThreatIndex& index, const Player& player, float dt);
+private:
+    float evadeTime;
+    float evadeDir;
+};
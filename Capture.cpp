@@ -0,0 +1,300 @@
+#include "Capture.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+// Pixels compared at once while skipping unchanged runs
+constexpr size_t CAPTURE_BLOCK = 16;
+// Shortest run worth a CAPTURE_FILL
+constexpr size_t CAPTURE_MINFILL = 3;
+
+static uint8_t* WriteVarint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+static bool ReadVarint(const uint8_t*& in, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (uint32_t shift = 0; shift < 64; shift += 7) {
+        if (in == end) {
+            return false;
+        }
+        uint8_t byte = *in++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t GetCaptureBound(size_t count) {
+    return count * 5 + 16;
+}
+
+size_t EncodeCaptureFrame(const uint32_t pixels[], uint32_t previous[], size_t count, std::vector<uint8_t>& output) {
+    assert(output.size() >= GetCaptureBound(count));
+    uint8_t* out = output.data();
+    size_t i = 0;
+    while (i < count) {
+        uint32_t x = pixels[i] ^ previous[i];
+        size_t j = i + 1;
+        if (x == 0) {
+            while (j + CAPTURE_BLOCK <= count && memcmp(pixels + j, previous + j, CAPTURE_BLOCK * sizeof(uint32_t)) == 0) {
+                j += CAPTURE_BLOCK;
+            }
+            while (j < count && pixels[j] == previous[j]) {
+                j++;
+            }
+            out = WriteVarint(out, (j - i) << 2 | CAPTURE_SKIP);
+            i = j;
+            continue;
+        }
+        while (j < count && (pixels[j] ^ previous[j]) == x) {
+            j++;
+        }
+        if (j - i >= CAPTURE_MINFILL) {
+            out = WriteVarint(out, (j - i) << 2 | CAPTURE_FILL);
+            memcpy(out, &x, sizeof(x));
+            out += sizeof(x);
+        }
+        else {
+            // Literal run up to the next unchanged pixel or the next fill
+            j = i + 1;
+            while (j < count) {
+                uint32_t y = pixels[j] ^ previous[j];
+                if (y == 0 || (j + 2 < count && (pixels[j + 1] ^ previous[j + 1]) == y && (pixels[j + 2] ^ previous[j + 2]) == y)) {
+                    break;
+                }
+                j++;
+            }
+            out = WriteVarint(out, (j - i) << 2 | CAPTURE_COPY);
+            for (size_t k = i; k < j; k++) {
+                uint32_t y = pixels[k] ^ previous[k];
+                memcpy(out, &y, sizeof(y));
+                out += sizeof(y);
+            }
+        }
+        memcpy(previous + i, pixels + i, (j - i) * sizeof(uint32_t));
+        i = j;
+    }
+    return out - output.data();
+}
+
+bool DecodeCaptureFrame(const uint8_t data[], size_t size, uint32_t pixels[], size_t count) {
+    const uint8_t* in = data;
+    const uint8_t* end = data + size;
+    size_t i = 0;
+    while (in != end) {
+        uint64_t token;
+        if (!ReadVarint(in, end, token)) {
+            return false;
+        }
+        uint64_t length = token >> 2;
+        if (length > count - i) {
+            return false;
+        }
+        switch (token & 3) {
+        case CAPTURE_SKIP:
+            break;
+        case CAPTURE_FILL: {
+            uint32_t x;
+            if (static_cast<size_t>(end - in) < sizeof(x)) {
+                return false;
+            }
+            memcpy(&x, in, sizeof(x));
+            in += sizeof(x);
+            for (size_t k = i; k < i + length; k++) {
+                pixels[k] ^= x;
+            }
+            break;
+        }
+        case CAPTURE_COPY:
+            if (static_cast<uint64_t>(end - in) < length * sizeof(uint32_t)) {
+                return false;
+            }
+            for (size_t k = i; k < i + length; k++) {
+                uint32_t x;
+                memcpy(&x, in, sizeof(x));
+                in += sizeof(x);
+                pixels[k] ^= x;
+            }
+            break;
+        default:
+            return false;
+        }
+        i += static_cast<size_t>(length);
+    }
+    return i == count;
+}
+
+// Class CaptureWriter
+// Public CaptureWriter
+CaptureWriter::CaptureWriter() : head(0), tail(0), running(false) {
+    width = 0;
+    height = 0;
+    frames = 0;
+    dropped = 0;
+    return;
+}
+
+CaptureWriter::~CaptureWriter() {
+    Stop();
+    return;
+}
+
+// Public CaptureWriter info
+uint32_t CaptureWriter::GetDropped() const {
+    return dropped;
+}
+
+uint32_t CaptureWriter::GetFrames() const {
+    return frames;
+}
+
+bool CaptureWriter::IsRunning() const {
+    return running.load(std::memory_order_relaxed);
+}
+
+// Public CaptureWriter update
+size_t CaptureWriter::AddFrame(const uint32_t pixels[]) {
+    if (!IsRunning()) {
+        return 0;
+    }
+    uint32_t slot = head.load(std::memory_order_relaxed);
+    if (slot - tail.load(std::memory_order_acquire) == CAPTURE_QUEUE) {
+        dropped++;
+        return 0;
+    }
+    Slot& x = slots[slot % CAPTURE_QUEUE];
+    x.header.index = frames;
+    x.header.key = (frames % CAPTURE_KEYPERIOD == 0) ? 1 : 0;
+    x.header.time = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    if (x.header.key) {
+        std::fill(previous.begin(), previous.end(), 0);
+    }
+    size_t size = EncodeCaptureFrame(pixels, previous.data(), previous.size(), x.data);
+    x.header.size = static_cast<uint32_t>(size);
+    head.store(slot + 1, std::memory_order_release);
+    frames++;
+    return size;
+}
+
+bool CaptureWriter::Start(const std::string& name, uint32_t argWidth, uint32_t argHeight) {
+    if (IsRunning()) {
+        return false;
+    }
+    output.open(name, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        return false;
+    }
+    width = argWidth;
+    height = argHeight;
+    CaptureHeader header = { CAPTURE_MAGIC, CAPTURE_VERSION, 0, width, height };
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    previous.assign(static_cast<size_t>(width) * height, 0);
+    // Every slot is sized for the worst frame here, AddFrame never allocates
+    for (auto& x : slots) {
+        x.data.resize(GetCaptureBound(previous.size()));
+    }
+    head.store(0);
+    tail.store(0);
+    frames = 0;
+    dropped = 0;
+    start = std::chrono::steady_clock::now();
+    running.store(true);
+    writer = std::thread(&CaptureWriter::WriteLoop, this);
+    return true;
+}
+
+void CaptureWriter::Stop() {
+    if (!IsRunning()) {
+        return;
+    }
+    running.store(false, std::memory_order_release);
+    writer.join();
+    output.close();
+    return;
+}
+
+// Private CaptureWriter
+void CaptureWriter::WriteLoop() {
+    while (true) {
+        // Read the flag first: once it is clear every frame is already in the ring
+        bool stop = !running.load(std::memory_order_acquire);
+        uint32_t slot = tail.load(std::memory_order_relaxed);
+        if (slot == head.load(std::memory_order_acquire)) {
+            if (stop) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        const Slot& x = slots[slot % CAPTURE_QUEUE];
+        output.write(reinterpret_cast<const char*>(&x.header), sizeof(x.header));
+        output.write(reinterpret_cast<const char*>(x.data.data()), x.header.size);
+        tail.store(slot + 1, std::memory_order_release);
+    }
+    output.flush();
+    return;
+}
+
+// Class CaptureReader
+// Public CaptureReader
+CaptureReader::CaptureReader() {
+    header = {};
+    width = 0;
+    height = 0;
+    return;
+}
+
+// Public CaptureReader info
+uint32_t CaptureReader::GetHeight() const {
+    return height;
+}
+
+uint32_t CaptureReader::GetWidth() const {
+    return width;
+}
+
+const std::vector<uint32_t>& CaptureReader::GetPixels() const {
+    return pixels;
+}
+
+const CaptureFrameHeader& CaptureReader::GetFrameHeader() const {
+    return header;
+}
+
+// Public CaptureReader update
+bool CaptureReader::Open(const std::string& name) {
+    input.open(name, std::ios::binary);
+    CaptureHeader file = {};
+    input.read(reinterpret_cast<char*>(&file), sizeof(file));
+    if (!input.good() || file.magic != CAPTURE_MAGIC || file.version != CAPTURE_VERSION || file.width == 0 || file.height == 0) {
+        return false;
+    }
+    width = file.width;
+    height = file.height;
+    pixels.assign(static_cast<size_t>(width) * height, 0);
+    return true;
+}
+
+bool CaptureReader::Next() {
+    input.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!input.good() || header.size > pixels.size() * 5 + 16) {
+        return false;
+    }
+    data.resize(header.size);
+    input.read(reinterpret_cast<char*>(data.data()), header.size);
+    if (!input.good()) {
+        return false;
+    }
+    if (header.key) {
+        std::fill(pixels.begin(), pixels.end(), 0);
+    }
+    return DecodeCaptureFrame(data.data(), data.size(), pixels.data(), pixels.size());
+}
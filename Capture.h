@@ -0,0 +1,110 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Capture file: a CaptureHeader followed by frames, each a CaptureFrameHeader and the
+// encoded difference to the frame before it. A key frame is the difference to a black
+// frame, so decoding can restart there.
+constexpr uint32_t CAPTURE_MAGIC = 0x50414341; // "ACAP"
+constexpr uint16_t CAPTURE_VERSION = 1;
+// Frames in flight between the game and the writer thread
+constexpr uint32_t CAPTURE_QUEUE = 8;
+constexpr uint32_t CAPTURE_KEYPERIOD = 300;
+
+struct CaptureHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t width, height;
+};
+
+struct CaptureFrameHeader {
+    uint32_t index;
+    uint32_t size;
+    float time;
+    uint32_t key;
+};
+
+// Encodes the pixels XORed with the previous frame as a stream of runs. Every run starts
+// with a varint (length << 2 | op): CAPTURE_SKIP leaves the pixels as they are,
+// CAPTURE_FILL XORs them with the single value that follows and CAPTURE_COPY with the
+// length values that follow.
+enum CaptureOp {
+    CAPTURE_SKIP,
+    CAPTURE_FILL,
+    CAPTURE_COPY
+};
+
+// Largest encoding of count pixels, a literal run per pixel
+size_t GetCaptureBound(size_t count);
+// Writes the encoding of pixels to the start of output and turns previous into pixels.
+// Output has to hold GetCaptureBound(count) bytes already, it is not resized here.
+// Returns the encoded size.
+size_t EncodeCaptureFrame(const uint32_t pixels[], uint32_t previous[], size_t count, std::vector<uint8_t>& output);
+// Applies an encoded frame on top of the previous one, false if the data is corrupt
+bool DecodeCaptureFrame(const uint8_t data[], size_t size, uint32_t pixels[], size_t count);
+
+// Records frames from the main thread. Encoding happens in place, a writer thread streams
+// the results to the file through a single-producer single-consumer ring. When the writer
+// falls behind whole frames are dropped, the next frame is then encoded against the last
+// one that made it into the ring.
+class CaptureWriter {
+public:
+    CaptureWriter();
+    ~CaptureWriter();
+
+    // Info
+    uint32_t GetDropped() const;
+    uint32_t GetFrames() const;
+    bool IsRunning() const;
+
+    // Update
+    // Returns the bytes queued for the file, 0 if the frame was dropped
+    size_t AddFrame(const uint32_t pixels[]);
+    bool Start(const std::string& name, uint32_t argWidth, uint32_t argHeight);
+    // Waits until everything queued is on disk
+    void Stop();
+private:
+    struct Slot {
+        CaptureFrameHeader header;
+        std::vector<uint8_t> data;
+    };
+
+    Slot slots[CAPTURE_QUEUE];
+    std::atomic<uint32_t> head, tail;
+    std::atomic<bool> running;
+    std::thread writer;
+    std::ofstream output;
+    std::vector<uint32_t> previous;
+    std::chrono::steady_clock::time_point start;
+    uint32_t width, height, frames, dropped;
+
+    void WriteLoop();
+};
+
+// Reads a capture file back frame by frame
+class CaptureReader {
+public:
+    CaptureReader();
+
+    // Info
+    uint32_t GetHeight() const;
+    uint32_t GetWidth() const;
+    const std::vector<uint32_t>& GetPixels() const;
+    const CaptureFrameHeader& GetFrameHeader() const;
+
+    bool Open(const std::string& name);
+    // False at the end of the file or on corrupt data
+    bool Next();
+private:
+    std::ifstream input;
+    CaptureFrameHeader header;
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> pixels;
+    uint32_t width, height;
+};
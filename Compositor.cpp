@@ -0,0 +1,282 @@
+#include "Compositor.h"
+#include "Engine.h"
+#include "Game.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define COMPOSITOR_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COMPOSITOR_SSE2
+#endif
+
+// Rounded x / 255 for x <= 255 * 255, the SIMD paths compute the same
+static uint32_t Div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static uint32_t BlendScalar(uint32_t dst, uint32_t color, uint32_t inv) {
+    uint32_t result = 0;
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        uint32_t channel = ((color >> shift) & 0xFF) + Div255(((dst >> shift) & 0xFF) * inv);
+        result |= std::min(channel, 255u) << shift;
+    }
+    return result;
+}
+
+#if defined(__AVX2__)
+static uint32_t BlendSimd(uint32_t dst[], uint32_t count, uint32_t color, uint32_t inv) {
+    const __m256i src = _mm256_set1_epi32(static_cast<int>(color));
+    const __m256i factor = _mm256_set1_epi16(static_cast<short>(inv));
+    const __m256i half = _mm256_set1_epi16(128);
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), factor), half);
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), factor), half);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+        // Unpack and pack both work within 128-bit lanes, so the pixel order survives
+        d = _mm256_adds_epu8(_mm256_packus_epi16(lo, hi), src);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), d);
+    }
+    return i;
+}
+#elif defined(COMPOSITOR_SSE2)
+static uint32_t BlendSimd(uint32_t dst[], uint32_t count, uint32_t color, uint32_t inv) {
+    const __m128i src = _mm_set1_epi32(static_cast<int>(color));
+    const __m128i factor = _mm_set1_epi16(static_cast<short>(inv));
+    const __m128i half = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), factor), half);
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), factor), half);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        d = _mm_adds_epu8(_mm_packus_epi16(lo, hi), src);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), d);
+    }
+    return i;
+}
+#else
+static uint32_t BlendSimd(uint32_t[], uint32_t, uint32_t, uint32_t) {
+    return 0;
+}
+#endif
+
+void BlendSpan(uint32_t dst[], uint32_t count, uint32_t color) {
+    uint32_t alpha = color >> 24;
+    if (alpha == 255) {
+        std::fill(dst, dst + count, color);
+        return;
+    }
+    if (color == 0) {
+        return;
+    }
+    uint32_t inv = 255 - alpha;
+    for (uint32_t i = BlendSimd(dst, count, color, inv); i < count; i++) {
+        dst[i] = BlendScalar(dst[i], color, inv);
+    }
+    return;
+}
+
+void BlendPixel(uint32_t& dst, uint32_t color) {
+    uint32_t alpha = color >> 24;
+    dst = (alpha == 255) ? color : BlendScalar(dst, color, 255 - alpha);
+    return;
+}
+
+void AddPixel(uint32_t& dst, uint32_t light) {
+    // Low 7 bits of every channel add without carrying into the next one
+    uint32_t low = (dst & 0x7F7F7F7F) + (light & 0x7F7F7F7F);
+    uint32_t a = dst & 0x80808080, b = light & 0x80808080, c = low & 0x80808080;
+    // A channel overflows when two of its three top bits are set
+    uint32_t overflow = (a & b) | (a & c) | (b & c);
+    dst = (low ^ a ^ b) | ((overflow >> 7) * 0xFF);
+    return;
+}
+
+// Span within one row of a tiled canvas, cut where it crosses into the next tile
+static void BlendTiledSpan(const Canvas& canvas, int x, int y, int length, uint32_t color) {
+    const int MASK = CANVAS_TILESIZE - 1;
+    uint32_t* band = canvas.pixels + (y >> CANVAS_TILESHIFT) * canvas.width * CANVAS_TILESIZE + ((y & MASK) << CANVAS_TILESHIFT);
+    while (length > 0) {
+        int run = std::min(length, CANVAS_TILESIZE - (x & MASK));
+        BlendSpan(band + ((x >> CANVAS_TILESHIFT) << (2 * CANVAS_TILESHIFT)) + (x & MASK), run, color);
+        x += run;
+        length -= run;
+    }
+    return;
+}
+
+void BlendWrappedSpan(const Canvas& canvas, int x, int y, int length, uint32_t color) {
+    if (canvas.window) {
+        if (y < 0 || y >= canvas.height) {
+            return;
+        }
+        int end = std::min(x + length, canvas.width);
+        x = std::max(x, 0);
+        length = end - x;
+    }
+    length = std::min(length, canvas.width);
+    if (length <= 0) {
+        return;
+    }
+    y = mod(y, canvas.height);
+    int start = mod(x, canvas.width);
+    int first = std::min(length, canvas.width - start);
+    if (canvas.tiled) {
+        BlendTiledSpan(canvas, start, y, first, color);
+        BlendTiledSpan(canvas, 0, y, length - first, color);
+        return;
+    }
+    uint32_t* row = canvas.pixels + y * canvas.width;
+    BlendSpan(row + start, first, color);
+    if (first < length) {
+        BlendSpan(row, length - first, color);
+    }
+    return;
+}
+
+// Gathers row y of a tiled canvas into dst
+static void CopyTiledRow(const Canvas& source, int y, uint32_t dst[]) {
+    const uint32_t* src = source.pixels + (y >> CANVAS_TILESHIFT) * source.width * CANVAS_TILESIZE + ((y & (CANVAS_TILESIZE - 1)) << CANVAS_TILESHIFT);
+    for (int x = 0; x < source.width; x += CANVAS_TILESIZE, src += CANVAS_TILESIZE * CANVAS_TILESIZE) {
+        int i = 0;
+#if defined(__AVX2__)
+        for (; i + 8 <= CANVAS_TILESIZE; i += 8) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x + i), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)));
+        }
+#elif defined(COMPOSITOR_SSE2)
+        for (; i + 4 <= CANVAS_TILESIZE; i += 4) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x + i), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        }
+#endif
+        for (; i < CANVAS_TILESIZE; i++) {
+            dst[x + i] = src[i];
+        }
+    }
+    return;
+}
+
+// Row y of the canvas as a plain array, gathered into scratch when the canvas is tiled
+static const uint32_t* GetRow(const Canvas& source, int y, uint32_t scratch[]) {
+    if (!source.tiled) {
+        return source.pixels + y * source.width;
+    }
+    CopyTiledRow(source, y, scratch);
+    return scratch;
+}
+
+// Per channel (a + b + 1) / 2, the same rounding as _mm_avg_epu8
+static uint32_t Average(uint32_t a, uint32_t b) {
+    return (a | b) - (((a ^ b) & 0xFEFEFEFE) >> 1);
+}
+
+static void AverageRows(const uint32_t a[], const uint32_t b[], uint32_t dst[], int count) {
+    int i = 0;
+#if defined(COMPOSITOR_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_avg_epu8(x, y));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = Average(a[i], b[i]);
+    }
+    return;
+}
+
+// Expands a row by factor into dst, towards the right neighbour when interpolating. The
+// last pixel's neighbour is the first one when the row wraps, otherwise itself.
+static void ExpandRow(const uint32_t src[], uint32_t dst[], int width, uint32_t factor, bool bilinear, bool wrap) {
+    int x = 0;
+#if defined(COMPOSITOR_SSE2)
+    // Four pixels and their right neighbours, the last ones wrap and are left to the scalar loop
+    for (; x + 4 < width; x += 4) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+        __m128i* out = reinterpret_cast<__m128i*>(dst + x * factor);
+        __m128i m = a;
+        if (bilinear) {
+            m = _mm_avg_epu8(a, _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x + 1)));
+        }
+        if (factor == 2) {
+            _mm_storeu_si128(out, _mm_unpacklo_epi32(a, m));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi32(a, m));
+            continue;
+        }
+        __m128i q1 = a, q3 = a;
+        if (bilinear) {
+            q1 = _mm_avg_epu8(a, m);
+            q3 = _mm_avg_epu8(m, _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x + 1)));
+        }
+        // Pixel i becomes a[i] q1[i] m[i] q3[i]
+        __m128i lo = _mm_unpacklo_epi32(a, q1), hi = _mm_unpackhi_epi32(a, q1);
+        __m128i mlo = _mm_unpacklo_epi32(m, q3), mhi = _mm_unpackhi_epi32(m, q3);
+        _mm_storeu_si128(out, _mm_unpacklo_epi64(lo, mlo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi64(lo, mlo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi64(hi, mhi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi64(hi, mhi));
+    }
+#endif
+    for (; x < width; x++) {
+        uint32_t a = src[x];
+        uint32_t b = bilinear ? src[wrap ? (x + 1) % width : std::min(x + 1, width - 1)] : a;
+        uint32_t m = Average(a, b);
+        uint32_t* out = dst + x * factor;
+        if (factor == 2) {
+            out[0] = a;
+            out[1] = m;
+        }
+        else {
+            out[0] = a;
+            out[1] = Average(a, m);
+            out[2] = m;
+            out[3] = Average(m, b);
+        }
+    }
+    return;
+}
+
+void Upscale(const Canvas& source, uint32_t dst[], uint32_t factor, bool bilinear) {
+    int width = source.width * factor;
+    // A source is at most half the screen wide
+    uint32_t scratch[SCREEN_WIDTH];
+    ExpandRow(GetRow(source, 0, scratch), dst, source.width, factor, bilinear, !source.window);
+    for (int y = 0; y < source.height; y++) {
+        uint32_t* a = dst + y * factor * width;
+        // The row below the last one is the first, which is expanded already, or on a window the last one itself
+        uint32_t* b = source.window ? a : dst;
+        if (y + 1 < source.height) {
+            b = a + factor * width;
+            ExpandRow(GetRow(source, y + 1, scratch), b, source.width, factor, bilinear, !source.window);
+        }
+        if (!bilinear) {
+            for (uint32_t k = 1; k < factor; k++) {
+                memcpy(a + k * width, a, width * sizeof(uint32_t));
+            }
+        }
+        else if (factor == 2) {
+            AverageRows(a, b, a + width, width);
+        }
+        else {
+            AverageRows(a, b, a + 2 * width, width);
+            AverageRows(a, a + 2 * width, a + width, width);
+            AverageRows(a + 2 * width, b, a + 3 * width, width);
+        }
+    }
+    return;
+}
+
+void Untile(const Canvas& source, uint32_t dst[]) {
+    for (int y = 0; y < source.height; y++) {
+        CopyTiledRow(source, y, dst + y * source.width);
+    }
+    return;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+
+// Blending into the backbuffer. Colors are 0xAARRGGBB with premultiplied alpha, so a pixel
+// becomes color + pixel * (255 - alpha) / 255 per channel. Alpha 255 is a plain store and
+// alpha 0 with color channels set adds light.
+
+// Canvas constants
+// Side of the square tiles of a tiled canvas, one row of a tile fills a 64 byte cache line
+constexpr int CANVAS_TILESHIFT = 4;
+constexpr int CANVAS_TILESIZE = 1 << CANVAS_TILESHIFT;
+
+// Pixels drawn into: the backbuffer or a lower resolution internal buffer. Game coordinates
+// are multiplied by scale, the field wraps at the edges of the canvas.
+struct Canvas {
+    uint32_t* pixels;
+    int width, height;
+    float scale;
+    // Stored in square tiles of CANVAS_TILESIZE, one tile after the other along each band of
+    // rows, instead of row after row. A disc then stays within a few pages instead of
+    // touching one per row. Width and height are multiples of CANVAS_TILESIZE.
+    bool tiled;
+    // Shows part of a field larger than itself: drawing is cut off at the edges instead of
+    // wrapping around them. Origin is the point of the field at the top left corner and
+    // field the size it wraps at, both in game coordinates.
+    bool window;
+    float originX, originY;
+    float fieldWidth, fieldHeight;
+};
+
+// Pixel at x, y within the canvas in either layout
+uint32_t& CanvasPixel(const Canvas& canvas, int x, int y);
+
+// Blends one color over count pixels, 8 (AVX2) or 4 (SSE2) at a time
+void BlendSpan(uint32_t dst[], uint32_t count, uint32_t color);
+void BlendPixel(uint32_t& dst, uint32_t color);
+// Saturating add of light, the same as BlendPixel with alpha 0 without unpacking the channels
+void AddPixel(uint32_t& dst, uint32_t light);
+// Horizontal span that wraps around the edges of the canvas like the field, or is cut off
+// at them on a window
+void BlendWrappedSpan(const Canvas& canvas, int x, int y, int length, uint32_t color);
+// Scales the canvas up by 2 or 4 into dst, repeating pixels or interpolating between
+// neighbours across the wrapped edges, which a window does not have. Rows are expanded
+// 4 pixels at a time with SSE2.
+void Upscale(const Canvas& source, uint32_t dst[], uint32_t factor, bool bilinear);
+// Copies a tiled canvas into the row after row layout of dst, a tile row at a time with AVX2 or SSE2
+void Untile(const Canvas& source, uint32_t dst[]);
+
+// Canvas
+inline uint32_t& CanvasPixel(const Canvas& canvas, int x, int y) {
+    if (!canvas.tiled) {
+        return canvas.pixels[y * canvas.width + x];
+    }
+    const int MASK = CANVAS_TILESIZE - 1;
+    return canvas.pixels[(y >> CANVAS_TILESHIFT) * canvas.width * CANVAS_TILESIZE + ((x >> CANVAS_TILESHIFT) << (2 * CANVAS_TILESHIFT))
+        + ((y & MASK) << CANVAS_TILESHIFT) + (x & MASK)];
+}
@@ -0,0 +1,217 @@
+#include "Env.h"
+#include "Compositor.h"
+#include "Game.h"
+#include "Jobs.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+constexpr float ENV_TICK = 1.0f / 60;
+
+struct EnvState {
+    GameManager game;
+    // Score and lives after the last step, the reward is the difference
+    uint64_t score;
+    uint32_t lives, ticks, episode;
+    std::vector<std::pair<float, uint32_t>> nearest;
+};
+
+struct EnvBatch {
+    std::vector<EnvState> envs;
+    uint32_t players, downsample;
+    uint64_t seed;
+};
+
+// splitmix64, every episode of every environment gets its own level seed
+static uint32_t EpisodeSeed(uint64_t seed, uint32_t env, uint32_t episode) {
+    uint64_t z = seed + (static_cast<uint64_t>(env) << 32 | episode) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return static_cast<uint32_t>(z ^ (z >> 31));
+}
+
+// A finished game moved the points of its players into the manager
+static uint64_t Score(const GameManager& game) {
+    if (game.GetState() != GameState::GAME) {
+        return game.GetPoints();
+    }
+    uint64_t score = 0;
+    for (const auto& x : game.players) {
+        score += x.GetPoints();
+    }
+    return score;
+}
+
+static uint32_t Lives(const GameManager& game) {
+    uint32_t lives = 0;
+    for (const auto& x : game.players) {
+        lives += x.GetLifes();
+    }
+    return lives;
+}
+
+static void Restart(EnvBatch& batch, uint32_t index) {
+    EnvState& env = batch.envs[index];
+    env.game.StartGame((batch.players == 2) ? GameType::MULTIPLAYER : GameType::SIGLEPLAYER, EpisodeSeed(batch.seed, index, env.episode++));
+    env.score = 0;
+    env.lives = Lives(env.game);
+    env.ticks = 0;
+    return;
+}
+
+static void WriteFeatures(EnvBatch& batch, EnvState& env, float features[]) {
+    const GameManager& game = env.game;
+    float* out = features;
+    for (uint32_t i = 0; i < batch.players; i++) {
+        if (i < game.players.size()) {
+            const Player& player = game.players[i];
+            out[0] = player.GetPosition().x / SCREEN_WIDTH;
+            out[1] = player.GetPosition().y / SCREEN_HEIGHT;
+            out[2] = player.GetSpeed().x / ENV_SPEEDSCALE;
+            out[3] = player.GetSpeed().y / ENV_SPEEDSCALE;
+            out[4] = cosf(player.GetDirection());
+            out[5] = sinf(player.GetDirection());
+            out[6] = static_cast<float>(player.GetLifes());
+            out[7] = player.IsAlive() ? 1.0f : 0.0f;
+            out[8] = player.CanShoot() ? 1.0f : 0.0f;
+        }
+        else {
+            std::fill(out, out + ENV_PLAYERFEATURES, 0.0f);
+        }
+        out += ENV_PLAYERFEATURES;
+    }
+    std::fill(out, out + ENV_ASTEROIDSLOTS * ENV_ASTEROIDFEATURES, 0.0f);
+    if (game.players.empty()) {
+        return;
+    }
+    Point origin = game.players[0].GetPosition();
+    env.nearest.clear();
+    for (uint32_t i = 0; i < game.asteroids.size(); i++) {
+        Point d = ShortestDelta(origin, game.GetPosition(game.asteroids[i]), game.GetField());
+        env.nearest.push_back({ d.x * d.x + d.y * d.y, i });
+    }
+    // Ties go to the lower index, so the order is the same on every run
+    uint32_t slots = std::min(static_cast<uint32_t>(env.nearest.size()), static_cast<uint32_t>(ENV_ASTEROIDSLOTS));
+    std::partial_sort(env.nearest.begin(), env.nearest.begin() + slots, env.nearest.end());
+    for (uint32_t i = 0; i < slots; i++) {
+        const Asteroid& x = game.asteroids[env.nearest[i].second];
+        Point d = ShortestDelta(origin, game.GetPosition(x), game.GetField());
+        out[0] = d.x / SCREEN_WIDTH;
+        out[1] = d.y / SCREEN_HEIGHT;
+        out[2] = x.GetVelocity().x / ENV_SPEEDSCALE;
+        out[3] = x.GetVelocity().y / ENV_SPEEDSCALE;
+        out[4] = x.GetSize() / ENV_SIZESCALE;
+        out[5] = 1.0f;
+        out += ENV_ASTEROIDFEATURES;
+    }
+    return;
+}
+
+// The field as draw() shows it, without background, particles and HUD
+static void WriteFrame(const EnvBatch& batch, const GameManager& game, uint32_t pixels[]) {
+    Canvas canvas = { pixels, SCREEN_WIDTH / static_cast<int>(batch.downsample), SCREEN_HEIGHT / static_cast<int>(batch.downsample), 1.0f / batch.downsample };
+    std::fill(pixels, pixels + canvas.width * canvas.height, 0);
+    for (const auto& player : game.players) {
+        if (player.IsAlive()) {
+            player.Draw(canvas);
+        }
+        for (const auto& x : player.bullets) {
+            x.Draw(canvas);
+        }
+    }
+    for (const auto& x : game.asteroids) {
+        x.Draw(canvas, game.GetTime(), game.GetField());
+    }
+    return;
+}
+
+static void Observe(EnvBatch& batch, uint32_t index, float features[], uint32_t frames[]) {
+    if (features) {
+        WriteFeatures(batch, batch.envs[index], features + static_cast<size_t>(index) * env_feature_count(&batch));
+    }
+    if (frames && batch.downsample) {
+        uint32_t width = 0, height = 0;
+        env_frame_size(&batch, &width, &height);
+        WriteFrame(batch, batch.envs[index].game, frames + static_cast<size_t>(index) * width * height);
+    }
+    return;
+}
+
+EnvBatch* env_create(uint32_t count, uint32_t players, uint32_t downsample, uint64_t seed) {
+    if (count == 0 || players < 1 || players > 2 || (downsample && (SCREEN_WIDTH % downsample || SCREEN_HEIGHT % downsample))) {
+        return nullptr;
+    }
+    EnvBatch* batch = new EnvBatch();
+    batch->envs.resize(count);
+    batch->players = players;
+    batch->downsample = downsample;
+    batch->seed = seed;
+    for (uint32_t i = 0; i < count; i++) {
+        batch->envs[i].episode = 0;
+        Restart(*batch, i);
+    }
+    return batch;
+}
+
+void env_destroy(EnvBatch* batch) {
+    delete batch;
+    return;
+}
+
+uint32_t env_count(const EnvBatch* batch) {
+    return static_cast<uint32_t>(batch->envs.size());
+}
+
+uint32_t env_feature_count(const EnvBatch* batch) {
+    return batch->players * ENV_PLAYERFEATURES + ENV_ASTEROIDSLOTS * ENV_ASTEROIDFEATURES;
+}
+
+void env_frame_size(const EnvBatch* batch, uint32_t* width, uint32_t* height) {
+    *width = batch->downsample ? SCREEN_WIDTH / batch->downsample : 0;
+    *height = batch->downsample ? SCREEN_HEIGHT / batch->downsample : 0;
+    return;
+}
+
+void env_reset(EnvBatch* batch, float* features, uint32_t* frames) {
+    jobs.ParallelFor(env_count(batch), 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            Restart(*batch, i);
+            Observe(*batch, i, features, frames);
+        }
+    });
+    return;
+}
+
+void env_step(EnvBatch* batch, const uint8_t* actions, float* features, uint32_t* frames, float* rewards, uint8_t* dones) {
+    jobs.ParallelFor(env_count(batch), 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            EnvState& env = batch->envs[i];
+            for (uint32_t j = 0; j < env.game.players.size(); j++) {
+                if (env.game.players[j].IsAlive()) {
+                    ApplyPlayerInput(env.game.players[j], actions[i * batch->players + j], ENV_TICK);
+                }
+            }
+            env.game.UpdateTimeGame(ENV_TICK);
+            env.ticks++;
+            uint64_t score = Score(env.game);
+            uint32_t lives = Lives(env.game);
+            // A won game pays the remaining lives as points and clears the players
+            bool won = env.game.GetState() == GameState::GAMEWIN;
+            uint32_t lost = (!won && env.lives > lives) ? env.lives - lives : 0;
+            bool done = env.game.GetState() != GameState::GAME || env.ticks >= ENV_MAXTICKS;
+            if (rewards) {
+                rewards[i] = static_cast<float>(static_cast<int64_t>(score - env.score)) - ENV_LIFEPENALTY * lost;
+            }
+            if (dones) {
+                dones[i] = done ? 1 : 0;
+            }
+            env.score = score;
+            env.lives = lives;
+            if (done) {
+                Restart(*batch, i);
+            }
+            Observe(*batch, i, features, frames);
+        }
+    });
+    return;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+
+//
+//  C interface to step many headless games in lockstep, for training and evaluating
+//  autopilots. Every environment is an independent game; env_step advances all of them
+//  by one tick in parallel and writes straight into the caller's buffers.
+//
+//  Buffers hold one block per environment, back to back:
+//    actions   players bytes of INPUT_* bits (1 left, 2 right, 4 up, 8 shoot)
+//    features  env_feature_count floats, see below
+//    frames    width * height pixels of env_frame_size, premultiplied 0xAARRGGBB
+//    rewards   one float: points scored minus ENV_LIFEPENALTY per life lost
+//    dones     one byte, 1 when the episode ended on this step
+//  Any observation pointer may be null to skip it. An environment that is done has
+//  already been restarted, its observation is the first of the next episode.
+//
+//  Features: for each player x, y, vx, vy, cos and sin of the heading, lives, alive and
+//  can-shoot; then ENV_ASTEROIDSLOTS nearest asteroids to the first player, closest first,
+//  each as wrapped dx, dy, vx, vy, size and present. Positions are divided by the screen
+//  size, velocities by ENV_SPEEDSCALE and sizes by ENV_SIZESCALE; empty slots are zero.
+//
+
+#define ENV_PLAYERFEATURES 9
+#define ENV_ASTEROIDSLOTS 16
+#define ENV_ASTEROIDFEATURES 6
+#define ENV_SPEEDSCALE 100.0f
+#define ENV_SIZESCALE 35.0f
+#define ENV_LIFEPENALTY 100.0f
+// Episodes are cut after this many ticks of 1/60 s
+#define ENV_MAXTICKS 36000
+
+#if defined(_WIN32) && defined(ENV_EXPORTS)
+#  define ENV_API __declspec(dllexport)
+#else
+#  define ENV_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EnvBatch EnvBatch;
+
+// players is 1 or 2; downsample divides the screen size for frames, 0 renders none.
+// Returns null on invalid arguments.
+ENV_API EnvBatch* env_create(uint32_t count, uint32_t players, uint32_t downsample, uint64_t seed);
+ENV_API void env_destroy(EnvBatch* batch);
+
+ENV_API uint32_t env_count(const EnvBatch* batch);
+ENV_API uint32_t env_feature_count(const EnvBatch* batch);
+ENV_API void env_frame_size(const EnvBatch* batch, uint32_t* width, uint32_t* height);
+
+// Restarts every environment and writes the first observations
+ENV_API void env_reset(EnvBatch* batch, float* features, uint32_t* frames);
+ENV_API void env_step(EnvBatch* batch, const uint8_t* actions, float* features, uint32_t* frames, float* rewards, uint8_t* dones);
+
+#ifdef __cplusplus
+}
+#endif
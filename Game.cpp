@@ -1,6 +1,22 @@
 #include "Engine.h"
 #include "Game.h"
+#include "Allocations.h"
+#include "Arena.h"
+#include "Audio.h"
+#include "Benchmark.h"
 #include "Bitmap.h"
+#include "Bot.h"
+#include "Capture.h"
+#include "Compositor.h"
+#include "GoldenFrames.h"
+#include "Input.h"
+#include "Instrumentation.h"
+#include "Latency.h"
+#include "Jobs.h"
+#include "Metrics.h"
+#include "Net.h"
+#include "Particles.h"
+#include "Starfield.h"
 #include <fstream>
 #include <stdlib.h>
 #include <memory.h>
@@ -9,8 +25,13 @@
 #include <ctime>
 #include <cstdlib>
 #include <cassert>
+#include <cstdio>
+#include <mutex>
+#include <chrono>
+#include <thread>
 
-constexpr float M_PI = 3.141592f;
+// The field wraps around at the screen edges, unless the game is set to a larger world
+static const Point SCREENFIELD = { SCREEN_WIDTH, SCREEN_HEIGHT };
 
 // Player constants
 constexpr float ACCELERATION = 50.0f;
@@ -23,19 +44,84 @@ constexpr float INVINCIBLETIME = 3.0f;
 static Point INIT_POS = { SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 };
 static Point INIT_POS1 = { SCREEN_WIDTH / 3, SCREEN_HEIGHT / 2 };
 static Point INIT_POS2 = { 2 * SCREEN_WIDTH / 3, SCREEN_HEIGHT / 2 };
+// Arena ships start on a circle around INIT_POS, inside the space kept free of asteroids
+constexpr float ARENARADIUS = 270.0f;
+// Shooting down another ship, times the level like the asteroids
+constexpr uint64_t SHIPPOINTS = 1000;
+// Grid cell of the ships, bullets look for hits in the cells around them. A large world
+// gets larger cells, there are never more than GAME_MAXPLAYERS ships to spread out.
+constexpr float PLAYERCELLSIZE = 2 * SIZE;
+constexpr float PLAYERGRIDCELLS = 64.0f;
+// Rows of the standings in the arena HUD
+constexpr uint32_t ARENASTANDINGS = 8;
+
+// Internal resolution presets cycled with U: screen size divisor and bilinear filtering
+static const uint32_t RENDERPRESETS[][2] = { { 1, 0 }, { 2, 0 }, { 2, 1 }, { 4, 0 }, { 4, 1 } };
+// Rasterizing the field into tiles and converting it for the screen measured slower than
+// drawing straight into the rows of the buffer, the extra pass costs more than it saves
+constexpr bool TILEDFIELD = false;
+
+// Background constants
+static const char* DEFAULTBGFILE = "DefaultBG.txt";
+constexpr uint32_t STARFIELDSEED = 0x2F6B1D47;
+// Drift of the starfield in menus, in game it follows the first ship as well
+static const Point STARDRIFT = { 12.0f, 5.0f };
+
+// Menus, pause and end screens are only looked at again this often while they do not change
+constexpr float IDLEFRAMETIME = 0.05f;
+// Milliseconds between checks for input while idle
+constexpr uint32_t IDLEWAITSTEP = 2;
+
+// Metrics export, served over HTTP with METRICS_HTTP or rewritten to a file with METRICS_FILE
+#ifdef METRICS_FILE
+static const char* METRICSFILE = "Metrics.prom";
+#endif
+// Longer than this, a 60 Hz display showed the previous frame again
+constexpr float DROPPEDFRAMETIME = 1.5f / 60.0f;
+static const double FRAMETIMEBUCKETS[] = { 0.004, 0.008, 0.0125, 0.0167, 0.025, 0.0333, 0.05, 0.1, 0.25 };
+
+// Crash recovery
+static const char* AUTOSAVEFILE = "Autosave.bin";
+constexpr float AUTOSAVEPERIOD = 5.0f;
 
 // Bullet consants
 constexpr float BULLETSIZE = 3.0f;
 constexpr float BULLETSPEED = 200.0f;
 constexpr float BULLETTIME = 3.0f;
+// Bullets of a ship in flight at once when it shoots as often as it can
+constexpr uint32_t BULLETSINFLIGHT = static_cast<uint32_t>(BULLETTIME / PAUSETIME) + 1;
 
 // Asteroid constants
 constexpr float NONCREATIONRADIUS = 300.0f;
-uint32_t defaultBG[SCREEN_HEIGHT][SCREEN_WIDTH];
+constexpr float ASTEROIDMAXSIZE = 35.0f;
+// Grid cell fits a pair of the biggest asteroids touching each other
+constexpr float ASTEROIDCELLSIZE = 2 * ASTEROIDMAXSIZE;
+// Asteroids further than this from every ship on either axis, half a screen past the edge
+// of the view, are left on their lines: they pass through each other unseen. A field of
+// up to four screens keeps all of them awake.
+static const Point AWAKEREACH = { SCREEN_WIDTH, SCREEN_HEIGHT };
+// The grid of the asteroids is built again once they may have left their cells by this much
+constexpr float GRIDSLACK = 2 * ASTEROIDCELLSIZE;
+// or once this many asteroids were added after it, the queries test those one by one
+constexpr uint32_t GRIDLOOSE = 16;
+// Items of a large grid inserted and sorted per tick, about a millisecond
+constexpr uint32_t GRIDBUILDSTEP = 65536;
+
+// Level setup draws from rand(), see StartLevel
+static std::mutex levelLock;
+
+// Chunks of the parallel passes, fixed so the merge order never depends on the threads
+constexpr uint32_t AWAKEGRAIN = 64;
+constexpr uint32_t CELLGRAIN = 8;
+constexpr uint32_t BULLETGRAIN = 32;
 
 uint32_t BGRA::GetInt() const {
     return alpha << 24 | red << 16 | green << 8 | blue;
 }
+// Color channels scaled by alpha, the form the compositor blends
+uint32_t BGRA::GetPremultiplied() const {
+    return alpha << 24 | (red * alpha + 127) / 255 << 16 | (green * alpha + 127) / 255 << 8 | (blue * alpha + 127) / 255;
+}
 BGRA::BGRA() {
     blue = 0;
     green = 0;
@@ -49,51 +135,77 @@ BGRA::BGRA(uint8_t b, uint8_t g, uint8_t r, uint8_t a) {
     alpha = a;
 }
 
-void DrawString(uint32_t buff[], std::string str, uint32_t posx, uint32_t posy, uint32_t size = 4) {
+void DrawString(uint32_t buff[], const char* str, uint32_t posx, uint32_t posy, uint32_t size = 4, uint32_t color) {
     assert(posx < SCREEN_WIDTH - 4 && posy < SCREEN_HEIGHT - 8);
+    // Text is always drawn at the native resolution
+    Canvas screen = { buff, SCREEN_WIDTH, SCREEN_HEIGHT, 1.0f };
     uint32_t start;
-    for (const auto& x : str) {
+    for (; *str; str++) {
+        char x = *str;
         if (bitmap.find(x) == bitmap.end()) {
             continue;
         }
         start = posx;
         for (uint32_t j = 0; j < bitmap[x].size(); j++) {
-            for (uint32_t i = 0; i < bitmap[x][j].size(); i++) {
-                if (bitmap[x][j][i]) {
-                    for (uint32_t k = 0; k < size; k++) {
-                        for (uint32_t l = 0; l < size; l++) {
-                            buff[mod(posy + j * size + k, SCREEN_HEIGHT) * SCREEN_WIDTH + mod(posx + i * size + l, SCREEN_WIDTH)] = BGRA({ 255, 255, 255, 0 }).GetInt();
-                        }
-                    }
+            const auto& row = bitmap[x][j];
+            for (uint32_t i = 0; i < row.size(); i++) {
+                if (!row[i]) {
+                    continue;
+                }
+                // Neighbouring set pixels of a glyph row become one span
+                uint32_t run = i;
+                while (run < row.size() && row[run]) {
+                    run++;
+                }
+                for (uint32_t k = 0; k < size; k++) {
+                    BlendWrappedSpan(screen, posx + i * size, posy + j * size + k, (run - i) * size, color);
                 }
+                i = run;
             }
         }
         posx = start + size * (static_cast<uint32_t>(bitmap[x][0].size()) + 1);
     }
 }
 
-float Distance(Point a, Point b) {
-    float minValue = std::min({
-        powf(a.x - b.x, 2) + powf(a.y - b.y, 2),
-        powf(a.x - b.x + SCREEN_WIDTH, 2) + powf(a.y - b.y, 2),
-        powf(-a.x + b.x + SCREEN_WIDTH, 2) + powf(a.y - b.y, 2),
-        powf(a.x - b.x, 2) + powf(a.y - b.y + SCREEN_HEIGHT, 2),
-        powf(a.x - b.x, 2) + powf(-a.y + b.y + SCREEN_HEIGHT, 2),
-        powf(a.x - b.x + SCREEN_WIDTH, 2) + powf(a.y - b.y + SCREEN_HEIGHT, 2),
-        powf(a.x - b.x + SCREEN_WIDTH, 2) + powf(-a.y + b.y + SCREEN_HEIGHT, 2),
-        powf(-a.x + b.x + SCREEN_WIDTH, 2) + powf(a.y - b.y + SCREEN_HEIGHT, 2),
-        powf(-a.x + b.x + SCREEN_WIDTH, 2) + powf(-a.y + b.y + SCREEN_HEIGHT, 2),
-    });
-    return std::sqrtf(minValue);
+void DrawString(uint32_t buff[], const std::string& str, uint32_t posx, uint32_t posy, uint32_t size = 4, uint32_t color) {
+    DrawString(buff, str.c_str(), posx, posy, size, color);
+    return;
 }
 
+// A window shows the copy of the point that is nearest to its center, so what lies across
+// the seam of the field from the camera still appears next to it
+Point ToCanvas(const Canvas& canvas, Point pos) {
+    if (!canvas.window) {
+        return { pos.x * canvas.scale, pos.y * canvas.scale };
+    }
+    Point half = { canvas.width / canvas.scale / 2, canvas.height / canvas.scale / 2 };
+    Point delta = ShortestDelta({ canvas.originX + half.x, canvas.originY + half.y }, pos, { canvas.fieldWidth, canvas.fieldHeight });
+    return { (delta.x + half.x) * canvas.scale, (delta.y + half.y) * canvas.scale };
+}
+
+
+void ApplyPlayerInput(Player& player, uint8_t input, float dt) {
+    if (input & INPUT_LEFT) {
+        player.Rotate(-dt * ROTATIONSPEED);
+    }
+    if (input & INPUT_RIGHT) {
+        player.Rotate(dt * ROTATIONSPEED);
+    }
+    if (input & INPUT_UP) {
+        player.Accelerate(dt);
+    }
+    if ((input & INPUT_SHOOT) && player.CanShoot()) {
+        player.Shoot();
+    }
+    return;
+}
 
 int mod(int value, int m) {
     value %= m;
     return (value >= 0) ? value : value + m;
 }
 
-void Bresenham(uint32_t buff[], Point d1, Point d2, uint32_t color) {
+void Bresenham(const Canvas& canvas, Point d1, Point d2, uint32_t color) {
     int x1 = static_cast<int>(d1.x), x2 = static_cast<int>(d2.x), y1 = static_cast<int>(d1.y), y2 = static_cast<int>(d2.y);
     int dx = abs(x2 - x1);
     int dy = -abs(y2 - y1);
@@ -103,7 +215,12 @@ void Bresenham(uint32_t buff[], Point d1, Point d2, uint32_t color) {
     int e2 = 0;
 
     for ( int x = x1, y = y1; x != x2 || y != y2; ) {
-        buff[mod(y, SCREEN_HEIGHT) * SCREEN_WIDTH + mod(x, SCREEN_WIDTH)] = color;
+        if (!canvas.window) {
+            BlendPixel(CanvasPixel(canvas, mod(x, canvas.width), mod(y, canvas.height)), color);
+        }
+        else if (x >= 0 && x < canvas.width && y >= 0 && y < canvas.height) {
+            BlendPixel(CanvasPixel(canvas, x, y), color);
+        }
         if (x1 == x2 && y1 == y2) break;
         e2 = 2 * err;
         if (e2 >= dy) { err += dy; x += sx; }
@@ -113,14 +230,6 @@ void Bresenham(uint32_t buff[], Point d1, Point d2, uint32_t color) {
     return;
 }
 
-//float CalculateDirection(Point a, Point b) {
-//    return atan2f(a.x - b.x, a.y - b.y);
-//}
-
-//Point CalculateSpeed(float initDir, float speed, float collisionDir) {
-//    return { speed * cosf(collisionDir - initDir), speed * sinf(collisionDir - initDir) };
-//}
-
 // Class GameObject
 // Public GameObject
 GameObject::GameObject() {
@@ -128,17 +237,22 @@ GameObject::GameObject() {
     SetSize(0.0);
     SetSpeed(0.0);
     SetColor({ 0, 0, 0, 0 });
+    id = 0;
 }
 
 // Public GameObject info
 uint32_t GameObject::GetColor() const {
-    return color.GetInt();
+    return color.GetPremultiplied();
 }
 
 float GameObject::GetDirection() const {
     return dir;
 }
 
+uint32_t GameObject::GetId() const {
+    return id;
+}
+
 Point GameObject::GetPosition() const {
     return pos;
 }
@@ -154,33 +268,72 @@ float GameObject::GetSpeed() const {
 // Public GameObject action
 void GameObject::Rotate(float angle) {
     dir += angle;
-    dir = fmod(dir, 2 * M_PI);
+    dir = fmod(dir, 2 * GAME_PI);
     return;
 }
 
-void GameObject::Move(float dt) {
-    pos.x = fmodf(pos.x + speed * cosf(dir) * dt, SCREEN_WIDTH);
-    if (pos.x < 0) {
-        pos.x += SCREEN_WIDTH;
-    }
-    pos.y = fmodf(pos.y + speed * sinf(dir) * dt, SCREEN_HEIGHT);
-    if (pos.x < 0) {
-        pos.x += SCREEN_HEIGHT;
-    }
+void GameObject::Move(float dt, Point field) {
+    pos = Advance(pos, speed, dir, dt, field);
+    return;
+}
+
+// Public GameObject replication
+void GameObject::Place(Point argPosition, float argDir) {
+    SetPosition(argPosition);
+    SetDirection(argDir);
     return;
 }
 
-void GameObject::Draw(uint32_t buff[]) const {
-    int x = static_cast<int>(pos.x);
-    int y = static_cast<int>(pos.y);
-    int R = static_cast<int>(size);
+void GameObject::SetId(uint32_t argId) {
+    id = argId;
+    return;
+}
 
-    for (int i = x - R; i <= x + R; i++) {
-        for (int j = y - R; j <= y + R; j++) {
-            if (std::pow(x - i, 2) + std::pow(y - j, 2) <= std::pow(R, 2)) {
-                buff[mod(j, SCREEN_HEIGHT) * SCREEN_WIDTH + mod(i, SCREEN_WIDTH)] = GetColor();
-            }
+// Public GameObject snapshot
+void GameObject::Load(SnapshotReader& reader) {
+    dir = reader.Read<float>();
+    size = reader.Read<float>();
+    speed = reader.Read<float>();
+    pos = reader.Read<Point>();
+    color = reader.Read<BGRA>();
+    id = reader.Read<uint32_t>();
+    return;
+}
+
+void GameObject::Save(SnapshotWriter& writer) const {
+    writer.Write(dir);
+    writer.Write(size);
+    writer.Write(speed);
+    writer.Write(pos);
+    writer.Write(color);
+    writer.Write(id);
+    return;
+}
+
+void GameObject::Draw(const Canvas& canvas) const {
+    DrawAt(canvas, pos);
+    return;
+}
+
+// Protected GameObject
+void GameObject::DrawAt(const Canvas& canvas, Point position) const {
+    Point c = ToCanvas(canvas, position);
+    int x = static_cast<int>(c.x);
+    int y = static_cast<int>(c.y);
+    int R = static_cast<int>(size * canvas.scale);
+    uint32_t color = GetColor();
+
+    // One span per row, covering the same pixels as a distance test would
+    for (int j = -R; j <= R; j++) {
+        int rest = R * R - j * j;
+        int w = static_cast<int>(std::sqrt(static_cast<float>(rest)));
+        while ((w + 1) * (w + 1) <= rest) {
+            w++;
         }
+        while (w * w > rest) {
+            w--;
+        }
+        BlendWrappedSpan(canvas, x - w, y + j, 2 * w + 1, color);
     }
     return;
 }
@@ -212,16 +365,31 @@ void GameObject::SetPosition(Point argPosition) {
 }
 
 // Class Bullet in class Player
-Player::Bullet::Bullet(Player player) : GameObject() {
+Player::Bullet::Bullet(const Player& player) : GameObject() {
     SetSpeed(BULLETSPEED);
     SetDirection(atan2f(sinf(player.GetDirection()) * GetSpeed() + player.GetSpeed().y, cosf(player.GetDirection()) * GetSpeed() + player.GetSpeed().x));
     SetInitPosition(player);
     SetSize(BULLETSIZE);
-    SetColor({ 255, 255, 255, 0 });
+    SetColor({ 255, 255, 255, 255 });
     ttl = BULLETTIME;
     return;
 }
 
+Player::Bullet::Bullet(Point argPosition, float argDir) : GameObject() {
+    SetSpeed(BULLETSPEED);
+    SetDirection(argDir);
+    SetPosition(argPosition);
+    SetSize(BULLETSIZE);
+    SetColor({ 255, 255, 255, 255 });
+    ttl = BULLETTIME;
+    return;
+}
+
+// Public Bullet info
+bool Player::Bullet::IsNew() const {
+    return ttl == BULLETTIME;
+}
+
 // Public Bullet Update
 bool Player::Bullet::UpdateTime(float dt) {
     ttl -= dt;
@@ -232,23 +400,72 @@ bool Player::Bullet::UpdateTime(float dt) {
     return false;
 }
 
-void Player::Bullet::SetInitPosition(Player player) {
+// Public Bullet snapshot
+void Player::Bullet::Load(SnapshotReader& reader) {
+    GameObject::Load(reader);
+    ttl = reader.Read<float>();
+    return;
+}
+
+void Player::Bullet::Save(SnapshotWriter& writer) const {
+    GameObject::Save(writer);
+    writer.Write(ttl);
+    return;
+}
+
+void Player::Bullet::SetInitPosition(const Player& player) {
     SetPosition({ player.GetPosition().x + (player.GetSize() + GetSize()) * cosf(player.GetDirection()),
                     player.GetPosition().y + (player.GetSize() + GetSize()) * sinf(player.GetDirection()) });
     return;
 }
 
+// Fully saturated color of a hue, 0 to 1 going around the wheel from red
+static BGRA HueColor(float hue) {
+    float h = 6 * (hue - std::floor(hue));
+    int sector = static_cast<int>(h) % 6;
+    uint8_t up = static_cast<uint8_t>(255 * (h - sector));
+    uint8_t down = 255 - up;
+    switch (sector) {
+    case 0:
+        return BGRA(0, up, 255, 255);
+    case 1:
+        return BGRA(0, 255, down, 255);
+    case 2:
+        return BGRA(up, 255, 0, 255);
+    case 3:
+        return BGRA(255, down, 0, 255);
+    case 4:
+        return BGRA(255, 0, up, 255);
+    default:
+        return BGRA(down, 0, 255, 255);
+    }
+}
+
 // Class Player
-Player::Player(GameType argType, bool first=true) {
-    SetPosition((argType == GameType::SIGLEPLAYER) ? INIT_POS : (first) ? INIT_POS2 : INIT_POS1);
+Player::Player(GameType argType, uint32_t index, uint32_t count) {
+    if (argType == GameType::ARENA) {
+        float angle = 2 * GAME_PI * index / std::max(count, 1u) - GAME_PI / 2;
+        SetPosition({ INIT_POS.x + ARENARADIUS * cosf(angle), INIT_POS.y + ARENARADIUS * sinf(angle) });
+    }
+    else {
+        SetPosition((argType == GameType::SIGLEPLAYER) ? INIT_POS : (index == 0) ? INIT_POS2 : INIT_POS1);
+    }
     initPos = GetPosition();
-    SetDirection(- M_PI / 2);
+    SetDirection(- GAME_PI / 2);
     SetSize(SIZE);
     SetSpeed({0, 0});
     lifes = LIVES;
     invincibleTime = INVINCIBLETIME;
     points = 0;
-    (argType == GameType::MULTIPLAYER) ? (first) ? SetColor({0, 255, 255, 0}) : SetColor({255, 255, 0, 0}) : SetColor({ 255, 0, 255, 0 });
+    shots = 0;
+    thrust = false;
+    spareBullets.resize(BULLETSINFLIGHT, Bullet(Point({ 0, 0 }), 0.0f));
+    if (argType == GameType::ARENA) {
+        SetColor(HueColor(static_cast<float>(index) / std::max(count, 1u)));
+    }
+    else {
+        (argType == GameType::MULTIPLAYER) ? (index == 0) ? SetColor({0, 255, 255, 255}) : SetColor({255, 255, 0, 255}) : SetColor({ 255, 0, 255, 255 });
+    }
     time = 0;
     return;
 }
@@ -258,6 +475,10 @@ bool Player::CanShoot() const {
     return time == 0;
 }
 
+bool Player::IsThrusting() const {
+    return thrust;
+}
+
 uint32_t Player::GetLifes() const {
     return lifes;
 }
@@ -266,6 +487,11 @@ uint64_t Player::GetPoints() const {
     return points;
 }
 
+// Bullets leave at this speed whatever the ship's own
+float Player::GetShotSpeed() const {
+    return BULLETSPEED;
+}
+
 Point Player::GetSpeed() const {
     return speed;
 }
@@ -287,6 +513,7 @@ void Player::Accelerate(float dt) {
     else {
         speed = newSpeed;
     }
+    thrust = true;
     return;
 }
 
@@ -295,35 +522,51 @@ void Player::AddPoints(uint64_t argPoints) {
     return;
 }
 
-void Player::Move(float dt) {
-    pos.x = fmodf(pos.x + speed.x * dt, SCREEN_WIDTH);
-    if (pos.x < 0) {
-        pos.x += SCREEN_WIDTH;
-    }
-    pos.y = fmodf(pos.y + speed.y * dt, SCREEN_HEIGHT);
-    if (pos.x < 0) {
-        pos.x += SCREEN_HEIGHT;
-    }
+void Player::Move(float dt, Point field) {
+    pos = Translate(pos, { speed.x * dt, speed.y * dt }, field);
     return;
 }
 
 void Player::Shoot() {
     time = PAUSETIME;
-    bullets.push_back(Bullet(*this));
+    AddBullet(Bullet(*this)).SetId(shots++);
     return;
 }
 
+// Public Player bullets
+Player::Bullet& Player::AddBullet(const Bullet& bullet) {
+    if (spareBullets.empty()) {
+        bullets.push_back(bullet);
+        return bullets.back();
+    }
+    bullets.splice(bullets.end(), spareBullets, spareBullets.begin());
+    bullets.back() = bullet;
+    return bullets.back();
+}
+
+void Player::ClearBullets() {
+    spareBullets.splice(spareBullets.end(), bullets);
+    return;
+}
+
+std::list<Player::Bullet>::iterator Player::RemoveBullet(std::list<Bullet>::iterator bullet) {
+    auto next = std::next(bullet);
+    spareBullets.splice(spareBullets.end(), bullets, bullet);
+    return next;
+}
+
 void Player::UpdateTime(float dt) {
     DecreaseTime(time, dt);
     DecreaseTime(invincibleTime, dt);
+    thrust = false;
     return;
 }
 
 // Public Player reset 
 void Player::Reset() {
-    bullets.clear();
+    ClearBullets();
     SetPosition(initPos);
-    SetDirection(-M_PI / 2);
+    SetDirection(-GAME_PI / 2);
     SetSpeed({ 0, 0 });
     time = 0;
     return;
@@ -338,19 +581,84 @@ void Player::Collision() {
     return;
 }
 
+// Public Player replication
+void Player::Replicate(Point argPosition, float argDir, Point argSpeed, uint32_t argLifes, uint64_t argPoints) {
+    Place(argPosition, argDir);
+    SetSpeed(argSpeed);
+    lifes = argLifes;
+    points = argPoints;
+    return;
+}
+
+// Public Player snapshot
+void Player::Load(SnapshotReader& reader) {
+    GameObject::Load(reader);
+    invincibleTime = reader.Read<float>();
+    time = reader.Read<float>();
+    lifes = reader.Read<uint32_t>();
+    shots = reader.Read<uint32_t>();
+    points = reader.Read<uint64_t>();
+    initPos = reader.Read<Point>();
+    speed = reader.Read<Point>();
+    uint32_t count = reader.Read<uint32_t>();
+    if (count > reader.GetRemaining()) {
+        reader.Fail();
+        count = 0;
+    }
+    // Overwrite the bullets in place, list nodes only move between the bullets and the spares,
+    // so going back and forth between states does not allocate once both were seen
+    auto it = bullets.begin();
+    for (uint32_t i = 0; i < count; i++) {
+        if (it == bullets.end()) {
+            if (spareBullets.empty()) {
+                it = bullets.insert(it, Bullet(Point({ 0, 0 }), 0.0f));
+            }
+            else {
+                bullets.splice(it, spareBullets, spareBullets.begin());
+                it = std::prev(bullets.end());
+            }
+        }
+        it->Load(reader);
+        ++it;
+    }
+    spareBullets.splice(spareBullets.end(), bullets, it, bullets.end());
+    return;
+}
+
+void Player::Save(SnapshotWriter& writer) const {
+    GameObject::Save(writer);
+    writer.Write(invincibleTime);
+    writer.Write(time);
+    writer.Write(lifes);
+    writer.Write(shots);
+    writer.Write(points);
+    writer.Write(initPos);
+    writer.Write(speed);
+    writer.Write(static_cast<uint32_t>(bullets.size()));
+    for (const auto& x : bullets) {
+        x.Save(writer);
+    }
+    return;
+}
 
-void Player::Draw(uint32_t buff[]) const {
+void Player::Draw(const Canvas& canvas) const {
     // Calculate 4 dots for creating triangle-like player
-    Point d1 = { pos.x + size * cosf(dir), pos.y + size * sinf(dir) };
-    Point d2 = { pos.x + size * cosf(dir + 5 * M_PI / 6), pos.y + size * sinf(dir + 5 * M_PI / 6) };
-    Point d3 = { pos.x + 0.6f * size * cosf(dir + M_PI), pos.y + 0.6f * size * sinf(dir + M_PI) };
-    Point d4 = { pos.x + size * cosf(dir - 5 * M_PI / 6), pos.y + size * sinf(dir - 5 * M_PI / 6) };
-    // Call Bresenham's line algorithm 4 times
-    uint32_t color = GetColor();
-    Bresenham(buff, d1, d2, color);
-    Bresenham(buff, d2, d3, color);
-    Bresenham(buff, d3, d4, color);
-    Bresenham(buff, d4, d1, color);
+    Point c = ToCanvas(canvas, pos);
+    float r = size * canvas.scale;
+    Point d1 = { c.x + r * cosf(dir), c.y + r * sinf(dir) };
+    Point d2 = { c.x + r * cosf(dir + 5 * GAME_PI / 6), c.y + r * sinf(dir + 5 * GAME_PI / 6) };
+    Point d3 = { c.x + 0.6f * r * cosf(dir + GAME_PI), c.y + 0.6f * r * sinf(dir + GAME_PI) };
+    Point d4 = { c.x + r * cosf(dir - 5 * GAME_PI / 6), c.y + r * sinf(dir - 5 * GAME_PI / 6) };
+    // Call Bresenham's line algorithm 4 times, fading in and out while invincible
+    BGRA shade = color;
+    if (invincibleTime > 0) {
+        shade.alpha = static_cast<uint8_t>(140 + 115 * cosf(invincibleTime * 4 * GAME_PI));
+    }
+    uint32_t lineColor = shade.GetPremultiplied();
+    Bresenham(canvas, d1, d2, lineColor);
+    Bresenham(canvas, d2, d3, lineColor);
+    Bresenham(canvas, d3, d4, lineColor);
+    Bresenham(canvas, d4, d1, lineColor);
     return;
 }
 
@@ -366,31 +674,62 @@ void Player::DecreaseTime(float& t, float dt) {
 }
 
 // Class Asteroid
-Asteroid::Asteroid(const Asteroid& prev, bool type) {
+Asteroid::Asteroid(const Asteroid& prev, bool type, float argTime, Point field) {
     speedType = prev.GetSpeedType();
     assert(prev.GetSizeType() != AsteroidSize::SMALL);
     sizeType = AsteroidSize(static_cast<uint32_t>(prev.GetSizeType()) - 1);
     SetInitSize(sizeType);
     SetSpeed(prev.GetSpeed() * 2 / sqrtf(3));
-    SetDirection(prev.GetDirection() + ((type) ? M_PI : -M_PI) / 6);
-    SetPosition(prev.GetPosition());
+    SetDirection(prev.GetDirection() + ((type) ? GAME_PI : -GAME_PI) / 6);
+    SetStart(prev.GetPosition(argTime, field), argTime);
     SetInitColor(speedType);
     return;
 }
 
+// Replica of an asteroid simulated elsewhere
+Asteroid::Asteroid(AsteroidSpeed argSpeed, AsteroidSize argSize, Point argPosition, float argDir, float argTime) {
+    speedType = argSpeed;
+    sizeType = argSize;
+    SetInitSize(argSize);
+    SetInitSpeed(speedType);
+    SetDirection(argDir);
+    SetStart(argPosition, argTime);
+    SetInitColor(argSpeed);
+    return;
+}
+
 // For destroy purposes
-Asteroid::Asteroid(AsteroidSpeed argSpeed, AsteroidSize argSize) {
+Asteroid::Asteroid(AsteroidSpeed argSpeed, AsteroidSize argSize, Point field, float argTime) {
     speedType = argSpeed;
     sizeType = argSize;
     SetInitSize(argSize);
     SetInitSpeed(speedType);
     SetInitDirection();
-    SetInitPosition();
+    SetInitPosition(field);
+    SetStart(pos, argTime);
     SetInitColor(argSpeed);
     return;
 }
 
 // Public Asteroid info 
+float Asteroid::GetMass() const {
+    // Every split halves the mass
+    switch (sizeType) {
+    case AsteroidSize::SMALL:
+        return 1.0f;
+    case AsteroidSize::NORMAL:
+        return 2.0f;
+    default:
+        return 4.0f;
+    }
+}
+
+// Nothing adds up from tick to tick: the same time gives the same point wherever it is asked
+Point Asteroid::GetPosition(float time, Point field) const {
+    float t = time - startTime;
+    return Translate(pos, { velocity.x * t, velocity.y * t }, field);
+}
+
 Asteroid::AsteroidSize Asteroid::GetSizeType() const {
     return sizeType;
 }
@@ -399,33 +738,81 @@ Asteroid::AsteroidSpeed Asteroid::GetSpeedType() const {
     return speedType;
 }
 
+Point Asteroid::GetVelocity() const {
+    return velocity;
+}
+
+// Public Asteroid snapshot
+void Asteroid::Load(SnapshotReader& reader) {
+    GameObject::Load(reader);
+    sizeType = reader.Read<AsteroidSize>();
+    speedType = reader.Read<AsteroidSpeed>();
+    SetStart(pos, reader.Read<float>());
+    return;
+}
+
+void Asteroid::Save(SnapshotWriter& writer) const {
+    GameObject::Save(writer);
+    writer.Write(sizeType);
+    writer.Write(speedType);
+    writer.Write(startTime);
+    return;
+}
+
+// Public Asteroid collision response
+Disc<float> Asteroid::GetDisc(float time, Point field) const {
+    return { GetPosition(time, field), speed, dir, size, GetMass() };
+}
+
+void Asteroid::SetDisc(const Disc<float>& disc, float time) {
+    SetSpeed(disc.speed);
+    SetDirection(disc.dir);
+    SetStart(disc.pos, time);
+    return;
+}
+
+void Asteroid::Draw(const Canvas& canvas, float time, Point field) const {
+    DrawAt(canvas, GetPosition(time, field));
+    return;
+}
+
 // Private Asteroid set 
 void Asteroid::SetInitColor(AsteroidSpeed argSpeed) {
     switch (argSpeed) {
     case AsteroidSpeed::SLOW:
-        SetColor({ 0, 255, 0, 0 });
+        SetColor({ 0, 255, 0, 255 });
         break;
     case AsteroidSpeed::MEDIUM:
-        SetColor({ 255, 0, 0, 0 });
+        SetColor({ 255, 0, 0, 255 });
         break;
     case AsteroidSpeed::FAST:
-        SetColor({ 0, 0, 255, 0 });
+        SetColor({ 0, 0, 255, 255 });
         break;
     }
     speedType = argSpeed;
     return;
 }
 
+// Whole coordinate below extent. rand() may stop at 32767, wider fields take two draws.
+static float RandomCoordinate(float extent) {
+    uint32_t range = static_cast<uint32_t>(extent);
+    uint32_t value = static_cast<uint32_t>(std::rand());
+    if (range > static_cast<uint32_t>(RAND_MAX)) {
+        value = value * (static_cast<uint32_t>(RAND_MAX) + 1) + static_cast<uint32_t>(std::rand());
+    }
+    return static_cast<float>(value % range);
+}
+
 void Asteroid::SetInitDirection() {
-    SetDirection(static_cast <float> (std::rand()) / static_cast <float> (RAND_MAX) * 2 * M_PI);
+    SetDirection(static_cast <float> (std::rand()) / static_cast <float> (RAND_MAX) * 2 * GAME_PI);
     return;
 }
 
-void Asteroid::SetInitPosition() {
+void Asteroid::SetInitPosition(Point field) {
     Point argPos;
     do {
-        argPos = { static_cast <float> (std::rand() % SCREEN_WIDTH), static_cast <float> (std::rand() % SCREEN_HEIGHT) };
-    } while (Distance(argPos, INIT_POS) < NONCREATIONRADIUS);
+        argPos = { RandomCoordinate(field.x), RandomCoordinate(field.y) };
+    } while (Distance(argPos, INIT_POS, field) < NONCREATIONRADIUS);
     SetPosition(argPos);
     return;
 }
@@ -439,7 +826,7 @@ void Asteroid::SetInitSize(AsteroidSize argSize) {
         SetSize(27.0);
         break;
     case AsteroidSize::BIG:
-        SetSize(35.0);
+        SetSize(ASTEROIDMAXSIZE);
         break;
     }
     return;
@@ -460,21 +847,65 @@ void Asteroid::SetInitSpeed(AsteroidSpeed argSpeed) {
     return;
 }
 
-//void Asteroid::RecalculateDirection(float dir, Point initSpeed, Point futureSpeed) {
-//    SetDirection(atan2f(initSpeed.y * cosf(dir) + futureSpeed.x * sinf(dir), futureSpeed.x * cosf(dir) + initSpeed.y * sinf(dir)));
-//}
+// Speed and direction are set already
+void Asteroid::SetStart(Point argPosition, float argTime) {
+    SetPosition(argPosition);
+    startTime = argTime;
+    velocity = ToVelocity(speed, dir);
+    return;
+}
+
+// Adds the asteroids removed now, by their index now, to the sorted removals of a grid
+// built from count of them, by their index then: past every earlier removal before it
+static void AddRemoved(std::vector<uint32_t>& list, uint32_t count, const std::vector<uint32_t>& removed) {
+    size_t earlier = list.size();
+    for (auto x : removed) {
+        for (size_t j = 0; j < earlier && list[j] <= x; j++) {
+            x++;
+        }
+        if (x < count) {
+            list.push_back(x);
+        }
+    }
+    std::sort(list.begin(), list.end());
+    return;
+}
 
 // Class GameManager
 GameManager::GameManager() {
     levelDifficulties = { {5, 1, 0}, {3, 2, 1}, {1, 3, 2}, {1, 1, 4} };
     level = 0;
+    nextId = 0;
+    seed = 0;
     maxPoints = 0;
+    points = 0;
+    totaltime = 0;
+    hasBG = false;
+    type = GameType::SIGLEPLAYER;
     players = std::vector<Player>();
     state = GameState::GAME;
+    field = SCREENFIELD;
+    gridTime = 0;
+    gridSpeed = 0;
+    gridPush = 0;
+    nextTime = 0;
+    nextSpeed = 0;
+    nextPush = 0;
+    nextCount = 0;
+    nextInserted = 0;
+    ResetGrids();
     return;
 }
 
 // Public GameManager info 
+Point GameManager::GetField() const {
+    return field;
+}
+
+uint32_t GameManager::GetLevel() const {
+    return level;
+}
+
 uint64_t GameManager::GetMaxPoints() const {
     return maxPoints;
 }
@@ -483,10 +914,18 @@ uint64_t GameManager::GetPoints() const {
     return points;
 }
 
+Point GameManager::GetPosition(const Asteroid& asteroid) const {
+    return asteroid.GetPosition(totaltime, field);
+}
+
 GameState GameManager::GetState() const {
     return state;
 }
 
+float GameManager::GetTime() const {
+    return totaltime;
+}
+
 GameType GameManager::GetType() const {
     return type;
 }
@@ -499,20 +938,23 @@ bool GameManager::IsLevelOver() const {
     return asteroids.empty();
 }
 
+// An arena is over once a single ship is left standing
 bool GameManager::IsGameOver() const {
-    bool anyAlive = false;
+    uint32_t alive = 0;
     for (const auto& x : players) {
-        anyAlive |= x.IsAlive();
+        alive += x.IsAlive() ? 1 : 0;
     }
-    return !anyAlive;
+    return (type == GameType::ARENA && players.size() > 1) ? alive < 2 : alive == 0;
 }
 
 // Public GameManager update 
+// Ships of a local game play together and add up their points, in an arena the best one counts
 void GameManager::GameOver() {
     asteroids.clear();
+    BuildAsteroidGrid();
     points = 0;
     for (const auto& x : players) {
-        points += x.GetPoints();
+        points = (type == GameType::ARENA) ? std::max(points, x.GetPoints()) : points + x.GetPoints();
     }
     if (points > maxPoints) {
         maxPoints = points;
@@ -523,10 +965,11 @@ void GameManager::GameOver() {
 
 void GameManager::GameWin() {
     asteroids.clear();
+    BuildAsteroidGrid();
     points = 0;
     for (const auto& x : players) {
-        points += x.GetPoints();
-        points += static_cast<uint64_t>(x.GetLifes()) * 10000;
+        uint64_t score = x.GetPoints() + static_cast<uint64_t>(x.GetLifes()) * 10000;
+        points = (type == GameType::ARENA) ? std::max(points, score) : points + score;
     }
     players.clear();
     uint64_t tme = static_cast<uint64_t>(totaltime);
@@ -555,122 +998,148 @@ void GameManager::NextLevel() {
     return;
 }
 
+void GameManager::SetField(Point argField) {
+    field.x = std::max(static_cast<float>(SCREEN_WIDTH), std::min(std::floor(argField.x), GAME_MAXFIELD));
+    field.y = std::max(static_cast<float>(SCREEN_HEIGHT), std::min(std::floor(argField.y), GAME_MAXFIELD));
+    return;
+}
+
 void GameManager::SetState(GameState argState) {
     state = argState;
 }
 
 void GameManager::StartGame(GameType argType) {
+    StartGame(argType, static_cast<uint32_t>(std::rand()));
+    return;
+}
+
+void GameManager::StartGame(GameType argType, uint32_t argSeed) {
+    StartGame(argType, argSeed, (argType == GameType::SIGLEPLAYER) ? 1 : (argType == GameType::MULTIPLAYER) ? 2 : GAME_MAXPLAYERS);
+    return;
+}
+
+void GameManager::StartGame(GameType argType, uint32_t argSeed, uint32_t playerCount) {
     level = 0;
+    nextId = 0;
+    seed = argSeed;
     totaltime = 0;
     type = argType;
     state = GameState::GAME;
     players.clear();
     asteroids.clear();
-    players.push_back(Player({ type }));
-    if (type == GameType::MULTIPLAYER) {
-        players.push_back(Player({ type, false }));
+    ResetGrids();
+    playerCount = std::max(1u, std::min(playerCount, GAME_MAXPLAYERS));
+    players.reserve(playerCount);
+    for (uint32_t i = 0; i < playerCount; i++) {
+        players.push_back(Player(type, i, playerCount));
     }
+    // Scratch of the ship hits, a ship is hit once a tick at most
+    playerSlots.reserve(playerCount);
+    playerHits.reserve(playerCount);
+    playerHit.reserve(playerCount);
+    // And of the bullets in flight
+    bulletRefs.reserve(playerCount * BULLETSINFLIGHT);
     StartLevel();
     return;
 }
 
 void GameManager::StartLevel() {
+    // Levels are generated from the manager's own seed, so re-simulating a level change
+    // from a snapshot spawns the same asteroids. Some runtimes share the rand() state
+    // between threads, managers stepped in parallel take turns.
+    std::lock_guard<std::mutex> guard(levelLock);
+    std::srand(seed);
+    // A world larger than the screen gets as many asteroids for every screen it covers
+    int screens = std::max(1, static_cast<int>(field.x * field.y / (SCREEN_WIDTH * SCREEN_HEIGHT)));
+    // A big one ends as at most four small ones, with the fragments of a tick appended
+    // before the hit ones are removed at most six: splits never grow the vector
+    size_t bigs = 0;
+    for (int x : levelDifficulties[level]) {
+        bigs += x * screens;
+    }
+    asteroids.reserve(asteroids.size() + 6 * bigs);
+    gridPushes.reserve(asteroids.capacity());
+    nextPushes.reserve(asteroids.capacity());
+    // So do the grids and the scratch of the hits
+    uint32_t capacity = static_cast<uint32_t>(asteroids.capacity());
+    asteroidGrid.Reserve(capacity);
+    nextGrid.Reserve(capacity);
+    gridPositions.reserve(capacity);
+    gridRemoved.reserve(capacity);
+    nextRemoved.reserve(capacity);
+    removed.reserve(capacity);
+    asteroidHit.reserve(capacity);
+    // As many chunks as the largest pass splits into, each with room for a contact per item
+    uint32_t bullets = static_cast<uint32_t>(bulletRefs.capacity());
+    uint32_t chunks = std::max({ asteroidGrid.GetCellCount() / CELLGRAIN, capacity / AWAKEGRAIN, bullets / BULLETGRAIN }) + 1;
+    if (chunkPairs.size() < chunks) {
+        chunkPairs.resize(chunks);
+    }
+    for (auto& x : chunkPairs) {
+        x.reserve(AWAKEGRAIN);
+    }
+    chunkTests.reserve(chunks);
     for (int i = 0; i < levelDifficulties[level].size(); i++) {
-        for (int j = 0; j < levelDifficulties[level][i]; j++) {
-            asteroids.push_back(Asteroid(static_cast<Asteroid::AsteroidSpeed>(i), Asteroid::AsteroidSize::BIG));
+        for (int j = 0; j < levelDifficulties[level][i] * screens; j++) {
+            AddAsteroid(Asteroid(static_cast<Asteroid::AsteroidSpeed>(i), Asteroid::AsteroidSize::BIG, field, totaltime));
         }
     }
+    seed = static_cast<uint32_t>(std::rand());
+    BuildAsteroidGrid();
     return;
 }
 
 void GameManager::UpdateTimeGame(float dt) {
     totaltime += dt;
+    effects.clear();
     for (auto& x : players) {
+        if (x.IsThrusting() && x.IsAlive()) {
+            effects.push_back({ EffectType::THRUST, x.GetPosition(), x.GetSpeed(), x.GetDirection(), x.GetSize(), x.GetColor() });
+        }
         x.UpdateTime(dt);
-        x.Move(dt);
+        x.Move(dt, field);
         for (auto it = x.bullets.begin(); it != x.bullets.end();) {
-            it->Move(dt);
-            it = (it->UpdateTime(dt)) ? x.bullets.erase(it) : ++it;
+            if (it->IsNew()) {
+                effects.push_back({ EffectType::SHOT, it->GetPosition(), x.GetSpeed(), it->GetDirection(), it->GetSize(), it->GetColor() });
+            }
+            it->Move(dt, field);
+            it = (it->UpdateTime(dt)) ? x.RemoveBullet(it) : ++it;
         }
     }
 
-    for (auto& x : asteroids) {
-        x.Move(dt);
+    // The asteroids moved along their lines with the clock. Where all of them are awake
+    // they are all looked at anyway, elsewhere the grid only catches up with them now and then
+    // and the next one is built a part per tick.
+    if (IsEveryoneAwake() || gridCount - gridRemoved.size() > asteroids.size()) {
+        BuildAsteroidGrid();
     }
+    else {
+        StepAsteroidGrid(dt);
+    }
+    CollideAsteroids();
     // Collision between Player and Asteroids
-    for (const auto& x : asteroids) {
-        for (auto& player : players) {
-            if (Distance(x.GetPosition(), player.GetPosition()) <= x.GetSize() + player.GetSize() * 0.6) {
-                player.Collision();
-            }
-        }
-    }
-    // Collision between Player and bullets
-    // Work, but not funny with it
-    for (auto& player: players) {
-        for (auto itB = player.bullets.begin(); itB != player.bullets.end(); itB++) {
-            if (Distance(itB->GetPosition(), player.GetPosition()) <= itB->GetSize() + player.GetSize() * 0.6) {
-                player.bullets.erase(itB);
-                player.Collision();
-                break;
-            }
-        }
-    }
-    //    if (GetType() == GameType::MULTIPLAYER) {
-    //        if (Distance(itB->GetPosition(), player2.GetPosition()) <= itB->GetSize() + player2.GetSize() * 0.6) {
-    //            bullets.erase(itB);
-    //            player2 = Player(GetType(), false);
-    //            lifes2--;
-    //            invincibleTime2 = INVINCIBLETIME;
-    //            break;
-    //        }
-    //    }
-    //}
-    // Collision between Bullets and Asteroids
-    for (auto& x : players) {
-        for (auto itB = x.bullets.begin(); itB != x.bullets.end();) {
-            bool next = true;
-            for (auto itA = asteroids.begin(); itA != asteroids.end(); itA++) {
-                if (Distance(itA->GetPosition(), itB->GetPosition()) <= itA->GetSize() + itB->GetSize()) {
-                    auto t = Distance(itA->GetPosition(), itB->GetPosition());
-                    next = false;
-                    Asteroid parent = *itA;
-                    itA = asteroids.erase(itA);
-                    itB = x.bullets.erase(itB);
-                    if (parent.GetSizeType() != Asteroid::AsteroidSize::SMALL) {
-                        asteroids.push_back(Asteroid(parent, false));
-                        asteroids.push_back(Asteroid(parent, true));
-                    }
-                    x.AddPoints((3 - static_cast<uint64_t>(parent.GetSizeType())) * 
-                        static_cast<uint64_t>(pow(10, static_cast<uint64_t>(parent.GetSpeedType()))) * (static_cast<uint64_t>(level) + 1));
-                    break;
-                }
+    for (auto& player : players) {
+        bool hit = false;
+        float reach = player.GetSize() * 0.6f + ASTEROIDMAXSIZE;
+        QueryAsteroids(player.GetPosition(), { reach, reach }, [&](uint32_t i) {
+            const Asteroid& x = asteroids[i];
+            hit |= Distance(GetPosition(x), player.GetPosition(), field) <= x.GetSize() + player.GetSize() * 0.6;
+        });
+        if (hit) {
+            if (player.IsAlive()) {
+                effects.push_back({ EffectType::EXPLOSION, player.GetPosition(), player.GetSpeed(), player.GetDirection(), player.GetSize(), player.GetColor() });
             }
-            if (next) {
-                itB++;
-            }
-        }
-    }
-    // Collision between asteroids
-    // Didn't debugged, not funny with it
-    //for (auto itB = asteroids.begin(); itB != asteroids.end(); itB++) {
-    //    for (auto itA = next(itB); itA != asteroids.end(); itA++) {
-    //        float delta = 5e-1;
-    //        if (Distance(itA->GetPosition(), itB->GetPosition()) - itA->GetSize() - itB->GetSize() <= delta) {
-    //            if (itA->GetSizeType() == itB->GetSizeType()) {
-    //                float tmp = Distance(itA->GetPosition(), itB->GetPosition()) <= itA->GetSize() + itB->GetSize();
-    //                float dir = CalculateDirection(itA->GetPosition(), itB->GetPosition());
-    //                Point speedTA = CalculateSpeed(itA->GetDirection(), itA->GetSpeed(), dir);
-    //                Point speedTB = CalculateSpeed(itB->GetDirection(), itB->GetSpeed(), dir);
-    //                itA->RecalculateDirection(dir, speedTA, speedTB);
-    //                itB->RecalculateDirection(dir, speedTB, speedTA);
-    //            }
-    //            else if (false) {
-    //                
-    //            }
-    //        }
-    //    }
-    //}
+            player.Collision();
+        }
+    }
+    CollidePlayers();
+    CollideBullets();
+    instrumentation.SetCount(Counter::ASTEROIDS, asteroids.size());
+    uint64_t bulletCount = 0;
+    for (const auto& x : players) {
+        bulletCount += x.bullets.size();
+    }
+    instrumentation.SetCount(Counter::BULLETS, bulletCount);
     if (IsLevelOver()) {
         NextLevel();
         return;
@@ -682,6 +1151,115 @@ void GameManager::UpdateTimeGame(float dt) {
     return;
 }
 
+void GameManager::BuildAsteroidGrid() {
+    nextBuilding = false;
+    asteroidGrid.Clear();
+    gridPositions.clear();
+    gridSpeed = 0;
+    for (const auto& x : asteroids) {
+        Point pos = GetPosition(x);
+        asteroidGrid.Insert(pos.x, pos.y);
+        gridPositions.push_back(pos);
+        gridSpeed = std::max(gridSpeed, x.GetSpeed());
+    }
+    asteroidGrid.Build();
+    gridTime = totaltime;
+    gridCount = static_cast<uint32_t>(asteroids.size());
+    gridRemoved.clear();
+    gridPushes.assign(asteroids.size(), 0.0f);
+    gridPush = 0;
+    return;
+}
+
+// Public GameManager replication
+void GameManager::Replicate(GameState argState, GameType argType, uint64_t argPoints, uint64_t argMaxPoints) {
+    state = argState;
+    type = argType;
+    points = argPoints;
+    maxPoints = argMaxPoints;
+    return;
+}
+
+// Public GameManager snapshot
+bool GameManager::LoadSnapshot(const uint8_t data[], size_t size) {
+    SnapshotReader reader(data, size);
+    GameState argState = reader.Read<GameState>();
+    GameType argType = reader.Read<GameType>();
+    uint64_t argMaxPoints = reader.Read<uint64_t>();
+    uint64_t argPoints = reader.Read<uint64_t>();
+    uint32_t argLevel = reader.Read<uint32_t>();
+    uint32_t argNextId = reader.Read<uint32_t>();
+    uint32_t argSeed = reader.Read<uint32_t>();
+    float argTotaltime = reader.Read<float>();
+    Point argField = reader.Read<Point>();
+    uint32_t playerCount = reader.Read<uint32_t>();
+    uint32_t asteroidCount = reader.Read<uint32_t>();
+    // Every object takes more than one byte, so larger counts can only come from a broken file
+    if (!reader.IsValid() || argLevel >= levelDifficulties.size() || playerCount > GAME_MAXPLAYERS ||
+        playerCount > reader.GetRemaining() || asteroidCount > reader.GetRemaining()) {
+        return false;
+    }
+    // Written by SetField, so anything else is broken as well; the comparisons also catch NaN
+    if (!(argField.x >= SCREEN_WIDTH && argField.x <= GAME_MAXFIELD && argField.y >= SCREEN_HEIGHT && argField.y <= GAME_MAXFIELD)) {
+        return false;
+    }
+    state = argState;
+    type = argType;
+    maxPoints = argMaxPoints;
+    points = argPoints;
+    level = argLevel;
+    nextId = argNextId;
+    seed = argSeed;
+    totaltime = argTotaltime;
+    if (argField.x != field.x || argField.y != field.y) {
+        field = argField;
+        ResetGrids();
+    }
+
+    if (players.size() > playerCount) {
+        players.erase(players.begin() + playerCount, players.end());
+    }
+    while (players.size() < playerCount) {
+        players.push_back(Player(type, static_cast<uint32_t>(players.size()), playerCount));
+    }
+    for (auto& x : players) {
+        x.Load(reader);
+    }
+    if (asteroids.size() > asteroidCount) {
+        asteroids.erase(asteroids.begin() + asteroidCount, asteroids.end());
+    }
+    while (asteroids.size() < asteroidCount) {
+        asteroids.push_back(Asteroid(Asteroid::AsteroidSpeed::SLOW, Asteroid::AsteroidSize::SMALL, { 0, 0 }, 0.0f, 0.0f));
+    }
+    for (auto& x : asteroids) {
+        x.Load(reader);
+    }
+    BuildAsteroidGrid();
+    return reader.IsValid() && reader.GetRemaining() == 0;
+}
+
+void GameManager::SaveSnapshot(std::vector<uint8_t>& data) const {
+    SnapshotWriter writer(data);
+    writer.Write(state);
+    writer.Write(type);
+    writer.Write(maxPoints);
+    writer.Write(points);
+    writer.Write(level);
+    writer.Write(nextId);
+    writer.Write(seed);
+    writer.Write(totaltime);
+    writer.Write(field);
+    writer.Write(static_cast<uint32_t>(players.size()));
+    writer.Write(static_cast<uint32_t>(asteroids.size()));
+    for (const auto& x : players) {
+        x.Save(writer);
+    }
+    for (const auto& x : asteroids) {
+        x.Save(writer);
+    }
+    writer.Finish();
+    return;
+}
 
 void GameManager::LoadDefaultBG(uint32_t buff[], std::string name) {
     std::ifstream input(name);
@@ -699,167 +1277,1036 @@ void GameManager::LoadDefaultBG(uint32_t buff[], std::string name) {
     return;
 }
 
+// Private GameManager
+// Ids are handed out in creation order, so asteroids stays sorted by id
+void GameManager::AddAsteroid(const Asteroid& asteroid) {
+    asteroids.push_back(asteroid);
+    asteroids.back().SetId(nextId++);
+    return;
+}
+
+// Only the asteroids near a ship look for contacts, with each other and with whatever they
+// touch; the rest stay on their lines untouched. Contacts are found in parallel against the
+// positions at the start of the pass and then resolved one by one in a fixed order, so the
+// outcome depends neither on the thread count nor on when the grid was built. A pair pushed
+// into contact by an earlier resolution waits for the next tick.
+void GameManager::CollideAsteroids() {
+    ScopedTimer timer(Phase::PHYSICS);
+    bool everyone = IsEveryoneAwake();
+    if (!everyone) {
+        WakeAsteroids();
+    }
+    uint32_t count = everyone ? asteroidGrid.GetCellCount() : static_cast<uint32_t>(awake.size());
+    uint32_t grain = everyone ? CELLGRAIN : AWAKEGRAIN;
+    uint32_t chunks = (count + grain - 1) / grain;
+    if (chunkPairs.size() < chunks) {
+        chunkPairs.resize(chunks);
+    }
+    chunkTests.assign(chunks, 0);
+    auto touch = [this](uint32_t i, uint32_t j, Point a, Point b) {
+        Point delta = ShortestDelta(a, b, field);
+        float minDist = asteroids[i].GetSize() + asteroids[j].GetSize();
+        return delta.x * delta.x + delta.y * delta.y < minDist * minDist;
+    };
+    if (everyone) {
+        // The grid was built this tick, its cells give every pair once in cell order
+        jobs.ParallelFor(count, grain, [&](uint32_t begin, uint32_t end) {
+            auto& pairs = chunkPairs[begin / grain];
+            uint64_t tests = 0;
+            pairs.clear();
+            asteroidGrid.ForEachPairInCells(begin, end, [&](uint32_t i, uint32_t j) {
+                tests++;
+                if (touch(i, j, gridPositions[i], gridPositions[j])) {
+                    pairs.push_back({ i, j });
+                }
+            });
+            chunkTests[begin / grain] = tests;
+        });
+    }
+    else {
+        // In order of the awake asteroid and then of the other
+        jobs.ParallelFor(count, grain, [&](uint32_t begin, uint32_t end) {
+            auto& pairs = chunkPairs[begin / grain];
+            uint64_t tests = 0;
+            pairs.clear();
+            for (uint32_t k = begin; k < end; k++) {
+                uint32_t i = awake[k];
+                Point pos = GetPosition(asteroids[i]);
+                size_t first = pairs.size();
+                QueryAsteroids(pos, { ASTEROIDCELLSIZE, ASTEROIDCELLSIZE }, [&](uint32_t j) {
+                    // Of two awake ones the lower index tests the pair
+                    if (j == i || (j < i && std::binary_search(awake.begin(), awake.end(), j))) {
+                        return;
+                    }
+                    tests++;
+                    if (touch(i, j, pos, GetPosition(asteroids[j]))) {
+                        pairs.push_back({ i, j });
+                    }
+                });
+                std::sort(pairs.begin() + first, pairs.end());
+            }
+            chunkTests[begin / grain] = tests;
+        });
+    }
+
+    uint64_t tests = 0, contacts = 0;
+    for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+        tests += chunkTests[chunk];
+        for (const auto& x : chunkPairs[chunk]) {
+            contacts += ResolveContact(x.first, x.second) ? 1 : 0;
+        }
+    }
+    instrumentation.AddCount(Counter::PAIR_TESTS, tests);
+    instrumentation.AddCount(Counter::CONTACTS, contacts);
+    return;
+}
+
+// Bullets look for hits in parallel, then the hits are applied in bullet order: a bullet
+// takes the first asteroid by index that is still there. Fragments join after the pass
+// and cannot be hit by the bullets of the same tick.
+void GameManager::CollideBullets() {
+    bulletRefs.clear();
+    for (uint32_t i = 0; i < players.size(); i++) {
+        for (auto it = players[i].bullets.begin(); it != players[i].bullets.end(); it++) {
+            bulletRefs.push_back({ i, it });
+        }
+    }
+    uint32_t count = static_cast<uint32_t>(bulletRefs.size());
+    uint32_t chunks = (count + BULLETGRAIN - 1) / BULLETGRAIN;
+    if (chunkPairs.size() < chunks) {
+        chunkPairs.resize(chunks);
+    }
+    jobs.ParallelFor(count, BULLETGRAIN, [&](uint32_t begin, uint32_t end) {
+        auto& hits = chunkPairs[begin / BULLETGRAIN];
+        hits.clear();
+        for (uint32_t i = begin; i < end; i++) {
+            const Player::Bullet& bullet = *bulletRefs[i].bullet;
+            size_t first = hits.size();
+            float reach = bullet.GetSize() + ASTEROIDMAXSIZE;
+            QueryAsteroids(bullet.GetPosition(), { reach, reach }, [&](uint32_t j) {
+                if (Distance(GetPosition(asteroids[j]), bullet.GetPosition(), field) <= asteroids[j].GetSize() + bullet.GetSize()) {
+                    hits.push_back({ i, j });
+                }
+            });
+            std::sort(hits.begin() + first, hits.end());
+        }
+    });
+
+    // Without a hit the asteroids stay as they are, none of them has to be looked at
+    bool found = false;
+    for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+        found |= !chunkPairs[chunk].empty();
+    }
+    if (!found) {
+        return;
+    }
+    uint32_t total = static_cast<uint32_t>(asteroids.size());
+    asteroidHit.assign(total, 0);
+    removed.clear();
+    for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+        uint32_t used = count;
+        for (const auto& x : chunkPairs[chunk]) {
+            if (x.first == used || asteroidHit[x.second]) {
+                continue;
+            }
+            used = x.first;
+            asteroidHit[x.second] = 1;
+            removed.push_back(x.second);
+            Player& player = players[bulletRefs[x.first].player];
+            player.RemoveBullet(bulletRefs[x.first].bullet);
+            Asteroid parent = asteroids[x.second];
+            effects.push_back({ EffectType::DEBRIS, GetPosition(parent), parent.GetVelocity(), parent.GetDirection(), parent.GetSize(), parent.GetColor() });
+            if (parent.GetSizeType() != Asteroid::AsteroidSize::SMALL) {
+                AddAsteroid(Asteroid(parent, false, totaltime, field));
+                AddAsteroid(Asteroid(parent, true, totaltime, field));
+            }
+            player.AddPoints((3 - static_cast<uint64_t>(parent.GetSizeType())) *
+                static_cast<uint64_t>(pow(10, static_cast<uint64_t>(parent.GetSpeedType()))) * (static_cast<uint64_t>(level) + 1));
+        }
+    }
+    if (removed.empty()) {
+        return;
+    }
+    // Fragments were appended behind, the survivors keep their order and so the ids stay sorted.
+    // The ones between two hits move down together, the ones before the first stay.
+    std::sort(removed.begin(), removed.end());
+    bool everyone = IsEveryoneAwake();
+    uint32_t alive = removed.front();
+    for (size_t j = 0; j < removed.size(); j++) {
+        uint32_t begin = removed[j] + 1;
+        uint32_t end = (j + 1 < removed.size()) ? removed[j + 1] : static_cast<uint32_t>(asteroids.size());
+        std::copy(asteroids.begin() + begin, asteroids.begin() + end, asteroids.begin() + alive);
+        if (!everyone) {
+            uint32_t pushEnd = std::min(end, total);
+            std::copy(gridPushes.begin() + begin, gridPushes.begin() + pushEnd, gridPushes.begin() + alive);
+            std::copy(nextPushes.begin() + begin, nextPushes.begin() + pushEnd, nextPushes.begin() + alive);
+        }
+        alive += end - begin;
+    }
+    asteroids.erase(asteroids.begin() + alive, asteroids.end());
+    // The grid of the physics pass stays good for the renderer until a hit changes the asteroids.
+    // A small world builds it again, a large one notes the hit ones for the queries to skip.
+    if (everyone) {
+        BuildAsteroidGrid();
+        return;
+    }
+    gridPushes.resize(asteroids.size(), 0.0f);
+    nextPushes.resize(asteroids.size(), 0.0f);
+    AddRemoved(gridRemoved, gridCount, removed);
+    if (nextBuilding) {
+        AddRemoved(nextRemoved, nextCount, removed);
+    }
+    return;
+}
+
+// Bullets of every ship, its own included, look for the living ships in a grid, so the pass
+// grows with the number of ships and bullets rather than with their product. A ship is hit
+// once a tick at most, by the first bullet in player and firing order, and of the ships a
+// bullet touches it takes the lowest index. Hits are applied after the search because a ship
+// that is hit loses its own bullets.
+void GameManager::CollidePlayers() {
+    uint32_t count = static_cast<uint32_t>(players.size());
+    playerGrid.Clear();
+    playerSlots.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        if (players[i].IsAlive()) {
+            playerGrid.Insert(players[i].GetPosition().x, players[i].GetPosition().y);
+            playerSlots.push_back(i);
+        }
+    }
+    playerGrid.Build();
+    playerHit.assign(count, 0);
+    playerHits.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        for (auto it = players[i].bullets.begin(); it != players[i].bullets.end(); it++) {
+            uint32_t victim = count;
+            float reach = it->GetSize() + SIZE * 0.6f;
+            playerGrid.Query(it->GetPosition().x, it->GetPosition().y, reach, [&](uint32_t j) {
+                uint32_t k = playerSlots[j];
+                if (k < victim && !playerHit[k] && Distance(it->GetPosition(), players[k].GetPosition(), field) <= it->GetSize() + players[k].GetSize() * 0.6) {
+                    victim = k;
+                }
+            });
+            if (victim != count) {
+                playerHit[victim] = 1;
+                playerHits.push_back({ i, it, victim });
+            }
+        }
+    }
+    for (const auto& x : playerHits) {
+        players[x.shooter].RemoveBullet(x.bullet);
+    }
+    for (const auto& x : playerHits) {
+        Player& player = players[x.victim];
+        uint32_t lifes = player.GetLifes();
+        effects.push_back({ EffectType::EXPLOSION, player.GetPosition(), player.GetSpeed(), player.GetDirection(), player.GetSize(), player.GetColor() });
+        player.Collision();
+        // Only a life taken counts, not a ship that was still invincible
+        if (x.shooter != x.victim && player.GetLifes() < lifes) {
+            players[x.shooter].AddPoints(SHIPPOINTS * (static_cast<uint64_t>(level) + 1));
+        }
+    }
+    return;
+}
+
+// Slack of the grid: how far an asteroid may be from where the grid has it
+float GameManager::GetGridSlack() const {
+    return gridSpeed * (totaltime - gridTime) + gridPush;
+}
+
+bool GameManager::IsEveryoneAwake() const {
+    return field.x <= 2 * AWAKEREACH.x && field.y <= 2 * AWAKEREACH.y;
+}
+
+bool GameManager::ResolveContact(uint32_t a, uint32_t b) {
+    // Earlier contacts of the pass may have moved them apart already
+    Disc<float> da = asteroids[a].GetDisc(totaltime, field), db = asteroids[b].GetDisc(totaltime, field);
+    Point pa = da.pos, pb = db.pos;
+    if (::ResolveContact(da, db, field) == ContactResult::NONE) {
+        return false;
+    }
+    asteroids[a].SetDisc(da, totaltime);
+    asteroids[b].SetDisc(db, totaltime);
+    // Both start new lines, the grid still finds them if its slack covers the pushes and the new speeds
+    Point pushA = ShortestDelta(pa, da.pos, field), pushB = ShortestDelta(pb, db.pos, field);
+    gridPushes[a] += std::sqrt(pushA.x * pushA.x + pushA.y * pushA.y);
+    gridPushes[b] += std::sqrt(pushB.x * pushB.x + pushB.y * pushB.y);
+    gridPush = std::max({ gridPush, gridPushes[a], gridPushes[b] });
+    gridSpeed = std::max({ gridSpeed, da.speed, db.speed });
+    if (nextBuilding) {
+        nextPushes[a] += std::sqrt(pushA.x * pushA.x + pushA.y * pushA.y);
+        nextPushes[b] += std::sqrt(pushB.x * pushB.x + pushB.y * pushB.y);
+        nextPush = std::max({ nextPush, nextPushes[a], nextPushes[b] });
+        nextSpeed = std::max({ nextSpeed, da.speed, db.speed });
+    }
+    return true;
+}
+
+void GameManager::ResetGrids() {
+    asteroidGrid.Reset(field.x, field.y, ASTEROIDCELLSIZE);
+    nextGrid.Reset(field.x, field.y, ASTEROIDCELLSIZE);
+    gridCount = 0;
+    gridRemoved.clear();
+    nextBuilding = false;
+    playerGrid.Reset(field.x, field.y, std::max(PLAYERCELLSIZE, std::max(field.x, field.y) / PLAYERGRIDCELLS));
+    return;
+}
+
+// A large world builds its next grid a part per tick, so no tick pays for all of it. It is
+// started early enough to be done before the slack of the current one reaches GRIDSLACK and
+// is then swapped in, along with the hits since it started for the queries to skip.
+void GameManager::StepAsteroidGrid(float dt) {
+    uint32_t count = static_cast<uint32_t>(asteroids.size());
+    gridPushes.resize(count, 0.0f);
+    nextPushes.resize(count, 0.0f);
+    if (!nextBuilding) {
+        uint64_t cost = count + nextGrid.GetBuildCost(count);
+        float buildTime = static_cast<float>((cost + GRIDBUILDSTEP - 1) / GRIDBUILDSTEP) * dt;
+        if (count + gridRemoved.size() - gridCount <= GRIDLOOSE && GetGridSlack() + gridSpeed * buildTime <= GRIDSLACK) {
+            return;
+        }
+        nextGrid.Clear();
+        nextRemoved.clear();
+        std::fill(nextPushes.begin(), nextPushes.end(), 0.0f);
+        nextBuilding = true;
+        nextTime = totaltime;
+        nextSpeed = 0;
+        nextPush = 0;
+        nextCount = count;
+        nextInserted = 0;
+    }
+    // Inserted where they are now, which is no further than nextSpeed from where they were
+    uint32_t budget = GRIDBUILDSTEP;
+    for (; nextInserted < nextCount && budget > 0; nextInserted++, budget--) {
+        auto it = std::lower_bound(nextRemoved.begin(), nextRemoved.end(), nextInserted);
+        if (it != nextRemoved.end() && *it == nextInserted) {
+            nextGrid.Insert(0, 0);
+            continue;
+        }
+        const Asteroid& x = asteroids[nextInserted - (it - nextRemoved.begin())];
+        Point pos = GetPosition(x);
+        nextGrid.Insert(pos.x, pos.y);
+        nextSpeed = std::max(nextSpeed, x.GetSpeed());
+    }
+    if (budget == 0 || !nextGrid.BuildPart(budget)) {
+        return;
+    }
+    std::swap(asteroidGrid, nextGrid);
+    gridPushes.swap(nextPushes);
+    gridRemoved.swap(nextRemoved);
+    gridTime = nextTime;
+    gridSpeed = nextSpeed;
+    gridPush = nextPush;
+    gridCount = nextCount;
+    nextBuilding = false;
+    return;
+}
 
-//
-//  IDEAS:
-//  Add audio - impossible with the current Engine
-//  Collision detection for asteroids - not interesting result, drop
-//  Create death's animation
-//
+// Ships that are down count as well, the level goes on around them
+void GameManager::WakeAsteroids() {
+    awake.clear();
+    if (IsEveryoneAwake()) {
+        for (uint32_t i = 0; i < asteroids.size(); i++) {
+            awake.push_back(i);
+        }
+        return;
+    }
+    for (const auto& player : players) {
+        Point center = player.GetPosition();
+        QueryAsteroids(center, AWAKEREACH, [&](uint32_t i) {
+            Point delta = ShortestDelta(center, GetPosition(asteroids[i]), field);
+            if (std::fabs(delta.x) <= AWAKEREACH.x && std::fabs(delta.y) <= AWAKEREACH.y) {
+                awake.push_back(i);
+            }
+        });
+    }
+    std::sort(awake.begin(), awake.end());
+    awake.erase(std::unique(awake.begin(), awake.end()), awake.end());
+    return;
+}
 
 static GameManager gameManager;
+static NetServer netServer;
+static NetClient netClient;
+static Rollback rollback;
+static CaptureWriter capture;
+static ParticleSystem particles;
+// Engine has no sound, the mixer plays into a sink of its own
+static AudioMixer audio;
+#ifdef AUDIO_WAV
+static const char* AUDIOFILE = "Audio.wav";
+#endif
+static std::vector<uint32_t> worldPixels;
+static uint32_t renderPreset = 0;
+
+// Background choices cycled with B, the image is read only once it is chosen
+enum class Background {
+    STARS,
+    IMAGE,
+    NONE
+};
+static Background background = Background::STARS;
+static Starfield starfield(STARFIELDSEED);
+static std::vector<uint32_t> defaultBG;
+static Point starOffset = { 0, 0 };
+static std::vector<uint8_t> autosave;
+// The second ship of a local game can be left to a bot
+static bool botSecond = false;
+static ThreatIndex threatIndex;
+static BotController bot;
+// Seats of an arena without a player, index 0 stays with the local one
+static BotController arenaBots[GAME_MAXPLAYERS];
+static bool canResume = false;
+// Keys read by the toggles in every state, the ship controls are bound in InputSystem
+static const uint8_t TOGGLEKEYS[] = { 'B', 'I', 'K', 'L', 'U', 'V' };
+
+static std::bitset<INPUT_KEYS> KeySet(std::initializer_list<uint8_t> keys) {
+    std::bitset<INPUT_KEYS> set;
+    for (uint8_t x : keys) {
+        set.set(x);
+    }
+    return set;
+}
+
+// And the ones read by the menu of each GameState, the poller looks at no others
+static const std::bitset<INPUT_KEYS> MENUKEYS[] = {
+    KeySet({ 'A', 'H', 'J', 'M', 'O', 'R', 'S', VK_ESCAPE }),
+    KeySet({ VK_ESCAPE }),
+    KeySet({ 'C', 'Q' }),
+    KeySet({ 'F', 'Q' }),
+    KeySet({ 'F', 'Q' })
+};
+static InputSystem input;
+// Engine paints inside RedrawWindow right after draw(), so the next act() marks the present
+static LatencyTracer latency;
+static const char* LATENCYLOGFILE = "Latency.txt";
+// What a menu, pause or end screen shows. The buffer keeps the last frame, so while the
+// key stays the same draw() leaves it as it is and act() paces down to IDLEFRAMETIME.
+// The overlay is drawn over the frame and its numbers change every frame, a screen that
+// shows it is never reused; it is part of the key so turning it off draws the frame again.
+struct ScreenKey {
+    GameState state;
+    GameType type;
+    uint64_t points, maxPoints;
+    bool canResume, overlay;
+    Background background;
+    uint32_t renderPreset;
+    int32_t starX, starY;
+};
+static ScreenKey screenKey;
+static bool screenCached = false;
+// Series of the live counters, only updated while the exporter runs
+struct MetricIds {
+    uint32_t frames, droppedFrames, frameTime;
+    uint32_t phases[static_cast<int>(Phase::COUNT)];
+    uint32_t asteroids, bullets, particles, pairTests, contacts;
+    uint32_t netSent, netReceived, netClients, allocations, allocatedBytes;
+};
+static MetricIds metricIds;
+static MetricsExporter metricsExporter;
+
+static void RegisterMetrics() {
+    static const char* PHASE_LABELS[] = { "phase=\"input\"", "phase=\"update\"", "phase=\"physics\"", "phase=\"network\"", "phase=\"draw\"" };
+    metricIds.frames = metrics.AddCounter("asteroids_frames_total", nullptr, "Frames run, in every state.");
+    metricIds.droppedFrames = metrics.AddCounter("asteroids_dropped_frames_total", nullptr, "Frames in play that missed a 60 Hz refresh.");
+    metricIds.frameTime = metrics.AddHistogram("asteroids_frame_seconds", nullptr, "Duration of the frames in play.",
+        FRAMETIMEBUCKETS, sizeof(FRAMETIMEBUCKETS) / sizeof(FRAMETIMEBUCKETS[0]));
+    for (int i = 0; i < static_cast<int>(Phase::COUNT); i++) {
+        metricIds.phases[i] = metrics.AddCounter("asteroids_phase_seconds_total", PHASE_LABELS[i], "Time spent in each part of the frame.");
+    }
+    metricIds.asteroids = metrics.AddGauge("asteroids_entities", "kind=\"asteroid\"", "Entities alive at the end of the last frame.");
+    metricIds.bullets = metrics.AddGauge("asteroids_entities", "kind=\"bullet\"", "Entities alive at the end of the last frame.");
+    metricIds.particles = metrics.AddGauge("asteroids_entities", "kind=\"particle\"", "Entities alive at the end of the last frame.");
+    metricIds.pairTests = metrics.AddCounter("asteroids_pair_tests_total", nullptr, "Collision pairs tested.");
+    metricIds.contacts = metrics.AddCounter("asteroids_contacts_total", nullptr, "Collision pairs that touched.");
+    metricIds.netSent = metrics.AddCounter("asteroids_net_sent_bytes_total", nullptr, "Bytes sent to the network.");
+    metricIds.netReceived = metrics.AddCounter("asteroids_net_received_bytes_total", nullptr, "Bytes received from the network.");
+    metricIds.netClients = metrics.AddGauge("asteroids_net_clients", nullptr, "Clients connected to this host.");
+    metricIds.allocations = metrics.AddCounter("asteroids_allocations_total", nullptr, "Heap allocations, zero unless built to track them.");
+    metricIds.allocatedBytes = metrics.AddCounter("asteroids_allocated_bytes_total", nullptr, "Heap bytes allocated, zero unless built to track them.");
+    return;
+}
+
+// Hands the frame that just ended to the registry, a few relaxed atomics per frame
+static void PublishMetrics(bool inPlay) {
+    float frameTime = instrumentation.GetFrameTime() * 1e-6f;
+    metrics.Add(metricIds.frames, 1);
+    if (inPlay) {
+        metrics.Observe(metricIds.frameTime, frameTime);
+        if (frameTime > DROPPEDFRAMETIME) {
+            metrics.Add(metricIds.droppedFrames, 1);
+        }
+    }
+    for (int i = 0; i < static_cast<int>(Phase::COUNT); i++) {
+        metrics.Add(metricIds.phases[i], instrumentation.GetTime(static_cast<Phase>(i)) * 1e-6);
+    }
+    metrics.Set(metricIds.asteroids, static_cast<double>(instrumentation.GetCount(Counter::ASTEROIDS)));
+    metrics.Set(metricIds.bullets, static_cast<double>(instrumentation.GetCount(Counter::BULLETS)));
+    metrics.Set(metricIds.particles, static_cast<double>(instrumentation.GetCount(Counter::PARTICLES)));
+    metrics.Add(metricIds.pairTests, static_cast<double>(instrumentation.GetCount(Counter::PAIR_TESTS)));
+    metrics.Add(metricIds.contacts, static_cast<double>(instrumentation.GetCount(Counter::CONTACTS)));
+    metrics.Add(metricIds.netSent, static_cast<double>(instrumentation.GetCount(Counter::NET_SENT)));
+    metrics.Add(metricIds.netReceived, static_cast<double>(instrumentation.GetCount(Counter::NET_RECEIVED)));
+    metrics.Set(metricIds.netClients, static_cast<double>(instrumentation.GetCount(Counter::NET_CLIENTS)));
+    uint64_t bytes = 0;
+    for (int i = 0; i <= ALLOCATION_NOPHASE; i++) {
+        bytes += allocations.GetBytes(i);
+    }
+    metrics.Add(metricIds.allocations, static_cast<double>(allocations.GetFrameCount()));
+    metrics.Add(metricIds.allocatedBytes, static_cast<double>(bytes));
+    return;
+}
 
 // initialize game data in this function
 void initialize() {
     srand(static_cast<uint32_t>(time(0)));
     gameManager = {};
     gameManager.SetState(GameState::MAINMENU);
-    gameManager.LoadDefaultBG(reinterpret_cast<uint32_t*>(defaultBG), "DefaultBG.txt");
+    canResume = ReadSnapshotFile(AUTOSAVEFILE, autosave);
+    for (uint8_t x : TOGGLEKEYS) {
+        input.Watch(x);
+    }
+    input.Start();
+    latency.OpenLog(LATENCYLOGFILE);
+#ifdef AUDIO_WAV
+    audio.Start(std::unique_ptr<AudioSink>(new WavAudioSink(AUDIOFILE)));
+#else
+    audio.Start(std::unique_ptr<AudioSink>(new NullAudioSink()));
+#endif
+#ifdef STRICT_ALLOCATIONS
+    allocations.SetStrict(true);
+#endif
+    RegisterMetrics();
+#ifdef METRICS_HTTP
+    metricsExporter.StartHttp(metrics, METRICS_PORT);
+#endif
+#ifdef METRICS_FILE
+    metricsExporter.StartFile(metrics, METRICSFILE, METRICS_FILEPERIOD);
+#endif
+#ifdef BENCHMARK
+    RunBenchmarks("Benchmark.txt");
+    schedule_quit_game();
+#endif
+#ifdef GOLDEN_FRAMES
+    RunGoldenFrames("Golden.txt", "GoldenReport.txt");
+    schedule_quit_game();
+#endif
+    return;
+}
+
+// A world larger than the screen scrolls under a camera
+static bool IsScrolling(const GameManager& game) {
+    return game.GetField().x > SCREEN_WIDTH || game.GetField().y > SCREEN_HEIGHT;
+}
+
+// Center of the part of the field on the screen, scrolling it follows the local ship
+static Point GetCamera(const GameManager& game) {
+    if (!IsScrolling(game) || game.players.empty()) {
+        return { SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 };
+    }
+    return game.players[0].GetPosition();
+}
+
+// Whether a body of the given radius can touch the canvas, always on one that wraps
+static bool IsOnCanvas(const Canvas& canvas, Point pos, float radius) {
+    if (!canvas.window) {
+        return true;
+    }
+    Point c = ToCanvas(canvas, pos);
+    float r = radius * canvas.scale;
+    return c.x + r >= 0 && c.y + r >= 0 && c.x - r < canvas.width && c.y - r < canvas.height;
+}
+
+// Nothing moves on these but the stars; the overlay and network games change on their own
+static bool IsStillScreen(const GameManager& game) {
+    return game.GetState() != GameState::GAME && !netClient.IsConnected() && !netServer.IsRunning() && !instrumentation.IsOverlayVisible();
+}
+
+static ScreenKey GetScreenKey(const GameManager& game) {
+    ScreenKey key = { game.GetState(), game.GetType(), game.GetPoints(), game.GetMaxPoints(), canResume, instrumentation.IsOverlayVisible(),
+        background, renderPreset, 0, 0 };
+    // Stars land on whole pixels, a still screen is drawn with the drift rounded down to them
+    if (background == Background::STARS) {
+        key.starX = static_cast<int32_t>(std::floor(starOffset.x));
+        key.starY = static_cast<int32_t>(std::floor(starOffset.y));
+    }
+    return key;
+}
+
+static bool IsSameScreen(const ScreenKey& a, const ScreenKey& b) {
+    return a.state == b.state && a.type == b.type && a.points == b.points && a.maxPoints == b.maxPoints && a.canResume == b.canResume
+        && a.overlay == b.overlay && a.background == b.background && a.renderPreset == b.renderPreset && a.starX == b.starX && a.starY == b.starY;
+}
+
+// Sleeps out the rest of an idle frame, a key going down or up ends it early
+static void WaitIdle() {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(static_cast<int64_t>(IDLEFRAMETIME * 1e6f));
+    while (!input.HasPending() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(IDLEWAITSTEP));
+    }
+    return;
+}
+
+// Turning and thrust last as long as the keys were held within the tick
+static void ApplyHeldInput(Player& player, const InputSnapshot& keys, uint32_t index, float dt) {
+    float turn = keys.GetHeld(index, InputAction::RIGHT) - keys.GetHeld(index, InputAction::LEFT);
+    if (turn != 0) {
+        player.Rotate(turn * dt * ROTATIONSPEED);
+    }
+    if (keys.GetHeld(index, InputAction::UP) > 0) {
+        player.Accelerate(keys.GetHeld(index, InputAction::UP) * dt);
+    }
+    if ((keys.GetPlayerInput(index) & INPUT_SHOOT) && player.CanShoot()) {
+        player.Shoot();
+    }
+    return;
+}
+
+// Bots take the arena seats nobody plays. Hosting, their input goes through the rollback
+// like the one of a client, for the tick about to be simulated.
+static void FlyArenaBots(float dt, bool hosting) {
+    if (gameManager.GetType() != GameType::ARENA) {
+        return;
+    }
+    threatIndex.Build(gameManager);
+    for (uint32_t i = 1; i < gameManager.players.size(); i++) {
+        Player& player = gameManager.players[i];
+        if (!player.IsAlive() || (hosting && netServer.HasClient(i))) {
+            continue;
+        }
+        uint8_t bits = arenaBots[i].Think(threatIndex, player, dt);
+        if (hosting) {
+            rollback.SetInput(rollback.GetTick(), i, bits);
+        }
+        else {
+            ApplyPlayerInput(player, bits, dt);
+        }
+    }
     return;
 }
 
 // this function is called to update game data,
 // dt - time elapsed since the previous update (in seconds)
 void act(float dt) {
+    static uint32_t linkPreset = 0;
+    static float autosaveTime = 0;
+    static GameState lastState = GameState::MAINMENU;
+    static uint32_t lastLevel = 0;
+    latency.Mark(LatencyStage::PRESENT, input.Now());
+    if (screenCached) {
+        WaitIdle();
+    }
+    instrumentation.BeginFrame();
+    audio.Measure();
+    // The frame that ended was steady play if it started and ended in GAME on the same level
+    const GameManager& played = netClient.IsConnected() ? netClient.GetView() : gameManager;
+    allocations.BeginFrame(lastState == GameState::GAME && played.GetState() == GameState::GAME && played.GetLevel() == lastLevel);
+    if (metricsExporter.IsRunning()) {
+        PublishMetrics(lastState == GameState::GAME && played.GetState() == GameState::GAME);
+    }
+    lastState = played.GetState();
+    lastLevel = played.GetLevel();
+    ScopedTimer timer(Phase::UPDATE);
+    // Both ships of a local game or the host's own on the arrows, otherwise either key set
+    bool split = !netClient.IsConnected() && gameManager.GetType() == GameType::MULTIPLAYER;
+    InputLayout layout = split ? InputLayout::SPLIT : InputLayout::SHARED;
+    // A connected client only reads its ship and the way out
+    input.Focus(layout, MENUKEYS[static_cast<int>(netClient.IsConnected() ? GameState::GAME : gameManager.GetState())]);
+    const InputSnapshot& keys = input.Consume(layout, input.Now());
+    if (keys.HasPress()) {
+        latency.Input(keys.GetFirstPress());
+    }
+    if (is_window_active()) {
+        if (keys.WasPressed('I')) {
+            instrumentation.ToggleOverlay();
+        }
+        if (keys.WasPressed('L')) {
+            linkPreset = (linkPreset + 1) % NET_LINKPRESETCOUNT;
+            netServer.GetConditioner().Configure(NET_LINKPRESETS[linkPreset][0], NET_LINKPRESETS[linkPreset][1], NET_LINKPRESETS[linkPreset][2]);
+            netClient.GetConditioner().Configure(NET_LINKPRESETS[linkPreset][0], NET_LINKPRESETS[linkPreset][1], NET_LINKPRESETS[linkPreset][2]);
+        }
+        if (keys.WasPressed('V')) {
+            if (capture.IsRunning()) {
+                capture.Stop();
+            }
+            else {
+                capture.Start("Capture_" + std::to_string(std::time(nullptr)) + ".acap", SCREEN_WIDTH, SCREEN_HEIGHT);
+            }
+        }
+        if (keys.WasPressed('U')) {
+            renderPreset = (renderPreset + 1) % (sizeof(RENDERPRESETS) / sizeof(RENDERPRESETS[0]));
+        }
+        if (keys.WasPressed('B')) {
+            background = (background == Background::STARS) ? Background::IMAGE : (background == Background::IMAGE) ? Background::NONE : Background::STARS;
+            if (background == Background::IMAGE && !gameManager.HasBG()) {
+                defaultBG.resize(SCREEN_WIDTH * SCREEN_HEIGHT);
+                gameManager.LoadDefaultBG(defaultBG.data(), DEFAULTBGFILE);
+                if (!gameManager.HasBG()) {
+                    std::vector<uint32_t>().swap(defaultBG);
+                    background = Background::NONE;
+                }
+            }
+        }
+        if (keys.WasPressed('K')) {
+            botSecond = !botSecond;
+        }
+    }
+    // The stars drift and pass by the first ship as it flies
+    const GameManager& shown = netClient.IsConnected() ? netClient.GetView() : gameManager;
+    starOffset.x += STARDRIFT.x * dt;
+    starOffset.y += STARDRIFT.y * dt;
+    if (shown.GetState() == GameState::GAME && !shown.players.empty()) {
+        starOffset.x += shown.players[0].GetSpeed().x * dt;
+        starOffset.y += shown.players[0].GetSpeed().y * dt;
+    }
+    // Networking keeps running in the background so that nobody times out
+    netServer.Receive(dt);
+    if (netClient.IsConnected()) {
+        uint8_t bits = 0;
+        if (is_window_active()) {
+            bits = keys.GetPlayerInput(0);
+            if (keys.IsDown(VK_ESCAPE)) {
+                netClient.Disconnect();
+            }
+        }
+        netClient.Update(dt, bits);
+        return;
+    }
     if (is_window_active()) {
         if (gameManager.GetState() == GameState::GAME) {
-            if (is_key_pressed(VK_ESCAPE)) {
+            if (netServer.IsRunning()) {
+                // Remote inputs arrive late, so the host simulates through the rollback window
+                rollback.SetInput(rollback.GetTick(), 0, keys.GetPlayerInput(0));
+                netServer.SubmitInputs(rollback);
+                FlyArenaBots(dt, true);
+                instrumentation.AddCount(Counter::ROLLBACK_TICKS, rollback.Advance(gameManager, dt));
+            }
+            else if (gameManager.players[0].IsAlive()) {
+                ApplyHeldInput(gameManager.players[0], keys, 0, dt);
+            }
+            if (gameManager.GetType() == GameType::MULTIPLAYER && !netServer.IsRunning() && botSecond) {
+                threatIndex.Build(gameManager);
+                ApplyPlayerInput(gameManager.players[1], bot.Think(threatIndex, gameManager.players[1], dt), dt);
+            }
+            else if (gameManager.GetType() == GameType::MULTIPLAYER && !netServer.IsRunning() && gameManager.players[1].IsAlive()) {
+                ApplyHeldInput(gameManager.players[1], keys, 1, dt);
+            }
+            else if (!netServer.IsRunning()) {
+                FlyArenaBots(dt, false);
+            }
+            if (!netServer.IsRunning()) {
+                gameManager.UpdateTimeGame(dt);
+            }
+            particles.Emit(gameManager.effects);
+            particles.Update(dt, gameManager.GetField());
+            audio.Play(gameManager.effects, GetCamera(gameManager), gameManager.GetField());
+            instrumentation.SetCount(Counter::PARTICLES, particles.GetCount());
+            // Paused only after the tick, a rollback would restore the running state
+            if (keys.WasPressed(VK_ESCAPE) && gameManager.GetState() == GameState::GAME) {
                 gameManager.SetState(GameState::PAUSE);
             }
-            if (gameManager.players[0].IsAlive()) {
-                if (is_key_pressed(VK_LEFT) || gameManager.GetType() == GameType::SIGLEPLAYER && is_key_pressed('A')) {
-                    gameManager.players[0].Rotate(-dt * ROTATIONSPEED);
-                }
-                if (is_key_pressed(VK_RIGHT) || gameManager.GetType() == GameType::SIGLEPLAYER && is_key_pressed('D')) {
-                    gameManager.players[0].Rotate(dt * ROTATIONSPEED);
-                }
-                if (is_key_pressed(VK_UP) || gameManager.GetType() == GameType::SIGLEPLAYER && is_key_pressed('W')) {
-                    gameManager.players[0].Accelerate(dt);
-                }
-                if (is_key_pressed(VK_SPACE) || gameManager.GetType() == GameType::SIGLEPLAYER && is_key_pressed('G')) {
-                    if (gameManager.players[0].CanShoot()) {
-                        gameManager.players[0].Shoot();
-                    }
-                }
+            autosaveTime += dt;
+            if (gameManager.GetState() == GameState::GAME && autosaveTime >= AUTOSAVEPERIOD) {
+                autosaveTime = 0;
+                gameManager.SaveSnapshot(autosave);
+                canResume = WriteSnapshotFile(AUTOSAVEFILE, autosave);
             }
-            if (gameManager.GetType() == GameType::MULTIPLAYER && gameManager.players[1].IsAlive()) {
-                if (is_key_pressed('A')) {
-                    gameManager.players[1].Rotate(-dt * ROTATIONSPEED);
-                }
-                if (is_key_pressed('D')) {
-                    gameManager.players[1].Rotate(dt * ROTATIONSPEED);
-                }
-                if (is_key_pressed('W')) {
-                    gameManager.players[1].Accelerate(dt);
-                }
-                if (is_key_pressed('G')) {
-                    if (gameManager.players[1].CanShoot()) {
-                        gameManager.players[1].Shoot();
-                    }
-                }
+            else if (gameManager.GetState() == GameState::GAMEOVER || gameManager.GetState() == GameState::GAMEWIN) {
+                // A finished game is not worth resuming
+                std::remove(AUTOSAVEFILE);
+                canResume = false;
             }
-            gameManager.UpdateTimeGame(dt);
         }
         else if (gameManager.GetState() == GameState::PAUSE) {
-            if (is_key_pressed('Q')) {
+            if (keys.WasPressed('Q')) {
                 gameManager.GameOver();
                 gameManager.SetState(GameState::MAINMENU);
+                netServer.Stop();
+                particles.Clear();
             }
-            if (is_key_pressed('C')) {
+            if (keys.WasPressed('C')) {
                 gameManager.SetState(GameState::GAME);
             }
         }
         else if (gameManager.GetState() == GameState::GAMEOVER || gameManager.GetState() == GameState::GAMEWIN) {
-            if (is_key_pressed('Q')) {
+            if (keys.WasPressed('Q')) {
                 gameManager.GameOver();
                 gameManager.SetState(GameState::MAINMENU);
+                netServer.Stop();
+                particles.Clear();
             }
-            if (is_key_pressed('F')) {
+            if (keys.WasPressed('F')) {
                 gameManager.StartGame(gameManager.GetType());
+                rollback.Reset();
+                particles.Clear();
             }
         }
         else if (gameManager.GetState() == GameState::MAINMENU) {
-            if (is_key_pressed(VK_ESCAPE)) {
+            if (keys.WasPressed(VK_ESCAPE)) {
                 schedule_quit_game();
             }
-            if (is_key_pressed('S')) {
+            // Replaying a finished game keeps its world, a new one from the menu picks it
+            if (keys.WasPressed('S')) {
+                gameManager.SetField(SCREENFIELD);
                 gameManager.StartGame(GameType::SIGLEPLAYER);
             }
-            if (is_key_pressed('M')) {
+            if (keys.WasPressed('M')) {
+                gameManager.SetField(SCREENFIELD);
                 gameManager.StartGame(GameType::MULTIPLAYER);
             }
+            if (keys.WasPressed('A')) {
+                gameManager.SetField(SCREENFIELD);
+                gameManager.StartGame(GameType::ARENA);
+            }
+            if (keys.WasPressed('O')) {
+                gameManager.SetField({ GAME_WORLDSIZE, GAME_WORLDSIZE });
+                gameManager.StartGame(GameType::SIGLEPLAYER);
+            }
+            // A hosted game is an arena, players who join take over seats from the bots.
+            // Replicated positions only reach a little past the screen, so it keeps to it.
+            if (keys.WasPressed('H') && netServer.Start(NET_PORT, GAME_MAXPLAYERS)) {
+                gameManager.SetField(SCREENFIELD);
+                gameManager.StartGame(GameType::ARENA);
+                rollback.Reset();
+            }
+            if (keys.WasPressed('J')) {
+                netClient.Connect({ NET_LOCALHOST, NET_PORT });
+            }
+            if (keys.WasPressed('R') && canResume && ReadSnapshotFile(AUTOSAVEFILE, autosave)) {
+                // Restore into a copy, so a broken file leaves the menu intact
+                GameManager resumed = gameManager;
+                if (resumed.LoadSnapshot(autosave.data(), autosave.size()) && resumed.GetState() == GameState::GAME) {
+                    gameManager = resumed;
+                    autosaveTime = 0;
+                }
+                else {
+                    canResume = false;
+                }
+            }
         }
     }
+    netServer.SendSnapshots(gameManager, rollback.GetTick());
     return;
 }
 
-// fill buffer in this function
-// uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH] - is an array of 32-bit colors (8 bits per R, G, B)
-void draw() {
+// HUD lines are built in the frame arena, so playing frames do not allocate
+static void DrawValue(uint32_t buff[], const char* label, uint64_t value, uint32_t posx, uint32_t posy) {
+    ArenaString text(frameArena);
+    text += label;
+    text += std::to_string(value).c_str();
+    DrawString(buff, text.c_str(), posx, posy);
+    return;
+}
+
+// Best ships of an arena in their colors, one line each: rank, seat, points and lives.
+// Only the shown rows are sorted, the cost grows with the number of ships and not faster.
+static void DrawStandings(uint32_t buff[], const GameManager& game, uint32_t posx, uint32_t posy) {
+    uint32_t order[GAME_MAXPLAYERS];
+    uint32_t count = std::min(static_cast<uint32_t>(game.players.size()), GAME_MAXPLAYERS);
+    uint32_t alive = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        order[i] = i;
+        alive += game.players[i].IsAlive() ? 1 : 0;
+    }
+    uint32_t rows = std::min(count, ARENASTANDINGS);
+    std::partial_sort(order, order + rows, order + count, [&](uint32_t a, uint32_t b) {
+        uint64_t pa = game.players[a].GetPoints(), pb = game.players[b].GetPoints();
+        return pa > pb || (pa == pb && a < b);
+    });
+    ArenaString text(frameArena);
+    text.assign("SHIPS ");
+    text += std::to_string(alive).c_str();
+    text += " OF ";
+    text += std::to_string(count).c_str();
+    DrawString(buff, text.c_str(), posx, posy, 2);
+    for (uint32_t i = 0; i < rows; i++) {
+        const Player& player = game.players[order[i]];
+        text.assign(std::to_string(i + 1).c_str());
+        text += " P";
+        text += std::to_string(order[i]).c_str();
+        text += " ";
+        text += std::to_string(player.GetPoints()).c_str();
+        text += " x";
+        text += std::to_string(player.GetLifes()).c_str();
+        // Ships that are out are listed dimmed
+        uint32_t color = player.GetColor();
+        if (!player.IsAlive()) {
+            color = 0xFF000000 | (color >> 1 & 0x007F7F7F);
+        }
+        DrawString(buff, text.c_str(), posx, posy + 20 * (i + 1), 2, color);
+    }
+    return;
+}
+
+// Renders a frame as draw() shows it, without the overlay
+void RenderFrame(uint32_t buff[], const GameManager& game, const ParticleSystem& particleSystem, const RenderSettings& settings, Point stars) {
+    bool playing = game.GetState() == GameState::GAME || game.GetState() == GameState::PAUSE;
+    // The field is drawn at the internal resolution and scaled up, the HUD stays native
+    uint32_t factor = playing ? RENDERPRESETS[settings.preset][0] : 1;
+    Canvas world = { buff, SCREEN_WIDTH, SCREEN_HEIGHT, 1.0f, false };
+    if (factor > 1 || settings.tiled) {
+        worldPixels.resize(SCREEN_WIDTH / factor * SCREEN_HEIGHT / factor);
+        world = { worldPixels.data(), SCREEN_WIDTH / static_cast<int>(factor), SCREEN_HEIGHT / static_cast<int>(factor), 1.0f / factor, settings.tiled };
+    }
+    bool picture = settings.image && !playing;
     // clear backbuffer
-    if (gameManager.HasBG() && !(gameManager.GetState() == GameState::GAME || gameManager.GetState() == GameState::PAUSE)) {
-        memcpy_s(buffer, SCREEN_HEIGHT * SCREEN_WIDTH * sizeof(uint32_t), defaultBG, SCREEN_HEIGHT * SCREEN_WIDTH * sizeof(uint32_t));
+    if (picture) {
+        memcpy_s(buff, SCREEN_HEIGHT * SCREEN_WIDTH * sizeof(uint32_t), settings.image, SCREEN_HEIGHT * SCREEN_WIDTH * sizeof(uint32_t));
     }
     else {
-        memset(buffer, 0, SCREEN_HEIGHT * SCREEN_WIDTH * sizeof(uint32_t));
+        memset(world.pixels, 0, world.width * world.height * sizeof(uint32_t));
+        if (settings.stars) {
+            starfield.Draw(world, stars);
+        }
     }
-    if (gameManager.GetState() == GameState::GAME || gameManager.GetState() == GameState::PAUSE) {
-        for (const auto& player : gameManager.players) {
-            if (player.IsAlive()) {
-                player.Draw(reinterpret_cast<uint32_t*>(buffer));
+    // A larger world is seen through a window around the camera, the stars stay behind it
+    Canvas view = world;
+    if (playing) {
+        Point camera = GetCamera(game);
+        if (IsScrolling(game)) {
+            view.window = true;
+            view.originX = camera.x - SCREEN_WIDTH / 2;
+            view.originY = camera.y - SCREEN_HEIGHT / 2;
+            view.fieldWidth = game.GetField().x;
+            view.fieldHeight = game.GetField().y;
+        }
+        for (const auto& player : game.players) {
+            if (player.IsAlive() && IsOnCanvas(view, player.GetPosition(), player.GetSize())) {
+                player.Draw(view);
             }
             for (auto& x : player.bullets) {
-                x.Draw(reinterpret_cast<uint32_t*>(buffer));
+                if (IsOnCanvas(view, x.GetPosition(), x.GetSize())) {
+                    x.Draw(view);
+                }
             }
         }
-        for (auto& x : gameManager.asteroids) {
-            x.Draw(reinterpret_cast<uint32_t*>(buffer));
+        // Only the cells around the window are looked at, however many asteroids the world holds
+        uint64_t drawn = 0;
+        if (view.window) {
+            Point reach = { SCREEN_WIDTH / 2 + ASTEROIDMAXSIZE, SCREEN_HEIGHT / 2 + ASTEROIDMAXSIZE };
+            game.QueryAsteroids(camera, reach, [&](uint32_t i) {
+                const Asteroid& x = game.asteroids[i];
+                if (IsOnCanvas(view, game.GetPosition(x), x.GetSize())) {
+                    x.Draw(view, game.GetTime(), game.GetField());
+                    drawn++;
+                }
+            });
+        }
+        else {
+            for (auto& x : game.asteroids) {
+                x.Draw(view, game.GetTime(), game.GetField());
+            }
+            drawn = game.asteroids.size();
+        }
+        instrumentation.SetCount(Counter::DRAWN, drawn);
+        particleSystem.Draw(view);
+        if (game.GetState() == GameState::PAUSE) {
+            BlendSpan(world.pixels, world.width * world.height, BGRA(0, 0, 0, 160).GetPremultiplied());
+        }
+    }
+    // The field reaches the screen before the text, which is always native and row after row
+    if (factor > 1) {
+        Upscale(view, buff, factor, RENDERPRESETS[settings.preset][1] != 0);
+    }
+    else if (world.tiled && !picture) {
+        Untile(world, buff);
+    }
+    if (playing) {
+        if (game.GetState() == GameState::PAUSE) {
+            DrawString(buff, "PAUSE", 200, SCREEN_HEIGHT / 2 - 50, 10);
+            DrawString(buff, "Press C to continue! ", 200, SCREEN_HEIGHT / 2 + 200);
+            DrawString(buff, "Press Q to return to main menu! ", 200, SCREEN_HEIGHT / 2 + 150);
         }
-        if (gameManager.GetState() == GameState::PAUSE) {
-            DrawString(reinterpret_cast<uint32_t*>(buffer), "PAUSE", 200, SCREEN_HEIGHT / 2 - 50, 10);
-            DrawString(reinterpret_cast<uint32_t*>(buffer), "Press C to continue! ", 200, SCREEN_HEIGHT / 2 + 200);
-            DrawString(reinterpret_cast<uint32_t*>(buffer), "Press Q to return to main menu! ", 200, SCREEN_HEIGHT / 2 + 150);
+        else if (game.GetType() == GameType::SIGLEPLAYER) {
+            DrawValue(buff, "Score: ", game.players[0].GetPoints(), 10, 10);
+            DrawValue(buff, "Highscore: ", game.GetMaxPoints(), 400, 10);
+            DrawValue(buff, "Lives: ", game.players[0].GetLifes(), SCREEN_WIDTH - 140, 10);
         }
-        else if (gameManager.GetType() == GameType::SIGLEPLAYER) {
-            DrawString(reinterpret_cast<uint32_t*>(buffer), "Score: " + std::to_string(gameManager.players[0].GetPoints()), 10, 10);
-            DrawString(reinterpret_cast<uint32_t*>(buffer), "Highscore: " + std::to_string(gameManager.GetMaxPoints()), 400, 10);
-            DrawString(reinterpret_cast<uint32_t*>(buffer), "Lives: " + std::to_string(gameManager.players[0].GetLifes()), SCREEN_WIDTH - 140, 10);
+        else if (game.GetType() == GameType::ARENA) {
+            DrawValue(buff, "Score: ", game.players[0].GetPoints(), 10, 10);
+            DrawValue(buff, "Lives: ", game.players[0].GetLifes(), 10, 60);
+            DrawStandings(buff, game, SCREEN_WIDTH - 250, 10);
         }
         else {
-            DrawString(reinterpret_cast<uint32_t*>(buffer), "Score: " + std::to_string(gameManager.players[1].GetPoints()), 10, 10);
-            DrawString(reinterpret_cast<uint32_t*>(buffer), "Score: " + std::to_string(gameManager.players[0].GetPoints()), 800, 10);
-            DrawString(reinterpret_cast<uint32_t*>(buffer), "Highscore: " + std::to_string(gameManager.GetMaxPoints()), 400, 10);
-            DrawString(reinterpret_cast<uint32_t*>(buffer), "Lives: " + std::to_string(gameManager.players[1].GetLifes()), 10, 60);
-            DrawString(reinterpret_cast<uint32_t*>(buffer), "Lives: " + std::to_string(gameManager.players[0].GetLifes()), 800, 60);
+            DrawValue(buff, "Score: ", game.players[1].GetPoints(), 10, 10);
+            DrawValue(buff, "Score: ", game.players[0].GetPoints(), 800, 10);
+            DrawValue(buff, "Highscore: ", game.GetMaxPoints(), 400, 10);
+            DrawValue(buff, "Lives: ", game.players[1].GetLifes(), 10, 60);
+            DrawValue(buff, "Lives: ", game.players[0].GetLifes(), 800, 60);
         }
-        return;
     }
-    else if (gameManager.GetState() == GameState::GAMEOVER) {
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "Game over!", 200, SCREEN_HEIGHT/2 - 50, 10);
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "Your score: " + std::to_string(gameManager.GetPoints()), 200, SCREEN_HEIGHT / 2 + 50);
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "Your highscore: " + std::to_string(gameManager.GetMaxPoints()), 200, SCREEN_HEIGHT / 2 + 100);
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "Press F to pay replay! ", 200, SCREEN_HEIGHT / 2 + 150);
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "Or press Q to give up ", 200, SCREEN_HEIGHT / 2 + 200);
+    else if (game.GetState() == GameState::GAMEOVER) {
+        DrawString(buff, "Game over!", 200, SCREEN_HEIGHT/2 - 50, 10);
+        DrawValue(buff, "Your score: ", game.GetPoints(), 200, SCREEN_HEIGHT / 2 + 50);
+        DrawValue(buff, "Your highscore: ", game.GetMaxPoints(), 200, SCREEN_HEIGHT / 2 + 100);
+        DrawString(buff, "Press F to pay replay! ", 200, SCREEN_HEIGHT / 2 + 150);
+        DrawString(buff, "Or press Q to give up ", 200, SCREEN_HEIGHT / 2 + 200);
+    }
+    else if (game.GetState() == GameState::GAMEWIN) {
+        DrawString(buff, "UNBELIEVABLE!", 200, SCREEN_HEIGHT / 2 - 50, 10);
+        DrawValue(buff, "Your score: ", game.GetPoints(), 200, SCREEN_HEIGHT / 2 + 50);
+        DrawValue(buff, "Your highscore: ", game.GetMaxPoints(), 200, SCREEN_HEIGHT / 2 + 100);
+        DrawString(buff, "Press F to pay replay! ", 200, SCREEN_HEIGHT / 2 + 150);
+        DrawString(buff, "Or press q to leave as a winner ", 200, SCREEN_HEIGHT / 2 + 200);
+    }
+    else if (game.GetState() == GameState::MAINMENU) {
+        DrawString(buff, "COSMOSHOOTING", 175, 150, 10);
+        DrawString(buff, "[S]ingleplayer or [M]ultiplayer", 200, SCREEN_HEIGHT / 2 - 100, 5);
+        DrawString(buff, "[H]ost or [J]oin a network game", 300, SCREEN_HEIGHT / 2 - 20, 3);
+        DrawString(buff, "[A]rena of 64 ships or [O]pen world", 300, SCREEN_HEIGHT / 2 + 60, 3);
+        if (settings.canResume) {
+            DrawString(buff, "[R]esume the last game", 300, SCREEN_HEIGHT / 2 + 20, 3);
+        }
+        DrawString(buff, "Press UP and W to accelerate", 300, SCREEN_HEIGHT / 2 + 100, 3);
+        DrawString(buff, "Press LEFTRIGHT and AD to rotate", 300, SCREEN_HEIGHT / 2 + 150, 3);
+        DrawString(buff, "Press SPACE and G to shoot", 300, SCREEN_HEIGHT / 2 + 200, 3);
+        DrawString(buff, "Created by lumidelta\a and based on Atari 1979 ", 300, 730, 2);
+        DrawString(buff, "0+", 10, 730, 4);
+    }
+    return;
+}
+
+// fill buffer in this function
+// uint32_t buffer[SCREEN_HEIGHT][SCREEN_WIDTH] - is an array of 32-bit colors (8 bits per R, G, B)
+void draw() {
+    latency.Mark(LatencyStage::SIMULATE, input.Now());
+    ScopedTimer timer(Phase::DRAW);
+    // A network client shows the replicated view instead of its own game
+    const GameManager& game = netClient.IsConnected() ? netClient.GetView() : gameManager;
+    bool still = IsStillScreen(game);
+    ScreenKey key = GetScreenKey(game);
+    if (still && screenCached && IsSameScreen(key, screenKey)) {
+        // Presented again from the buffer as it is
+        instrumentation.AddCount(Counter::CAPTURE_BYTES, capture.AddFrame(reinterpret_cast<const uint32_t*>(buffer)));
+        latency.Mark(LatencyStage::RASTER, input.Now());
+        return;
     }
-    else if (gameManager.GetState() == GameState::GAMEWIN) {
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "UNBELIEVABLE!", 200, SCREEN_HEIGHT / 2 - 50, 10);
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "Your score: " + std::to_string(gameManager.GetPoints()), 200, SCREEN_HEIGHT / 2 + 50);
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "Your highscore: " + std::to_string(gameManager.GetMaxPoints()), 200, SCREEN_HEIGHT / 2 + 100);
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "Press F to pay replay! ", 200, SCREEN_HEIGHT / 2 + 150);
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "Or press q to leave as a winner ", 200, SCREEN_HEIGHT / 2 + 200);
+    screenCached = still;
+    screenKey = key;
+    Point stars = still ? Point{ static_cast<float>(key.starX), static_cast<float>(key.starY) } : starOffset;
+    RenderSettings settings = { renderPreset, background == Background::STARS, nullptr, canResume, TILEDFIELD };
+    if (background == Background::IMAGE && gameManager.HasBG()) {
+        settings.image = defaultBG.data();
     }
-    else if (gameManager.GetState() == GameState::MAINMENU) {
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "COSMOSHOOTING", 175, 150, 10);
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "[S]ingleplayer or [M]ultiplayer", 200, SCREEN_HEIGHT / 2 - 100, 5);
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "Press UP and W to accelerate", 300, SCREEN_HEIGHT / 2 + 100, 3);
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "Press LEFTRIGHT and AD to rotate", 300, SCREEN_HEIGHT / 2 + 150, 3);
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "Press SPACE and G to shoot", 300, SCREEN_HEIGHT / 2 + 200, 3);
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "Created by lumidelta\a and based on Atari 1979 ", 300, 730, 2);
-        DrawString(reinterpret_cast<uint32_t*>(buffer), "0+", 10, 730, 4);
+    RenderFrame(reinterpret_cast<uint32_t*>(buffer), game, particles, settings, stars);
+    // Recorded without the overlay
+    instrumentation.AddCount(Counter::CAPTURE_BYTES, capture.AddFrame(reinterpret_cast<const uint32_t*>(buffer)));
+    if (instrumentation.IsOverlayVisible()) {
+        instrumentation.Draw(reinterpret_cast<uint32_t*>(buffer));
+        latency.Draw(reinterpret_cast<uint32_t*>(buffer), SCREEN_WIDTH / 2, 120);
+        allocations.Draw(reinterpret_cast<uint32_t*>(buffer), SCREEN_WIDTH / 2, 300);
+        audio.Draw(reinterpret_cast<uint32_t*>(buffer), SCREEN_WIDTH / 2, 480);
     }
+    // Everything drawn, the text of this frame is not needed any more
+    frameArena.Reset();
+    latency.Mark(LatencyStage::RASTER, input.Now());
 }
 
 // free game data in this function
 void finalize() {
+    metricsExporter.Stop();
+    audio.Stop();
+    capture.Stop();
+    input.Stop();
     return;
 }
\ No newline at end of file
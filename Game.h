@@ -1,14 +1,29 @@
 #pragma once
 #include "Engine.h"
+#include "Compositor.h"
+#include "Kinematics.h"
+#include "SpatialGrid.h"
+#include "Snapshot.h"
 #include <string>
 #include <vector>
 #include <list>
 
 enum class GameType {
     SIGLEPLAYER,
-    MULTIPLAYER
+    MULTIPLAYER,
+    // Free for all of up to GAME_MAXPLAYERS ships, the seats nobody takes are flown by bots
+    ARENA
 };
 
+constexpr uint32_t GAME_MAXPLAYERS = 64;
+// Every module measures angles with this one, not M_PI, which <cmath> defines on some toolchains
+constexpr float GAME_PI = 3.14159265f;
+// Side of the open world, which scrolls under a camera instead of fitting the screen
+constexpr float GAME_WORLDSIZE = 16384.0f;
+// Largest field a world can have: float still resolves positions to a few hundredths of a
+// pixel there, and the grids stay at a few million cells
+constexpr float GAME_MAXFIELD = 262144.0f;
+
 // Diferent states of the game
 enum class GameState {
     MAINMENU,
@@ -18,9 +33,25 @@ enum class GameState {
     GAMEWIN
 };
 
-struct Point {
-    float x;
-    float y;
+// Visual and audible effects the simulation asks for
+enum class EffectType {
+    DEBRIS,
+    EXPLOSION,
+    THRUST,
+    SHOT
+};
+
+// The game simulates on float, see Kinematics.h
+typedef Vec2<float> Point;
+
+class ParticleSystem;
+
+// Effect of one tick, turned into particles and sounds by the presentation
+struct Effect {
+    EffectType type;
+    Point pos, speed;
+    float dir, size;
+    uint32_t color;
 };
 
 struct BGRA {
@@ -31,15 +62,22 @@ struct BGRA {
     BGRA();
     BGRA(uint8_t b, uint8_t g, uint8_t r, uint8_t a);
     uint32_t GetInt() const;
+    uint32_t GetPremultiplied() const;
 };
 
-void Bresenham(uint32_t buff[], Point d1, Point d2, uint32_t color);
-float Distance(Point a, Point b);
-void DrawString(uint32_t buff[], std::string str, uint32_t posx, uint32_t posy, uint32_t size);
-int mod(int value, int m);
+// One player's input for one frame
+constexpr uint8_t INPUT_LEFT = 1;
+constexpr uint8_t INPUT_RIGHT = 2;
+constexpr uint8_t INPUT_UP = 4;
+constexpr uint8_t INPUT_SHOOT = 8;
 
-//float CalculateDirection(Point a, Point b);
-//Point CalculateSpeed(float initDir, float speed, float collisionDir);
+void Bresenham(const Canvas& canvas, Point d1, Point d2, uint32_t color);
+// Color is premultiplied 0xAARRGGBB as taken by the compositor
+void DrawString(uint32_t buff[], const char* str, uint32_t posx, uint32_t posy, uint32_t size, uint32_t color = 0xFFFFFFFF);
+void DrawString(uint32_t buff[], const std::string& str, uint32_t posx, uint32_t posy, uint32_t size, uint32_t color = 0xFFFFFFFF);
+int mod(int value, int m);
+// Where a point of the field lands on the canvas, on a window the copy nearest to its center
+Point ToCanvas(const Canvas& canvas, Point pos);
 
 
 class GameObject {
@@ -49,20 +87,34 @@ public:
     // Info
     uint32_t GetColor() const;
     float GetDirection() const;
+    uint32_t GetId() const;
     Point GetPosition() const;
     float GetSize() const;
     float GetSpeed() const;
     
     // Action
     void Rotate(float angle);
-    virtual void Move(float dt);
+    // Field is the size the world wraps at
+    virtual void Move(float dt, Point field);
+
+    // Replication
+    void Place(Point argPosition, float argDir);
+    void SetId(uint32_t argId);
 
-    virtual void Draw(uint32_t buff[]) const;
+    // Snapshot
+    void Load(SnapshotReader& reader);
+    void Save(SnapshotWriter& writer) const;
+
+    virtual void Draw(const Canvas& canvas) const;
     
 protected:
     float dir, size, speed;
     Point pos;
     BGRA color;
+    uint32_t id;
+
+    // Disc of the object's size and color centered on position
+    void DrawAt(const Canvas& canvas, Point position) const;
 
     // Set
     void SetColor(BGRA argColor);
@@ -77,48 +129,81 @@ class Player : public GameObject {
 public:
     class Bullet : public GameObject {
     public:
-        Bullet(Player player);
+        Bullet(const Player& player);
+        Bullet(Point argPosition, float argDir);
+
+        // Info
+        // Fired in this tick, it has not been updated yet
+        bool IsNew() const;
+
         bool UpdateTime(float dt);
+
+        // Snapshot
+        void Load(SnapshotReader& reader);
+        void Save(SnapshotWriter& writer) const;
     private:
-        void SetInitPosition(Player player);
+        void SetInitPosition(const Player& player);
         float ttl;
     };
 
     std::list<Bullet> bullets;
 
-    Player(GameType argType, bool first);
+    // Ships of a match start apart from each other, index is the seat in a match of count
+    Player(GameType argType, uint32_t index, uint32_t count);
     
     // Info
     bool CanShoot() const;
     uint32_t GetLifes() const;
     uint64_t GetPoints() const;
+    float GetShotSpeed() const;
     Point GetSpeed() const;
     bool IsAlive() const;
+    bool IsThrusting() const;
 
     // Action
     void Accelerate(float dt);
     void AddPoints(uint64_t points);
-    void Move(float dt) override;
+    void Move(float dt, Point field) override;
     void Shoot();
     void UpdateTime(float dt);
 
+    // Bullets: their list nodes are kept for the next ones, so steady play does not allocate
+    Bullet& AddBullet(const Bullet& bullet);
+    void ClearBullets();
+    // Returns the bullet after it
+    std::list<Bullet>::iterator RemoveBullet(std::list<Bullet>::iterator bullet);
+
     // Reset    
     void Reset();
     void Collision();
 
-    void Draw(uint32_t buff[]) const override;
+    // Replication
+    void Replicate(Point argPosition, float argDir, Point argSpeed, uint32_t argLifes, uint64_t argPoints);
+
+    // Snapshot
+    void Load(SnapshotReader& reader);
+    void Save(SnapshotWriter& writer) const;
+
+    void Draw(const Canvas& canvas) const override;
 private:
     // Due to acceleration it is easier to store sped as x and y values,
     // not as speed and direction
     float invincibleTime, time;
-    uint32_t lifes;
+    uint32_t lifes, shots;
     uint64_t points;
     Point initPos, speed;
+    // Accelerated since the last UpdateTime, not part of the snapshot
+    bool thrust;
+    // Nodes of the bullets that are gone, new bullets and restores take them back
+    std::list<Bullet> spareBullets;
 
     void DecreaseTime(float& t, float dt);
     void SetSpeed(Point argSpeed);
 };
 
+// Asteroids keep their velocity until they touch another one, so instead of being moved
+// every tick they keep the straight line they are on: where and when it started and the
+// velocity along it. Their position is worked out, wrap included, only when it is asked for.
 class Asteroid : public GameObject {
 public:
     // Different colors for different Speed-type asteroids
@@ -135,50 +220,103 @@ public:
         BIG
     };
 
-    Asteroid(AsteroidSpeed argSpeed, AsteroidSize argSize);
-    Asteroid(const Asteroid& prev, bool type);
+    // Somewhere in the field away from the start of the ships, from argTime on
+    Asteroid(AsteroidSpeed argSpeed, AsteroidSize argSize, Point field, float argTime);
+    // Fragment of prev, which was hit at argTime
+    Asteroid(const Asteroid& prev, bool type, float argTime, Point field);
+    // Replica of an asteroid simulated elsewhere, at argPosition at argTime
+    Asteroid(AsteroidSpeed argSpeed, AsteroidSize argSize, Point argPosition, float argDir, float argTime);
 
     // Info
+    float GetMass() const;
+    // Where it is at time on the clock of its game
+    Point GetPosition(float time, Point field) const;
     AsteroidSpeed GetSpeedType() const;
     AsteroidSize GetSizeType() const;
-    //void RecalculateDirection(float dir, Point initSpeed, Point futureSpeed);
+    Point GetVelocity() const;
+
+    // Snapshot
+    void Load(SnapshotReader& reader);
+    void Save(SnapshotWriter& writer) const;
+
+    // Collision response, a new disc starts a new line at time
+    Disc<float> GetDisc(float time, Point field) const;
+    void SetDisc(const Disc<float>& disc, float time);
+
+    void Draw(const Canvas& canvas, float time, Point field) const;
 private:
     AsteroidSize sizeType;
     AsteroidSpeed speedType;
+    // The line it moves on starts at pos at startTime
+    float startTime;
+    Point velocity;
 
     // Set
     void SetInitColor(AsteroidSpeed argSpeed);
     void SetInitDirection();
-    void SetInitPosition();
+    void SetInitPosition(Point field);
     void SetInitSize(AsteroidSize argSize);
     void SetInitSpeed(AsteroidSpeed argSpeed);
+    void SetStart(Point argPosition, float argTime);
 };
 
+void ApplyPlayerInput(Player& player, uint8_t input, float dt);
+
 // Manager for the game that controls situation on the field
 class GameManager {
 public:
     std::vector<Player> players;
     std::vector<Asteroid> asteroids;
+    // Effects of the last simulated tick only, re-simulated ticks do not repeat theirs
+    std::vector<Effect> effects;
 
     GameManager();
 
     // Info
+    Point GetField() const;
+    uint32_t GetLevel() const;
     uint64_t GetMaxPoints() const;
     uint64_t GetPoints() const;
+    // Where an asteroid of this game is now
+    Point GetPosition(const Asteroid& asteroid) const;
     GameState GetState() const;
+    // Seconds simulated since the game started, the clock the asteroids move on
+    float GetTime() const;
     GameType GetType() const;
     bool HasBG() const;
     bool IsGameOver() const;
     bool IsLevelOver() const;
+    // Calls f(i) for every asteroid whose center lies within the box of half size reach
+    // around center, or near it, from the grid of the last update. The grid holds where
+    // the asteroids were when it was built, the box grows by how far they may have moved
+    // since. Asteroids added after it are tested one by one.
+    template <class F>
+    void QueryAsteroids(Point center, Point reach, F f) const;
 
     // Update game states
     void GameOver();
     void GameWin();
     void NextLevel();
+    // Size of the world the games started from now on wrap at, the screen unless set.
+    // It is kept within the screen and GAME_MAXFIELD.
+    void SetField(Point argField);
     void SetState(GameState argState);
     void StartGame(GameType argType);
+    void StartGame(GameType argType, uint32_t argSeed);
+    void StartGame(GameType argType, uint32_t argSeed, uint32_t playerCount);
     void StartLevel();
     void UpdateTimeGame(float dt);
+    // The updates keep the grid of the asteroids in step, after changing them from outside
+    // it has to be built again for QueryAsteroids
+    void BuildAsteroidGrid();
+
+    // Replication
+    void Replicate(GameState argState, GameType argType, uint64_t argPoints, uint64_t argMaxPoints);
+
+    // Snapshot: restoring reuses the existing objects and containers, so a manager
+    // that already holds a similar state does not allocate. On failure the state is unspecified.
+    bool LoadSnapshot(const uint8_t data[], size_t size);
+    void SaveSnapshot(std::vector<uint8_t>& data) const;
     
     void LoadDefaultBG(uint32_t buff[], std::string name);
 private:
@@ -187,6 +325,94 @@ private:
     GameType type;
     uint64_t maxPoints, points;
     bool hasBG;
-    uint32_t level;
+    uint32_t level, nextId, seed;
     float totaltime;
-};
\ No newline at end of file
+    Point field;
+    SpatialGrid asteroidGrid, playerGrid;
+    // Built at gridTime from gridPositions, when no asteroid was faster than gridSpeed.
+    // Contacts since then pushed every asteroid by its entry of gridPushes, gridPush at most.
+    // It holds the first gridCount asteroids of then, less the ones in gridRemoved since,
+    // by their index of then. The ones added since are looked at one by one.
+    float gridTime, gridSpeed, gridPush;
+    uint32_t gridCount;
+    std::vector<Point> gridPositions;
+    std::vector<float> gridPushes;
+    std::vector<uint32_t> gridRemoved;
+    // The next grid of a large world, built a part per tick from nextTime on while the
+    // other one is queried, the same way
+    SpatialGrid nextGrid;
+    bool nextBuilding;
+    float nextTime, nextSpeed, nextPush;
+    uint32_t nextCount, nextInserted;
+    std::vector<float> nextPushes;
+    std::vector<uint32_t> nextRemoved;
+    // Asteroids hit in the tick, in index order
+    std::vector<uint32_t> removed;
+
+    // Scratch of the parallel passes: a list per chunk, merged in chunk order
+    struct BulletRef {
+        uint32_t player;
+        std::list<Player::Bullet>::iterator bullet;
+    };
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> chunkPairs;
+    std::vector<uint64_t> chunkTests;
+    // Asteroids near a ship, the ones that can touch each other, in index order
+    std::vector<uint32_t> awake;
+    std::vector<BulletRef> bulletRefs;
+    std::vector<uint8_t> asteroidHit;
+    struct PlayerHit {
+        uint32_t shooter;
+        std::list<Player::Bullet>::iterator bullet;
+        uint32_t victim;
+    };
+    std::vector<uint32_t> playerSlots;
+    std::vector<PlayerHit> playerHits;
+    std::vector<uint8_t> playerHit;
+
+    void AddAsteroid(const Asteroid& asteroid);
+    void CollideAsteroids();
+    void CollideBullets();
+    void CollidePlayers();
+    float GetGridSlack() const;
+    bool IsEveryoneAwake() const;
+    bool ResolveContact(uint32_t a, uint32_t b);
+    void ResetGrids();
+    void StepAsteroidGrid(float dt);
+    void WakeAsteroids();
+};
+
+template <class F>
+void GameManager::QueryAsteroids(Point center, Point reach, F f) const {
+    float slack = GetGridSlack();
+    asteroidGrid.QueryBox(center.x, center.y, reach.x + slack, reach.y + slack, [&](uint32_t i) {
+        if (gridRemoved.empty()) {
+            f(i);
+            return;
+        }
+        auto it = std::lower_bound(gridRemoved.begin(), gridRemoved.end(), i);
+        if (it == gridRemoved.end() || *it != i) {
+            f(i - static_cast<uint32_t>(it - gridRemoved.begin()));
+        }
+    });
+    for (uint32_t i = gridCount - static_cast<uint32_t>(gridRemoved.size()); i < asteroids.size(); i++) {
+        Point delta = ShortestDelta(center, GetPosition(asteroids[i]), field);
+        if (std::fabs(delta.x) <= reach.x && std::fabs(delta.y) <= reach.y) {
+            f(i);
+        }
+    }
+}
+
+// Choices a frame is composed with, the ones the player cycles through in the game
+struct RenderSettings {
+    // Index into the internal resolutions of the field
+    uint32_t preset;
+    bool stars;
+    // Full screen picture behind the menus, or null
+    const uint32_t* image;
+    bool canResume;
+    // Field rasterized in tiles, see Canvas
+    bool tiled;
+};
+
+// Renders the frame draw() presents for the game, without the overlay, into a full screen buffer
+void RenderFrame(uint32_t buff[], const GameManager& game, const ParticleSystem& particleSystem, const RenderSettings& settings, Point stars);
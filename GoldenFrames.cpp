@@ -0,0 +1,205 @@
+#include "GoldenFrames.h"
+#include "Arena.h"
+#include "BitmapFile.h"
+#include "Engine.h"
+#include "Game.h"
+#include "Hash.h"
+#include "Particles.h"
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+constexpr float GOLDENTICK = 1.0f / 60;
+constexpr uint32_t GOLDENMISMATCH = 0xFFFF00FF;
+
+static const char* STATE_NAMES[] = { "menu", "game", "pause", "gameover", "gamewin" };
+
+// Scripted session: a seeded game played with a fixed input pattern
+struct GoldenSession {
+    const char* name;
+    GameType type;
+    uint32_t seed;
+    RenderSettings settings;
+    // Renders the picture behind the menus into the settings
+    bool image;
+    // Side of a square world that scrolls under the camera, 0 keeps the screen
+    float world;
+};
+
+// Frame rendered at the end of a tick, shown in the given state
+struct GoldenCheckpoint {
+    uint32_t session;
+    uint32_t tick;
+    GameState state;
+};
+
+// Between them the sessions touch every part of RenderFrame: ships, bullets, asteroids and
+// particles at the native and the reduced resolutions in rows and in tiles, the starfield,
+// the picture, the pause dimming, the text of the HUD and of every screen, the arena
+// with its standings and an open world seen through the camera
+static const GoldenSession SESSIONS[] = {
+    { "single", GameType::SIGLEPLAYER, 11, { 0, true, nullptr, false, false }, false },
+    { "multi", GameType::MULTIPLAYER, 12, { 0, false, nullptr, false, true }, false },
+    { "filtered", GameType::MULTIPLAYER, 13, { 2, true, nullptr, false, true }, false },
+    { "blocky", GameType::SIGLEPLAYER, 14, { 3, true, nullptr, false, false }, false },
+    { "screens", GameType::SIGLEPLAYER, 15, { 0, true, nullptr, true, false }, true },
+    { "arena", GameType::ARENA, 16, { 0, true, nullptr, false, false }, false },
+    { "world", GameType::SIGLEPLAYER, 17, { 2, true, nullptr, false, false }, false, GAME_WORLDSIZE }
+};
+
+// Sorted by session and tick
+static const GoldenCheckpoint CHECKPOINTS[] = {
+    { 0, 0, GameState::GAME },
+    { 0, 120, GameState::GAME },
+    { 0, 600, GameState::GAME },
+    { 0, 600, GameState::PAUSE },
+    { 1, 60, GameState::GAME },
+    { 1, 300, GameState::GAME },
+    { 1, 900, GameState::GAME },
+    { 1, 900, GameState::GAMEOVER },
+    { 2, 60, GameState::GAME },
+    { 2, 300, GameState::GAME },
+    { 2, 300, GameState::PAUSE },
+    { 3, 240, GameState::GAME },
+    { 4, 0, GameState::MAINMENU },
+    { 4, 180, GameState::GAMEWIN },
+    { 4, 180, GameState::GAMEOVER },
+    { 5, 0, GameState::GAME },
+    { 5, 240, GameState::GAME },
+    { 5, 600, GameState::GAME },
+    { 6, 0, GameState::GAME },
+    { 6, 300, GameState::GAME },
+    { 6, 900, GameState::GAME }
+};
+
+// Ships turn, thrust and shoot in phases of half a second, the second one out of step
+static uint8_t ScriptedInput(uint32_t tick, uint32_t player) {
+    static const uint8_t PATTERN[] = { INPUT_UP, INPUT_LEFT | INPUT_SHOOT, INPUT_UP | INPUT_RIGHT, INPUT_SHOOT, 0, INPUT_RIGHT | INPUT_SHOOT };
+    return PATTERN[(tick / 30 + player * 2) % (sizeof(PATTERN) / sizeof(PATTERN[0]))];
+}
+
+// Gradient with a pattern, so a misplaced copy changes the hash
+static void MakeImage(std::vector<uint32_t>& pixels) {
+    pixels.resize(SCREEN_WIDTH * SCREEN_HEIGHT);
+    for (uint32_t y = 0; y < SCREEN_HEIGHT; y++) {
+        for (uint32_t x = 0; x < SCREEN_WIDTH; x++) {
+            pixels[y * SCREEN_WIDTH + x] = 0xFF000000 | (x * 255 / SCREEN_WIDTH) << 16 | (y * 255 / SCREEN_HEIGHT) << 8 | ((x ^ y) & 0xFF);
+        }
+    }
+    return;
+}
+
+static std::string GetFrameName(const GoldenCheckpoint& checkpoint) {
+    return std::string(SESSIONS[checkpoint.session].name) + "_" + std::to_string(checkpoint.tick) + "_" + STATE_NAMES[static_cast<int>(checkpoint.state)];
+}
+
+// Reference at a quarter of its brightness where the frame matches it, GOLDENMISMATCH where it does not
+static uint32_t Diff(const std::vector<uint32_t>& frame, const std::vector<uint32_t>& reference, std::vector<uint32_t>& diff) {
+    uint32_t count = 0;
+    diff.resize(frame.size());
+    for (size_t i = 0; i < frame.size(); i++) {
+        if (frame[i] == reference[i]) {
+            diff[i] = 0xFF000000 | (reference[i] >> 2 & 0x003F3F3F);
+        }
+        else {
+            diff[i] = GOLDENMISMATCH;
+            count++;
+        }
+    }
+    return count;
+}
+
+void RunGoldenFrames(const std::string& name, const std::string& reportName) {
+    // Golden lines are "<frame name> <hash>"
+    std::map<std::string, uint64_t> golden;
+    std::ifstream input(name);
+    std::string line;
+    while (std::getline(input, line)) {
+        std::istringstream fields(line);
+        std::string frameName;
+        uint64_t hash;
+        if (fields >> frameName >> std::hex >> hash) {
+            golden[frameName] = hash;
+        }
+    }
+    input.close();
+    bool recording = golden.empty();
+    std::ofstream output;
+    if (recording) {
+        output.open(name, std::ios::trunc);
+    }
+    std::ofstream report(reportName, std::ios::trunc);
+    // Frames are kept next to the golden file, named after it
+    std::string base = name.substr(0, name.rfind('.'));
+    std::vector<uint32_t> frame(SCREEN_WIDTH * SCREEN_HEIGHT), reference, diff, image;
+    MakeImage(image);
+    uint32_t passed = 0, failed = 0, missing = 0;
+    const GoldenCheckpoint* checkpoint = std::begin(CHECKPOINTS);
+    for (uint32_t i = 0; i < sizeof(SESSIONS) / sizeof(SESSIONS[0]); i++) {
+        const GoldenSession& session = SESSIONS[i];
+        RenderSettings settings = session.settings;
+        settings.image = session.image ? image.data() : nullptr;
+        GameManager game;
+        if (session.world > 0) {
+            game.SetField({ session.world, session.world });
+        }
+        game.StartGame(session.type, session.seed);
+        ParticleSystem particles;
+        for (uint32_t tick = 0; checkpoint != std::end(CHECKPOINTS) && checkpoint->session == i; tick++) {
+            for (; checkpoint != std::end(CHECKPOINTS) && checkpoint->session == i && checkpoint->tick == tick; checkpoint++) {
+                GameManager shown = game;
+                shown.SetState(checkpoint->state);
+                Point stars = { tick * 0.2f, tick * 0.1f };
+                RenderFrame(frame.data(), shown, particles, settings, stars);
+                frameArena.Reset();
+                std::string frameName = GetFrameName(*checkpoint);
+                std::string fileName = base + "_" + frameName;
+                uint64_t hash = HashWords(frame.data(), frame.size());
+                if (recording) {
+                    output << frameName << " " << std::hex << hash << std::dec << "\n";
+                    WriteBitmapFile(fileName + ".bmp", frame, SCREEN_WIDTH, SCREEN_HEIGHT);
+                    continue;
+                }
+                auto found = golden.find(frameName);
+                if (found == golden.end()) {
+                    report << frameName << " missing from " << name << "\n";
+                    missing++;
+                }
+                else if (found->second == hash) {
+                    passed++;
+                }
+                else {
+                    failed++;
+                    WriteBitmapFile(fileName + "_actual.bmp", frame, SCREEN_WIDTH, SCREEN_HEIGHT);
+                    report << frameName << " hash=" << std::hex << hash << " golden=" << found->second << std::dec;
+                    if (ReadBitmapFile(fileName + ".bmp", reference, SCREEN_WIDTH, SCREEN_HEIGHT)) {
+                        report << " pixels=" << Diff(frame, reference, diff);
+                        WriteBitmapFile(fileName + "_diff.bmp", diff, SCREEN_WIDTH, SCREEN_HEIGHT);
+                    }
+                    report << "\n";
+                }
+            }
+            // Stepped like act() does while the game runs
+            if (game.GetState() != GameState::GAME) {
+                continue;
+            }
+            for (uint32_t j = 0; j < game.players.size(); j++) {
+                if (game.players[j].IsAlive()) {
+                    ApplyPlayerInput(game.players[j], ScriptedInput(tick, j), GOLDENTICK);
+                }
+            }
+            game.UpdateTimeGame(GOLDENTICK);
+            particles.Emit(game.effects);
+            particles.Update(GOLDENTICK, game.GetField());
+        }
+    }
+    uint32_t total = sizeof(CHECKPOINTS) / sizeof(CHECKPOINTS[0]);
+    if (recording) {
+        report << "golden recorded=" << total << " into " << name << "\n";
+    }
+    else {
+        report << "golden frames=" << total << " passed=" << passed << " failed=" << failed << " missing=" << missing << "\n";
+    }
+    return;
+}
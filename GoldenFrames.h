@@ -0,0 +1,11 @@
+#pragma once
+#include <string>
+
+// Golden frame regression check of the renderer. A build with GOLDEN_FRAMES defined replays
+// scripted sessions from initialize(), renders them with RenderFrame at fixed ticks and
+// compares a hash of every frame with the golden file, then writes a report and quits.
+// Without a golden file it records one, together with the reference frames as bitmaps
+// next to it. A frame that differs is written next to its reference along with a diff
+// image. Hashes hold for one compiler and set of floating point flags, record them on the
+// configuration that checks them.
+void RunGoldenFrames(const std::string& name, const std::string& reportName);
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// FNV-1a folded a 32-bit word at a time, for checksums of frames and states that only have
+// to tell two runs apart
+constexpr uint64_t HASH_FNVBASIS = 1469598103934665603ull;
+constexpr uint64_t HASH_FNVPRIME = 1099511628211ull;
+
+inline uint64_t HashWord(uint64_t hash, uint32_t word) {
+    return (hash ^ word) * HASH_FNVPRIME;
+}
+
+inline uint64_t HashWords(const uint32_t data[], size_t count) {
+    uint64_t hash = HASH_FNVBASIS;
+    for (size_t i = 0; i < count; i++) {
+        hash = HashWord(hash, data[i]);
+    }
+    return hash;
+}
@@ -0,0 +1,278 @@
+#include "Input.h"
+#include "Engine.h"
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "Winmm.lib")
+#endif
+
+// Class InputSnapshot
+InputSnapshot::InputSnapshot() {
+    std::fill(std::begin(players), std::end(players), 0);
+    for (auto& x : held) {
+        std::fill(std::begin(x), std::end(x), 0.0f);
+    }
+    time = 0;
+    firstPress = 0;
+    return;
+}
+
+uint64_t InputSnapshot::GetTime() const {
+    return time;
+}
+
+bool InputSnapshot::IsDown(uint8_t key) const {
+    return down[key];
+}
+
+bool InputSnapshot::WasPressed(uint8_t key) const {
+    return pressed[key];
+}
+
+bool InputSnapshot::HasPress() const {
+    return pressed.any();
+}
+
+uint64_t InputSnapshot::GetFirstPress() const {
+    return firstPress;
+}
+
+uint8_t InputSnapshot::GetPlayerInput(uint32_t player) const {
+    return players[player];
+}
+
+float InputSnapshot::GetHeld(uint32_t player, InputAction action) const {
+    return held[player][static_cast<int>(action)];
+}
+
+// Class InputSystem
+// Public InputSystem
+InputSystem::InputSystem() : head(0), tail(0), running(false), focusVersion(0) {
+    epoch = std::chrono::steady_clock::now();
+    for (auto& layout : bindings) {
+        for (auto& player : layout) {
+            for (auto& action : player) {
+                std::fill(std::begin(action), std::end(action), 0);
+            }
+        }
+    }
+    const uint8_t ARROWS[] = { VK_LEFT, VK_RIGHT, VK_UP, VK_SPACE };
+    const uint8_t LETTERS[] = { 'A', 'D', 'W', 'G' };
+    for (int i = 0; i < static_cast<int>(InputAction::COUNT); i++) {
+        bindings[static_cast<int>(InputLayout::SHARED)][0][i][0] = ARROWS[i];
+        bindings[static_cast<int>(InputLayout::SHARED)][0][i][1] = LETTERS[i];
+        bindings[static_cast<int>(InputLayout::SPLIT)][0][i][0] = ARROWS[i];
+        bindings[static_cast<int>(InputLayout::SPLIT)][1][i][0] = LETTERS[i];
+    }
+    focused = false;
+    focusLayout = InputLayout::SHARED;
+    down.reset();
+    std::fill(std::begin(downSince), std::end(downSince), 0);
+    std::fill(std::begin(heldTime), std::end(heldTime), 0);
+    last = 0;
+    return;
+}
+
+InputSystem::~InputSystem() {
+    Stop();
+    return;
+}
+
+// Public InputSystem info
+uint64_t InputSystem::Now() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+bool InputSystem::IsRunning() const {
+    return running;
+}
+
+bool InputSystem::HasPending() const {
+    return head.load(std::memory_order_acquire) != tail.load(std::memory_order_relaxed);
+}
+
+// Public InputSystem bindings
+void InputSystem::Bind(InputLayout layout, uint32_t player, InputAction action, uint32_t slot, uint8_t key) {
+    bool restart = running;
+    Stop();
+    bindings[static_cast<int>(layout)][player][static_cast<int>(action)][slot] = key;
+    if (restart) {
+        Start();
+    }
+    return;
+}
+
+void InputSystem::Watch(uint8_t key) {
+    bool restart = running;
+    Stop();
+    watched.set(key);
+    if (restart) {
+        Start();
+    }
+    return;
+}
+
+void InputSystem::Focus(InputLayout layout, const std::bitset<INPUT_KEYS>& keys) {
+    if (focused && layout == focusLayout && keys == focusKeys) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(focusLock);
+        focused = true;
+        focusLayout = layout;
+        focusKeys = keys;
+    }
+    focusVersion.fetch_add(1, std::memory_order_release);
+    return;
+}
+
+// Public InputSystem producer
+void InputSystem::Start() {
+    if (running) {
+        return;
+    }
+    running = true;
+    poller = std::thread(&InputSystem::PollLoop, this);
+    return;
+}
+
+void InputSystem::Stop() {
+    if (!running) {
+        return;
+    }
+    running = false;
+    poller.join();
+    return;
+}
+
+bool InputSystem::Push(const InputEvent& event) {
+    uint32_t at = head.load(std::memory_order_relaxed);
+    if (at - tail.load(std::memory_order_acquire) == INPUT_QUEUESIZE) {
+        return false;
+    }
+    ring[at % INPUT_QUEUESIZE] = event;
+    head.store(at + 1, std::memory_order_release);
+    return true;
+}
+
+// Public InputSystem consumer
+const InputSnapshot& InputSystem::Consume(InputLayout layout, uint64_t now) {
+    uint64_t from = std::min(last, now);
+    snapshot.pressed.reset();
+    std::fill(std::begin(heldTime), std::end(heldTime), 0);
+    uint32_t at = tail.load(std::memory_order_relaxed);
+    uint32_t end = head.load(std::memory_order_acquire);
+    for (; at != end && ring[at % INPUT_QUEUESIZE].time <= now; at++) {
+        const InputEvent& event = ring[at % INPUT_QUEUESIZE];
+        if (event.down && !down[event.key]) {
+            snapshot.firstPress = snapshot.pressed.any() ? std::min(snapshot.firstPress, event.time) : event.time;
+            down.set(event.key);
+            snapshot.pressed.set(event.key);
+            downSince[event.key] = event.time;
+        }
+        else if (!event.down && down[event.key]) {
+            down.reset(event.key);
+            heldTime[event.key] += event.time - std::max(std::min(downSince[event.key], event.time), from);
+        }
+    }
+    tail.store(at, std::memory_order_release);
+    for (uint32_t key = 0; key < INPUT_KEYS; key++) {
+        if (down[key]) {
+            heldTime[key] += now - std::max(std::min(downSince[key], now), from);
+        }
+    }
+    snapshot.down = down;
+    snapshot.time = now;
+
+    float span = static_cast<float>(std::max<uint64_t>(now - from, 1));
+    const auto& players = bindings[static_cast<int>(layout)];
+    for (uint32_t player = 0; player < INPUT_PLAYERS; player++) {
+        snapshot.players[player] = 0;
+        for (int action = 0; action < static_cast<int>(InputAction::COUNT); action++) {
+            float held = 0;
+            bool active = false;
+            for (uint8_t key : players[player][action]) {
+                if (key) {
+                    active |= down[key] || snapshot.pressed[key];
+                    held = std::max(held, std::min(heldTime[key] / span, 1.0f));
+                }
+            }
+            // Too short to measure, or a tick without time in it: counts as held throughout
+            if (active && held == 0) {
+                held = 1;
+            }
+            snapshot.held[player][action] = held;
+            snapshot.players[player] |= active ? static_cast<uint8_t>(1 << action) : 0;
+        }
+    }
+    last = now;
+    return snapshot;
+}
+
+// Private InputSystem
+std::bitset<INPUT_KEYS> InputSystem::GetPolledKeys() {
+    std::lock_guard<std::mutex> guard(focusLock);
+    // Unfocused it reads the keys of every layout
+    std::bitset<INPUT_KEYS> keys = watched | focusKeys;
+    for (int layout = 0; layout < static_cast<int>(InputLayout::COUNT); layout++) {
+        if (focused && layout != static_cast<int>(focusLayout)) {
+            continue;
+        }
+        for (const auto& player : bindings[layout]) {
+            for (const auto& action : player) {
+                for (uint8_t key : action) {
+                    keys.set(key);
+                }
+            }
+        }
+    }
+    keys.reset(0);
+    return keys;
+}
+
+void InputSystem::PollLoop() {
+#ifdef _WIN32
+    // A sleep lasts at least a timer tick, 15.6 ms unless the resolution is raised
+    timeBeginPeriod(1);
+#endif
+    std::vector<uint8_t> keys;
+    keys.reserve(INPUT_KEYS);
+    std::bitset<INPUT_KEYS> state;
+    uint32_t version = focusVersion.load(std::memory_order_acquire) - 1;
+    while (running) {
+        uint32_t current = focusVersion.load(std::memory_order_acquire);
+        if (current != version) {
+            version = current;
+            std::bitset<INPUT_KEYS> polled = GetPolledKeys() | state;
+            keys.clear();
+            for (uint32_t key = 0; key < INPUT_KEYS; key++) {
+                if (polled[key]) {
+                    keys.push_back(static_cast<uint8_t>(key));
+                }
+            }
+        }
+        uint64_t now = Now();
+        for (uint8_t key : keys) {
+            bool pressed = is_key_pressed(key);
+            // A change that does not fit is seen again on the next poll
+            if (pressed != state[key] && Push({ now, key, pressed })) {
+                state.set(key, pressed);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(INPUT_POLLPERIOD));
+    }
+    // Released on stop, so the consumer does not keep keys down forever
+    for (uint8_t key : keys) {
+        if (state[key]) {
+            Push({ Now(), key, false });
+        }
+    }
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+    return;
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+// Input constants
+constexpr uint32_t INPUT_QUEUESIZE = 1024;
+constexpr uint32_t INPUT_KEYS = 256;
+constexpr uint32_t INPUT_PLAYERS = 2;
+constexpr uint32_t INPUT_KEYSPERACTION = 2;
+// Period of the key poller in microseconds
+constexpr uint32_t INPUT_POLLPERIOD = 1000;
+
+// What a player can do, bit i of the INPUT_* bits is action i
+enum class InputAction {
+    LEFT,
+    RIGHT,
+    UP,
+    SHOOT,
+    COUNT
+};
+
+// One player on both key sets, or the arrows and the letters for a player each
+enum class InputLayout {
+    SHARED,
+    SPLIT,
+    COUNT
+};
+
+struct InputEvent {
+    // Microseconds on the clock of the InputSystem
+    uint64_t time;
+    uint8_t key;
+    bool down;
+};
+
+// Keyboard as of one tick, read as often as needed without touching the platform
+class InputSnapshot {
+public:
+    InputSnapshot();
+
+    // Info
+    uint64_t GetTime() const;
+    bool IsDown(uint8_t key) const;
+    // Went down since the previous tick, even if it is up again already
+    bool WasPressed(uint8_t key) const;
+    bool HasPress() const;
+    // Time of the earliest of those presses
+    uint64_t GetFirstPress() const;
+    // INPUT_* bits of the player, a tap between two ticks counts as held
+    uint8_t GetPlayerInput(uint32_t player) const;
+    // Share of the tick the action was held, from 0 to 1
+    float GetHeld(uint32_t player, InputAction action) const;
+private:
+    friend class InputSystem;
+
+    std::bitset<INPUT_KEYS> down, pressed;
+    uint8_t players[INPUT_PLAYERS];
+    float held[INPUT_PLAYERS][static_cast<int>(InputAction::COUNT)];
+    uint64_t time, firstPress;
+};
+
+// A thread polls the watched and bound keys about every millisecond and queues every
+// change with its time, so the game reads the platform nowhere else, taps between ticks
+// are kept and a tick knows how long within it a key was held. Once focused it polls only
+// the keys the game reads in its current state. The queue is lock-free with a single
+// producer: the poller, or a headless driver pushing synthetic events while the poller is
+// stopped.
+class InputSystem {
+public:
+    InputSystem();
+    ~InputSystem();
+
+    // Info
+    uint64_t Now() const;
+    bool IsRunning() const;
+    // Events queued and not consumed yet
+    bool HasPending() const;
+
+    // Bindings, the poller is restarted to pick up new keys
+    void Bind(InputLayout layout, uint32_t player, InputAction action, uint32_t slot, uint8_t key);
+    // Polled in every state
+    void Watch(uint8_t key);
+    // Narrows the poller to the keys bound in the layout, the watched ones and these, from
+    // its next poll on without a restart. A key held then stays polled until it is released.
+    void Focus(InputLayout layout, const std::bitset<INPUT_KEYS>& keys);
+
+    // Producer
+    void Start();
+    void Stop();
+    bool Push(const InputEvent& event);
+
+    // Consumer: applies the events up to the given time, once per tick
+    const InputSnapshot& Consume(InputLayout layout, uint64_t now);
+private:
+    InputEvent ring[INPUT_QUEUESIZE];
+    std::atomic<uint32_t> head, tail;
+    std::atomic<bool> running;
+    std::thread poller;
+    std::chrono::steady_clock::time_point epoch;
+    uint8_t bindings[static_cast<int>(InputLayout::COUNT)][INPUT_PLAYERS][static_cast<int>(InputAction::COUNT)][INPUT_KEYSPERACTION];
+    std::bitset<INPUT_KEYS> watched;
+    // Written by the consumer under the lock, the poller rereads it when the version changes
+    std::mutex focusLock;
+    std::atomic<uint32_t> focusVersion;
+    bool focused;
+    InputLayout focusLayout;
+    std::bitset<INPUT_KEYS> focusKeys;
+
+    // Consumer state
+    std::bitset<INPUT_KEYS> down;
+    uint64_t downSince[INPUT_KEYS];
+    uint64_t heldTime[INPUT_KEYS];
+    uint64_t last;
+    InputSnapshot snapshot;
+
+    std::bitset<INPUT_KEYS> GetPolledKeys();
+    void PollLoop();
+};
@@ -0,0 +1,127 @@
+#include "Instrumentation.h"
+#include "Arena.h"
+#include "Game.h"
+#include <algorithm>
+
+Instrumentation instrumentation;
+
+// Plain enum, so it is usable from the allocation hooks before any constructor ran
+static thread_local Phase currentPhase = Phase::COUNT;
+
+static const char* PHASE_NAMES[] = { "INPUT", "UPDATE", "PHYSICS", "NETWORK", "DRAW" };
+static const char* COUNTER_NAMES[] = { "ASTEROIDS", "BULLETS", "PAIR TESTS", "CONTACTS", "NET SENT", "NET RECEIVED", "NET CLIENTS", "ROLLBACK TICKS", "CAPTURE BYTES", "PARTICLES", "DRAWN" };
+
+// Class Instrumentation
+// Public Instrumentation
+Instrumentation::Instrumentation() {
+    std::fill(std::begin(times), std::end(times), 0.0f);
+    std::fill(std::begin(lastTimes), std::end(lastTimes), 0.0f);
+    std::fill(std::begin(counts), std::end(counts), 0);
+    std::fill(std::begin(lastCounts), std::end(lastCounts), 0);
+    frameTime = 0;
+    overlay = false;
+    frameStart = std::chrono::steady_clock::now();
+    owner = std::this_thread::get_id();
+    return;
+}
+
+// Public Instrumentation info
+uint64_t Instrumentation::GetCount(Counter counter) const {
+    return lastCounts[static_cast<int>(counter)];
+}
+
+float Instrumentation::GetFrameTime() const {
+    return frameTime;
+}
+
+float Instrumentation::GetTime(Phase phase) const {
+    return lastTimes[static_cast<int>(phase)];
+}
+
+bool Instrumentation::IsOverlayVisible() const {
+    return overlay;
+}
+
+// Public Instrumentation update
+void Instrumentation::AddCount(Counter counter, uint64_t value) {
+    if (std::this_thread::get_id() != owner) {
+        return;
+    }
+    counts[static_cast<int>(counter)] += value;
+    return;
+}
+
+void Instrumentation::AddTime(Phase phase, float us) {
+    if (std::this_thread::get_id() != owner) {
+        return;
+    }
+    times[static_cast<int>(phase)] += us;
+    return;
+}
+
+void Instrumentation::BeginFrame() {
+    auto now = std::chrono::steady_clock::now();
+    frameTime = std::chrono::duration<float, std::micro>(now - frameStart).count();
+    frameStart = now;
+    std::copy(std::begin(times), std::end(times), std::begin(lastTimes));
+    std::copy(std::begin(counts), std::end(counts), std::begin(lastCounts));
+    std::fill(std::begin(times), std::end(times), 0.0f);
+    std::fill(std::begin(counts), std::end(counts), 0);
+    return;
+}
+
+void Instrumentation::SetCount(Counter counter, uint64_t value) {
+    if (std::this_thread::get_id() != owner) {
+        return;
+    }
+    counts[static_cast<int>(counter)] = value;
+    return;
+}
+
+void Instrumentation::ToggleOverlay() {
+    overlay = !overlay;
+    return;
+}
+
+void Instrumentation::Draw(uint32_t buff[]) const {
+    // There is no dot in the bitmap font, so times are shown in microseconds
+    uint32_t y = 120;
+    ArenaString text(frameArena);
+    text.assign("FRAME US: ");
+    text += std::to_string(static_cast<uint64_t>(frameTime)).c_str();
+    DrawString(buff, text.c_str(), 10, y, 2);
+    for (int i = 0; i < static_cast<int>(Phase::COUNT); i++) {
+        y += 20;
+        text.assign(PHASE_NAMES[i]);
+        text += " US: ";
+        text += std::to_string(static_cast<uint64_t>(lastTimes[i])).c_str();
+        DrawString(buff, text.c_str(), 10, y, 2);
+    }
+    for (int i = 0; i < static_cast<int>(Counter::COUNT); i++) {
+        y += 20;
+        text.assign(COUNTER_NAMES[i]);
+        text += ": ";
+        text += std::to_string(lastCounts[i]).c_str();
+        DrawString(buff, text.c_str(), 10, y, 2);
+    }
+    return;
+}
+
+// Class ScopedTimer
+ScopedTimer::ScopedTimer(Phase argPhase) {
+    phase = argPhase;
+    previous = currentPhase;
+    currentPhase = phase;
+    start = std::chrono::steady_clock::now();
+    return;
+}
+
+ScopedTimer::~ScopedTimer() {
+    instrumentation.AddTime(phase, std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count());
+    currentPhase = previous;
+    return;
+}
+
+Phase ScopedTimer::GetCurrent() {
+    return currentPhase;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <stdint.h>
+#include <chrono>
+#include <thread>
+
+// Parts of a frame that are timed separately
+enum class Phase {
+    INPUT,
+    UPDATE,
+    PHYSICS,
+    NETWORK,
+    DRAW,
+    COUNT
+};
+
+// Per-frame counters, reset at the start of every frame
+enum class Counter {
+    ASTEROIDS,
+    BULLETS,
+    PAIR_TESTS,
+    CONTACTS,
+    NET_SENT,
+    NET_RECEIVED,
+    NET_CLIENTS,
+    ROLLBACK_TICKS,
+    CAPTURE_BYTES,
+    PARTICLES,
+    // Asteroids handed to the rasterizer, fewer than there are once the world scrolls
+    DRAWN,
+    COUNT
+};
+
+// Collects phase times and counters of the current frame and keeps the ones of the
+// previous frame for the overlay. A frame starts in act() and ends with draw().
+// Only the thread that created it records, simulations stepped on other threads are ignored.
+class Instrumentation {
+public:
+    Instrumentation();
+
+    // Info
+    uint64_t GetCount(Counter counter) const;
+    float GetFrameTime() const;
+    float GetTime(Phase phase) const;
+    bool IsOverlayVisible() const;
+
+    // Update
+    void AddCount(Counter counter, uint64_t value);
+    void AddTime(Phase phase, float us);
+    void BeginFrame();
+    void SetCount(Counter counter, uint64_t value);
+    void ToggleOverlay();
+
+    void Draw(uint32_t buff[]) const;
+private:
+    std::chrono::steady_clock::time_point frameStart;
+    float times[static_cast<int>(Phase::COUNT)], lastTimes[static_cast<int>(Phase::COUNT)];
+    uint64_t counts[static_cast<int>(Counter::COUNT)], lastCounts[static_cast<int>(Counter::COUNT)];
+    float frameTime;
+    bool overlay;
+    std::thread::id owner;
+};
+
+// Adds the lifetime of the object to the given phase, which is the current phase of the
+// thread meanwhile
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Phase argPhase);
+    ~ScopedTimer();
+
+    // Innermost timed phase of the calling thread, Phase::COUNT outside all of them
+    static Phase GetCurrent();
+private:
+    Phase phase, previous;
+    std::chrono::steady_clock::time_point start;
+};
+
+extern Instrumentation instrumentation;
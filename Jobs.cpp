@@ -0,0 +1,136 @@
+#include "Jobs.h"
+#include <algorithm>
+
+// One thread is the caller, a worker for every other hardware thread
+JobSystem jobs(std::min(JOBS_MAXWORKERS, std::max(std::thread::hardware_concurrency(), 1u) - 1));
+
+// Set while a thread runs a chunk, a loop started from inside one runs inline
+static thread_local bool insideChunk = false;
+
+// Class JobSystem
+// Public JobSystem
+JobSystem::JobSystem(uint32_t workers) : pending(0) {
+    queueCount = 0;
+    generation = 0;
+    running = false;
+    SetWorkerCount(workers);
+    return;
+}
+
+JobSystem::~JobSystem() {
+    SetWorkerCount(0);
+    return;
+}
+
+uint32_t JobSystem::GetWorkerCount() const {
+    return static_cast<uint32_t>(threads.size());
+}
+
+void JobSystem::SetWorkerCount(uint32_t workers) {
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        running = false;
+    }
+    wake.notify_all();
+    for (auto& x : threads) {
+        x.join();
+    }
+    threads.clear();
+
+    workers = std::min(workers, JOBS_MAXWORKERS);
+    queueCount = workers + 1;
+    queues.reset(new Queue[queueCount]);
+    for (uint32_t i = 0; i < queueCount; i++) {
+        queues[i].head = 0;
+        queues[i].tail = 0;
+    }
+    running = true;
+    for (uint32_t i = 1; i < queueCount; i++) {
+        threads.emplace_back(&JobSystem::WorkerLoop, this, i);
+    }
+    return;
+}
+
+// Private JobSystem
+void JobSystem::Run(ChunkFunction run, void* body, uint32_t count, uint32_t grain) {
+    grain = std::max(grain, 1u);
+    uint32_t chunks = (count + grain - 1) / grain;
+    if (threads.empty() || chunks <= 1 || insideChunk) {
+        for (uint32_t begin = 0; begin < count; begin += grain) {
+            run(body, begin, std::min(begin + grain, count));
+        }
+        return;
+    }
+    pending.store(chunks, std::memory_order_relaxed);
+    // Round robin, so every thread starts on its own share before it has to steal
+    for (uint32_t k = 0; k < chunks; k++) {
+        Chunk chunk = { run, body, k * grain, std::min((k + 1) * grain, count) };
+        Queue& queue = queues[k % queueCount];
+        std::unique_lock<std::mutex> guard(queue.lock);
+        if (queue.tail - queue.head < JOBS_QUEUESIZE) {
+            queue.chunks[queue.tail++ % JOBS_QUEUESIZE] = chunk;
+            continue;
+        }
+        // Full, run it here; the order chunks run in never matters
+        guard.unlock();
+        insideChunk = true;
+        run(body, chunk.begin, chunk.end);
+        insideChunk = false;
+        pending.fetch_sub(1, std::memory_order_release);
+    }
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        generation++;
+    }
+    wake.notify_all();
+    while (pending.load(std::memory_order_acquire) > 0) {
+        if (!RunOne(0)) {
+            std::this_thread::yield();
+        }
+    }
+    return;
+}
+
+bool JobSystem::RunOne(uint32_t self) {
+    Chunk chunk;
+    bool found = false;
+    {
+        Queue& own = queues[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (own.tail != own.head) {
+            chunk = own.chunks[--own.tail % JOBS_QUEUESIZE];
+            found = true;
+        }
+    }
+    for (uint32_t i = 1; !found && i < queueCount; i++) {
+        Queue& victim = queues[(self + i) % queueCount];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (victim.tail != victim.head) {
+            chunk = victim.chunks[victim.head++ % JOBS_QUEUESIZE];
+            found = true;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+    insideChunk = true;
+    chunk.run(chunk.body, chunk.begin, chunk.end);
+    insideChunk = false;
+    pending.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+void JobSystem::WorkerLoop(uint32_t self) {
+    uint32_t seen = 0;
+    while (true) {
+        if (RunOne(self)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(sleepLock);
+        wake.wait(guard, [&]() { return !running || generation != seen; });
+        if (!running) {
+            return;
+        }
+        seen = generation;
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Jobs constants
+constexpr uint32_t JOBS_MAXWORKERS = 7;
+constexpr uint32_t JOBS_QUEUESIZE = 1024;
+
+// Work-stealing scheduler for data-parallel loops. Every thread owns a queue of chunks: it
+// takes from the back of its own and steals from the front of the others once it runs dry,
+// and the calling thread helps until its loop is done. Chunks depend only on the count and
+// the grain, never on the number of threads, so anything written per chunk and merged in
+// chunk order comes out the same on every machine.
+class JobSystem {
+public:
+    explicit JobSystem(uint32_t workers);
+    ~JobSystem();
+
+    uint32_t GetWorkerCount() const;
+    // Restarts with the given number of worker threads, 0 runs everything on the caller
+    void SetWorkerCount(uint32_t workers);
+
+    // Calls body(begin, end) for every chunk [k * grain, (k + 1) * grain) of [0, count)
+    // and returns once all of them are done. Called from inside a chunk it runs inline.
+    // Only one thread at a time may start loops.
+    template <class F>
+    void ParallelFor(uint32_t count, uint32_t grain, F body);
+private:
+    typedef void (*ChunkFunction)(void*, uint32_t, uint32_t);
+
+    struct Chunk {
+        ChunkFunction run;
+        void* body;
+        uint32_t begin, end;
+    };
+
+    // The caller owns queue 0, worker i owns queue i + 1
+    struct Queue {
+        std::mutex lock;
+        Chunk chunks[JOBS_QUEUESIZE];
+        uint32_t head, tail;
+    };
+
+    std::vector<std::thread> threads;
+    std::unique_ptr<Queue[]> queues;
+    uint32_t queueCount;
+    std::atomic<uint32_t> pending;
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    uint32_t generation;
+    bool running;
+
+    void Run(ChunkFunction run, void* body, uint32_t count, uint32_t grain);
+    bool RunOne(uint32_t self);
+    void WorkerLoop(uint32_t self);
+};
+
+extern JobSystem jobs;
+
+template <class F>
+void JobSystem::ParallelFor(uint32_t count, uint32_t grain, F body) {
+    ChunkFunction run = [](void* argBody, uint32_t begin, uint32_t end) {
+        (*static_cast<F*>(argBody))(begin, end);
+        return;
+    };
+    Run(run, &body, count, grain);
+    return;
+}
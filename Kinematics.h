@@ -0,0 +1,133 @@
+#pragma once
+#include "Scalar.h"
+
+// Movement and collision math of the simulation on any scalar type. The game runs it on
+// float, a lockstep or replay build can run the same code on Fixed.
+
+template <class T>
+struct Vec2 {
+    T x;
+    T y;
+};
+
+// Moving body as GameObject keeps it: position, speed along a heading, radius and mass
+template <class T>
+struct Disc {
+    Vec2<T> pos;
+    T speed, dir, size, mass;
+};
+
+enum class ContactResult {
+    NONE,
+    // Pushed apart, the velocities are unchanged because the pair separates already
+    SEPARATED,
+    BOUNCED
+};
+
+// Position moved by delta and wrapped into the field
+template <class T>
+Vec2<T> Translate(Vec2<T> pos, Vec2<T> delta, Vec2<T> field);
+template <class T>
+Vec2<T> Advance(Vec2<T> pos, T speed, T dir, T dt, Vec2<T> field);
+// Shortest vector from a to b on the wrapped field
+template <class T>
+Vec2<T> ShortestDelta(Vec2<T> a, Vec2<T> b, Vec2<T> field);
+// Length of that vector, on Fixed only for pairs near enough for its square to fit
+template <class T>
+T Distance(Vec2<T> a, Vec2<T> b, Vec2<T> field);
+template <class T>
+Vec2<T> ToVelocity(T speed, T dir);
+// Two overlapping discs are pushed apart by inverse mass and bounce elastically
+template <class T>
+ContactResult ResolveContact(Disc<T>& a, Disc<T>& b, Vec2<T> field);
+
+template <class T>
+Vec2<T> Translate(Vec2<T> pos, Vec2<T> delta, Vec2<T> field) {
+    typedef ScalarMath<T> M;
+    return { M::Wrap(pos.x + delta.x, field.x), M::Wrap(pos.y + delta.y, field.y) };
+}
+
+template <class T>
+Vec2<T> Advance(Vec2<T> pos, T speed, T dir, T dt, Vec2<T> field) {
+    typedef ScalarMath<T> M;
+    return Translate(pos, { speed * M::Cos(dir) * dt, speed * M::Sin(dir) * dt }, field);
+}
+
+template <class T>
+Vec2<T> ShortestDelta(Vec2<T> a, Vec2<T> b, Vec2<T> field) {
+    Vec2<T> delta = { b.x - a.x, b.y - a.y };
+    Vec2<T> half = { field.x / 2, field.y / 2 };
+    if (delta.x > half.x) {
+        delta.x -= field.x;
+    }
+    else if (delta.x < -half.x) {
+        delta.x += field.x;
+    }
+    if (delta.y > half.y) {
+        delta.y -= field.y;
+    }
+    else if (delta.y < -half.y) {
+        delta.y += field.y;
+    }
+    return delta;
+}
+
+template <class T>
+T Distance(Vec2<T> a, Vec2<T> b, Vec2<T> field) {
+    Vec2<T> delta = ShortestDelta(a, b, field);
+    return ScalarMath<T>::Length(delta.x, delta.y);
+}
+
+template <class T>
+Vec2<T> ToVelocity(T speed, T dir) {
+    typedef ScalarMath<T> M;
+    return { speed * M::Cos(dir), speed * M::Sin(dir) };
+}
+
+template <class T>
+ContactResult ResolveContact(Disc<T>& a, Disc<T>& b, Vec2<T> field) {
+    typedef ScalarMath<T> M;
+    Vec2<T> delta = ShortestDelta(a.pos, b.pos, field);
+    T minDist = a.size + b.size;
+    // Apart on one axis already, and the square of a far pair does not fit a Fixed
+    if (delta.x >= minDist || -delta.x >= minDist || delta.y >= minDist || -delta.y >= minDist) {
+        return ContactResult::NONE;
+    }
+    T dist2 = delta.x * delta.x + delta.y * delta.y;
+    if (dist2 >= minDist * minDist) {
+        return ContactResult::NONE;
+    }
+    Vec2<T> va = ToVelocity(a.speed, a.dir), vb = ToVelocity(b.speed, b.dir);
+    T dist = M::Sqrt(dist2);
+    const T EPSILON = M::FromFloat(1e-3f);
+    Vec2<T> n = { 1, 0 };
+    if (dist > EPSILON) {
+        n = { delta.x / dist, delta.y / dist };
+    }
+    else {
+        // Centers coincide right after a split: part them along their relative velocity
+        Vec2<T> rel = { vb.x - va.x, vb.y - va.y };
+        T len = M::Length(rel.x, rel.y);
+        if (len > EPSILON) {
+            n = { rel.x / len, rel.y / len };
+        }
+    }
+    T ma = a.mass, mb = b.mass;
+    // Push apart proportionally to the inverse mass so the pair does not stick
+    T overlap = minDist - dist;
+    a.pos = Translate(a.pos, { -n.x * overlap * mb / (ma + mb), -n.y * overlap * mb / (ma + mb) }, field);
+    b.pos = Translate(b.pos, { n.x * overlap * ma / (ma + mb), n.y * overlap * ma / (ma + mb) }, field);
+    // Elastic impulse along the normal, only while they are still approaching
+    T approach = (va.x - vb.x) * n.x + (va.y - vb.y) * n.y;
+    if (approach <= 0) {
+        return ContactResult::SEPARATED;
+    }
+    T impulse = T(2) * approach / (ma + mb);
+    Vec2<T> wa = { va.x - impulse * mb * n.x, va.y - impulse * mb * n.y };
+    Vec2<T> wb = { vb.x + impulse * ma * n.x, vb.y + impulse * ma * n.y };
+    a.speed = M::Length(wa.x, wa.y);
+    a.dir = M::Atan2(wa.y, wa.x);
+    b.speed = M::Length(wb.x, wb.y);
+    b.dir = M::Atan2(wb.y, wb.x);
+    return ContactResult::BOUNCED;
+}
@@ -0,0 +1,119 @@
+#include "Latency.h"
+#include "Arena.h"
+#include "Game.h"
+#include <algorithm>
+
+constexpr int LATENCY_TOTAL = static_cast<int>(LatencyStage::COUNT);
+
+static const char* STAGE_NAMES[] = { "SIMULATE", "RASTER", "PRESENT" };
+
+// Class LatencyTracer
+// Public LatencyTracer
+LatencyTracer::LatencyTracer() {
+    std::fill(std::begin(trace), std::end(trace), 0);
+    reached = 0;
+    count = 0;
+    // Full size from the start, so tracing never allocates inside a frame
+    for (int i = 0; i <= LATENCY_TOTAL; i++) {
+        samples[i].reserve(LATENCY_SAMPLES);
+        sorted[i].reserve(LATENCY_SAMPLES);
+    }
+    return;
+}
+
+// Public LatencyTracer info
+uint32_t LatencyTracer::GetCount() const {
+    return count;
+}
+
+uint64_t LatencyTracer::GetPercentile(float percent) const {
+    return Percentile(sorted[LATENCY_TOTAL], percent);
+}
+
+uint64_t LatencyTracer::GetPercentile(LatencyStage stage, float percent) const {
+    return Percentile(sorted[static_cast<int>(stage)], percent);
+}
+
+void LatencyTracer::Draw(uint32_t buff[], uint32_t x, uint32_t y) const {
+    ArenaString text(frameArena);
+    text.assign("INPUT TO PHOTON: ");
+    text += std::to_string(count).c_str();
+    DrawString(buff, text.c_str(), x, y, 2);
+    for (int percent : { 50, 90, 99 }) {
+        y += 20;
+        text.assign("P");
+        text += std::to_string(percent).c_str();
+        text += " US: ";
+        text += std::to_string(GetPercentile(static_cast<float>(percent))).c_str();
+        DrawString(buff, text.c_str(), x, y, 2);
+    }
+    for (int i = 0; i < LATENCY_TOTAL; i++) {
+        y += 20;
+        text.assign(STAGE_NAMES[i]);
+        text += " P50 US: ";
+        text += std::to_string(GetPercentile(static_cast<LatencyStage>(i), 50)).c_str();
+        DrawString(buff, text.c_str(), x, y, 2);
+    }
+    return;
+}
+
+// Public LatencyTracer tracing
+void LatencyTracer::Input(uint64_t time) {
+    if (reached) {
+        return;
+    }
+    trace[0] = time;
+    reached = 1;
+    return;
+}
+
+void LatencyTracer::Mark(LatencyStage stage, uint64_t time) {
+    // Points are only taken in order, a present before the raster belongs to an older frame
+    uint32_t index = static_cast<uint32_t>(stage) + 1;
+    if (reached != index) {
+        return;
+    }
+    trace[index] = std::max(time, trace[index - 1]);
+    reached++;
+    if (stage != LatencyStage::PRESENT) {
+        return;
+    }
+    reached = 0;
+    uint32_t slot = count++ % LATENCY_SAMPLES;
+    for (int i = 0; i <= LATENCY_TOTAL; i++) {
+        uint64_t value = (i < LATENCY_TOTAL) ? trace[i + 1] - trace[i] : trace[LATENCY_TOTAL] - trace[0];
+        if (samples[i].size() < LATENCY_SAMPLES) {
+            samples[i].push_back(static_cast<uint32_t>(value));
+        }
+        else {
+            samples[i][slot] = static_cast<uint32_t>(value);
+        }
+        sorted[i] = samples[i];
+        std::sort(sorted[i].begin(), sorted[i].end());
+    }
+    if (log.is_open()) {
+        log << trace[0];
+        for (int i = 0; i <= LATENCY_TOTAL; i++) {
+            log << " " << samples[i][slot];
+        }
+        log << "\n";
+    }
+    return;
+}
+
+bool LatencyTracer::OpenLog(const std::string& name) {
+    log.open(name);
+    if (log.is_open()) {
+        log << "# input_us simulate_us raster_us present_us total_us\n";
+    }
+    return log.is_open();
+}
+
+// Private LatencyTracer
+uint64_t LatencyTracer::Percentile(const std::vector<uint32_t>& values, float percent) {
+    if (values.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(percent / 100 * (values.size() - 1) + 0.5f);
+    return values[std::min(index, values.size() - 1)];
+}
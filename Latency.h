@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Latency constants
+constexpr uint32_t LATENCY_SAMPLES = 256;
+
+// Points a traced input passes on its way to the screen
+enum class LatencyStage {
+    SIMULATE,
+    RASTER,
+    PRESENT,
+    COUNT
+};
+
+// Follows one input at a time from its event timestamp through the tick that applied it,
+// the end of the frame it changed and the present of that frame. Keeps the last samples
+// for percentiles and optionally appends every sample to a log. Times are microseconds
+// on one clock, the one of the InputSystem.
+class LatencyTracer {
+public:
+    LatencyTracer();
+
+    // Info
+    uint32_t GetCount() const;
+    // Of the whole path, or from the previous point up to the given stage
+    uint64_t GetPercentile(float percent) const;
+    uint64_t GetPercentile(LatencyStage stage, float percent) const;
+    void Draw(uint32_t buff[], uint32_t x, uint32_t y) const;
+
+    // Tracing
+    // An input first seen by the current tick; ignored while another one is on its way
+    void Input(uint64_t time);
+    void Mark(LatencyStage stage, uint64_t time);
+    bool OpenLog(const std::string& name);
+private:
+    // Input plus one time per stage, valid up to reached
+    uint64_t trace[static_cast<int>(LatencyStage::COUNT) + 1];
+    uint32_t reached;
+    // Per stage and the total last, newest overwriting the oldest
+    std::vector<uint32_t> samples[static_cast<int>(LatencyStage::COUNT) + 1];
+    std::vector<uint32_t> sorted[static_cast<int>(LatencyStage::COUNT) + 1];
+    uint32_t count;
+    std::ofstream log;
+
+    static uint64_t Percentile(const std::vector<uint32_t>& values, float percent);
+};
@@ -0,0 +1,332 @@
+#include "Metrics.h"
+#include "Snapshot.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+MetricsRegistry metrics;
+
+static const char* TYPE_NAMES[] = { "counter", "gauge", "histogram" };
+static const char* HTTP_OK = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\nContent-Length: ";
+static const char* HTTP_NOTFOUND = "HTTP/1.0 404 Not Found\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+constexpr uint32_t HTTP_MAXREQUEST = 2048;
+
+// Formatting, into text without going through a stream
+static void AppendNumber(std::string& text, double value) {
+    char number[32];
+    // Exact for integers up to 2^53, which covers every counter
+    std::snprintf(number, sizeof(number), "%.15g", value);
+    text += number;
+    return;
+}
+
+static void AppendSample(std::string& text, const char* name, const char* suffix, const char* labels, const char* le, double value) {
+    text += name;
+    text += suffix;
+    if (labels || le) {
+        text += '{';
+        if (labels) {
+            text += labels;
+        }
+        if (labels && le) {
+            text += ',';
+        }
+        if (le) {
+            text += "le=\"";
+            text += le;
+            text += '"';
+        }
+        text += '}';
+    }
+    text += ' ';
+    AppendNumber(text, value);
+    text += '\n';
+    return;
+}
+
+// Class MetricsRegistry
+// Public MetricsRegistry
+MetricsRegistry::MetricsRegistry() {
+    count.store(0, std::memory_order_relaxed);
+    return;
+}
+
+// Public MetricsRegistry registration
+uint32_t MetricsRegistry::AddCounter(const char* name, const char* labels, const char* help) {
+    return Register(name, labels, help, MetricType::COUNTER);
+}
+
+uint32_t MetricsRegistry::AddGauge(const char* name, const char* labels, const char* help) {
+    return Register(name, labels, help, MetricType::GAUGE);
+}
+
+uint32_t MetricsRegistry::AddHistogram(const char* name, const char* labels, const char* help, const double bounds[], uint32_t count) {
+    uint32_t id = Register(name, labels, help, MetricType::HISTOGRAM);
+    if (id == METRICS_MAXSERIES) {
+        return id;
+    }
+    series[id].bucketCount = std::min(count, METRICS_MAXBUCKETS);
+    std::copy(bounds, bounds + series[id].bucketCount, series[id].bounds);
+    return id;
+}
+
+// Public MetricsRegistry update
+void MetricsRegistry::Add(uint32_t id, double value) {
+    if (id >= METRICS_MAXSERIES) {
+        return;
+    }
+    // No fetch_add on a double before C++20; the writer is usually alone, so it does not loop
+    double current = series[id].value.load(std::memory_order_relaxed);
+    while (!series[id].value.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {
+    }
+    return;
+}
+
+void MetricsRegistry::Set(uint32_t id, double value) {
+    if (id >= METRICS_MAXSERIES) {
+        return;
+    }
+    series[id].value.store(value, std::memory_order_relaxed);
+    return;
+}
+
+void MetricsRegistry::Observe(uint32_t id, double value) {
+    if (id >= METRICS_MAXSERIES) {
+        return;
+    }
+    Series& x = series[id];
+    uint32_t bucket = static_cast<uint32_t>(std::lower_bound(x.bounds, x.bounds + x.bucketCount, value) - x.bounds);
+    x.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    Add(id, value);
+    return;
+}
+
+// Public MetricsRegistry export
+void MetricsRegistry::Write(std::string& text) const {
+    text.clear();
+    uint32_t size = count.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < size; i++) {
+        const Series& x = series[i];
+        if (i == 0 || std::strcmp(series[i - 1].name, x.name) != 0) {
+            text += "# HELP ";
+            text += x.name;
+            text += ' ';
+            text += x.help;
+            text += "\n# TYPE ";
+            text += x.name;
+            text += ' ';
+            text += TYPE_NAMES[static_cast<int>(x.type)];
+            text += '\n';
+        }
+        if (x.type != MetricType::HISTOGRAM) {
+            AppendSample(text, x.name, "", x.labels, nullptr, x.value.load(std::memory_order_relaxed));
+            continue;
+        }
+        // Buckets are read one by one, a scrape during an update may be off by that update
+        uint64_t total = 0;
+        char le[32];
+        for (uint32_t j = 0; j <= x.bucketCount; j++) {
+            total += x.buckets[j].load(std::memory_order_relaxed);
+            if (j < x.bucketCount) {
+                std::snprintf(le, sizeof(le), "%g", x.bounds[j]);
+            }
+            AppendSample(text, x.name, "_bucket", x.labels, j < x.bucketCount ? le : "+Inf", static_cast<double>(total));
+        }
+        AppendSample(text, x.name, "_sum", x.labels, nullptr, x.value.load(std::memory_order_relaxed));
+        AppendSample(text, x.name, "_count", x.labels, nullptr, static_cast<double>(total));
+    }
+    return;
+}
+
+// Private MetricsRegistry
+uint32_t MetricsRegistry::Register(const char* name, const char* labels, const char* help, MetricType type) {
+    uint32_t id = count.load(std::memory_order_relaxed);
+    if (id == METRICS_MAXSERIES) {
+        return id;
+    }
+    Series& x = series[id];
+    x.name = name;
+    x.labels = labels;
+    x.help = help;
+    x.type = type;
+    x.bucketCount = 0;
+    x.value.store(0, std::memory_order_relaxed);
+    for (auto& bucket : x.buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    // Published only once filled in, an exporter may already be reading
+    count.store(id + 1, std::memory_order_release);
+    return id;
+}
+
+// Class MetricsExporter
+// Public MetricsExporter
+MetricsExporter::MetricsExporter() {
+    registry = nullptr;
+    running.store(false);
+    listener = -1;
+    period = METRICS_FILEPERIOD;
+    return;
+}
+
+MetricsExporter::~MetricsExporter() {
+    Stop();
+    return;
+}
+
+bool MetricsExporter::IsRunning() const {
+    return running.load();
+}
+
+bool MetricsExporter::StartHttp(const MetricsRegistry& argRegistry, uint16_t port) {
+    Stop();
+#ifdef _WIN32
+    static bool started = false;
+    if (!started) {
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+            return false;
+        }
+        started = true;
+    }
+#endif
+    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == INVALID_SOCKET) {
+        return false;
+    }
+#ifndef _WIN32
+    // A restarted game binds again while the old connections linger in TIME_WAIT
+    int reuse = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#endif
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(s, 4) != 0) {
+        closesocket(s);
+        return false;
+    }
+    listener = static_cast<intptr_t>(s);
+    registry = &argRegistry;
+    text.reserve(METRICS_TEXTSIZE);
+    running.store(true);
+    worker = std::thread(&MetricsExporter::ServeHttp, this);
+    return true;
+}
+
+bool MetricsExporter::StartFile(const MetricsRegistry& argRegistry, const std::string& argName, float argPeriod) {
+    Stop();
+    registry = &argRegistry;
+    name = argName;
+    period = argPeriod;
+    text.reserve(METRICS_TEXTSIZE);
+    running.store(true);
+    worker = std::thread(&MetricsExporter::ServeFile, this);
+    return true;
+}
+
+void MetricsExporter::Stop() {
+    running.store(false);
+    if (worker.joinable()) {
+        worker.join();
+    }
+    if (listener != -1) {
+        closesocket(static_cast<SOCKET>(listener));
+        listener = -1;
+    }
+    return;
+}
+
+// Private MetricsExporter
+void MetricsExporter::ServeHttp() {
+    SOCKET s = static_cast<SOCKET>(listener);
+    char request[HTTP_MAXREQUEST];
+    char header[128];
+    while (running.load()) {
+        // Waits in slices to notice Stop, accepting right away would block for good
+        fd_set ready;
+        FD_ZERO(&ready);
+        FD_SET(s, &ready);
+        timeval wait = { 0, static_cast<long>(METRICS_POLLMS * 1000) };
+        if (select(static_cast<int>(s) + 1, &ready, nullptr, nullptr, &wait) <= 0) {
+            continue;
+        }
+        SOCKET client = accept(s, nullptr, nullptr);
+        if (client == INVALID_SOCKET) {
+            continue;
+        }
+        // A scraper that connects and says nothing must not hold up the next one
+#ifdef _WIN32
+        DWORD timeout = METRICS_POLLMS;
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+#else
+        timeval timeout = { 0, static_cast<long>(METRICS_POLLMS * 1000) };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+        size_t size = 0;
+        while (size < sizeof(request) - 1) {
+            int received = recv(client, request + size, static_cast<int>(sizeof(request) - 1 - size), 0);
+            if (received <= 0) {
+                break;
+            }
+            size += received;
+            request[size] = 0;
+            if (std::strstr(request, "\r\n\r\n")) {
+                break;
+            }
+        }
+        request[size] = 0;
+        const char* response = HTTP_NOTFOUND;
+        size_t length = std::strlen(HTTP_NOTFOUND);
+        if (std::strncmp(request, "GET /metrics ", 13) == 0 || std::strncmp(request, "GET / ", 6) == 0) {
+            registry->Write(text);
+            int headerSize = std::snprintf(header, sizeof(header), "%s%u\r\n\r\n", HTTP_OK, static_cast<uint32_t>(text.size()));
+            send(client, header, headerSize, MSG_NOSIGNAL);
+            response = text.data();
+            length = text.size();
+        }
+        for (size_t sent = 0; sent < length;) {
+            int chunk = send(client, response + sent, static_cast<int>(length - sent), MSG_NOSIGNAL);
+            if (chunk <= 0) {
+                break;
+            }
+            sent += chunk;
+        }
+        closesocket(client);
+    }
+    return;
+}
+
+void MetricsExporter::ServeFile() {
+    auto next = std::chrono::steady_clock::now();
+    while (running.load()) {
+        if (std::chrono::steady_clock::now() < next) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(METRICS_POLLMS));
+            continue;
+        }
+        next += std::chrono::microseconds(static_cast<int64_t>(period * 1e6f));
+        registry->Write(text);
+        ReplaceFileContents(name, text.data(), text.size());
+    }
+    return;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+// Metrics constants
+constexpr uint32_t METRICS_MAXSERIES = 64;
+constexpr uint32_t METRICS_MAXBUCKETS = 12;
+// Prometheus' default port range for exporters
+constexpr uint16_t METRICS_PORT = 9464;
+constexpr float METRICS_FILEPERIOD = 5.0f;
+// Exporter threads look at the stop flag this often while waiting
+constexpr uint32_t METRICS_POLLMS = 100;
+// Exposition text is built in a buffer of this size reserved up front, so a scrape does
+// not allocate while the tracker counts a steady frame
+constexpr size_t METRICS_TEXTSIZE = 16 * 1024;
+
+enum class MetricType {
+    COUNTER,
+    GAUGE,
+    HISTOGRAM
+};
+
+// Fixed table of series that any thread updates without a lock and an exporter renders in
+// the Prometheus text format. Series are registered on one thread before an exporter starts
+// and never removed. Series of the same name with different labels are one family and have
+// to be registered one after another.
+class MetricsRegistry {
+public:
+    MetricsRegistry();
+
+    // Registration; labels are the inside of the braces, like phase="draw", or null.
+    // Returns the id to update, or METRICS_MAXSERIES when the table is full.
+    uint32_t AddCounter(const char* name, const char* labels, const char* help);
+    uint32_t AddGauge(const char* name, const char* labels, const char* help);
+    // Upper bounds in increasing order, +Inf is implied
+    uint32_t AddHistogram(const char* name, const char* labels, const char* help, const double bounds[], uint32_t count);
+
+    // Update
+    void Add(uint32_t id, double value);
+    void Set(uint32_t id, double value);
+    void Observe(uint32_t id, double value);
+
+    // Export
+    // Replaces the content of text with all series
+    void Write(std::string& text) const;
+private:
+    struct Series {
+        const char* name;
+        const char* labels;
+        const char* help;
+        MetricType type;
+        double bounds[METRICS_MAXBUCKETS];
+        uint32_t bucketCount;
+        // Value of a counter or gauge, sum of a histogram
+        std::atomic<double> value;
+        // Not cumulative, the last one counts the values above every bound
+        std::atomic<uint64_t> buckets[METRICS_MAXBUCKETS + 1];
+    };
+
+    Series series[METRICS_MAXSERIES];
+    std::atomic<uint32_t> count;
+
+    uint32_t Register(const char* name, const char* labels, const char* help, MetricType type);
+};
+
+// Serves a registry to scrapers on its own thread, either over HTTP on the loopback
+// interface or by rewriting a file for a node exporter's textfile collector. The game
+// thread only pays for the registry updates; rendering happens on a scrape.
+class MetricsExporter {
+public:
+    MetricsExporter();
+    ~MetricsExporter();
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    bool IsRunning() const;
+
+    // Answers GET /metrics on 127.0.0.1
+    bool StartHttp(const MetricsRegistry& argRegistry, uint16_t port);
+    // Written to a temporary next to it and moved over the old one in one step, so a reader
+    // always finds the file and never sees half of it
+    bool StartFile(const MetricsRegistry& argRegistry, const std::string& argName, float argPeriod);
+    void Stop();
+private:
+    const MetricsRegistry* registry;
+    std::thread worker;
+    std::atomic<bool> running;
+    intptr_t listener;
+    std::string name, text;
+    float period;
+
+    void ServeHttp();
+    void ServeFile();
+};
+
+extern MetricsRegistry metrics;
@@ -0,0 +1,1044 @@
+#include "Net.h"
+#include "Instrumentation.h"
+#include "Random.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef int socklen_t;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
+constexpr float FULLTURN = 2 * GAME_PI;
+
+// Packet types, the first byte of every datagram
+constexpr uint8_t PACKET_CONNECT = 1;
+constexpr uint8_t PACKET_ACCEPT = 2;
+constexpr uint8_t PACKET_INPUT = 3;
+constexpr uint8_t PACKET_SNAPSHOT = 4;
+constexpr uint8_t PACKET_DISCONNECT = 5;
+// Part of a snapshot: type, snapshot seq, index and count, then its share of the bytes
+constexpr uint8_t PACKET_FRAGMENT = 6;
+constexpr uint32_t FRAGMENT_HEADER = 7;
+constexpr uint32_t FRAGMENT_PAYLOAD = NET_MAXPACKET - FRAGMENT_HEADER;
+
+// Entity kind lives in the top bits of the id, so sorting by id groups the kinds
+constexpr uint32_t ENTITY_ASTEROID = 0u << 30;
+constexpr uint32_t ENTITY_PLAYER = 1u << 30;
+constexpr uint32_t ENTITY_BULLET = 2u << 30;
+constexpr uint32_t ENTITY_KIND = 3u << 30;
+constexpr uint32_t BULLET_OWNERSHIFT = 22;
+constexpr uint32_t BULLET_IDMASK = (1u << BULLET_OWNERSHIFT) - 1;
+
+// Fields present in a delta record
+constexpr uint8_t FIELD_X = 1;
+constexpr uint8_t FIELD_Y = 2;
+constexpr uint8_t FIELD_DIR = 4;
+constexpr uint8_t FIELD_VX = 8;
+constexpr uint8_t FIELD_VY = 16;
+constexpr uint8_t FIELD_INFO = 32;
+constexpr uint8_t FIELD_NEW = 64;
+
+// Inputs repeated in every input packet to survive losses
+constexpr uint32_t INPUT_REDUNDANCY = 8;
+constexpr float CONNECT_RETRY = 0.25f;
+
+// Quantization
+static uint16_t QuantizePosition(float v) {
+    return static_cast<uint16_t>(static_cast<int>(v * 32.0f) & 0xFFFF);
+}
+
+static float DequantizePosition(uint16_t v) {
+    return v / 32.0f;
+}
+
+static uint16_t QuantizeDirection(float dir) {
+    return static_cast<uint16_t>(static_cast<int>(std::floor(dir / FULLTURN * 65536.0f + 0.5f)) & 0xFFFF);
+}
+
+static float DequantizeDirection(uint16_t v) {
+    return v * FULLTURN / 65536.0f;
+}
+
+static int16_t QuantizeVelocity(float v) {
+    return static_cast<int16_t>(std::max(-32767.0f, std::min(32767.0f, v * 64.0f)));
+}
+
+static float DequantizeVelocity(int16_t v) {
+    return v / 64.0f;
+}
+
+// Serialization
+static void WriteU8(std::vector<uint8_t>& out, uint8_t value) {
+    out.push_back(value);
+}
+
+static void WriteU32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+static void WriteF32(std::vector<uint8_t>& out, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    WriteU32(out, bits);
+}
+
+// LEB128
+static void WriteVar(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static void WriteSigned(std::vector<uint8_t>& out, int32_t value) {
+    WriteVar(out, (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31));
+}
+
+// Bounds-checked reader, a truncated packet only clears the valid flag
+class ByteReader {
+public:
+    ByteReader(const uint8_t argData[], size_t argSize) {
+        data = argData;
+        size = argSize;
+        pos = 0;
+        valid = true;
+    }
+
+    bool IsValid() const {
+        return valid;
+    }
+
+    uint8_t U8() {
+        if (pos >= size) {
+            valid = false;
+            return 0;
+        }
+        return data[pos++];
+    }
+
+    uint32_t U32() {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++) {
+            value |= static_cast<uint32_t>(U8()) << (8 * i);
+        }
+        return value;
+    }
+
+    float F32() {
+        uint32_t bits = U32();
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    uint64_t Var() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte = U8();
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        valid = false;
+        return 0;
+    }
+
+    int32_t Signed() {
+        uint32_t value = static_cast<uint32_t>(Var());
+        return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+    }
+private:
+    const uint8_t* data;
+    size_t size, pos;
+    bool valid;
+};
+
+// Snapshots
+static NetEntity MakeEntity(uint32_t id, Point pos, float dir, Point velocity, uint8_t info) {
+    NetEntity entity;
+    entity.id = id;
+    entity.x = QuantizePosition(pos.x);
+    entity.y = QuantizePosition(pos.y);
+    entity.dir = QuantizeDirection(dir);
+    entity.vx = QuantizeVelocity(velocity.x);
+    entity.vy = QuantizeVelocity(velocity.y);
+    entity.info = info;
+    return entity;
+}
+
+static void Capture(const GameManager& game, float time, NetSnapshot& snapshot) {
+    snapshot.time = time;
+    snapshot.state = game.GetState();
+    snapshot.type = game.GetType();
+    snapshot.points = game.GetPoints();
+    snapshot.maxPoints = game.GetMaxPoints();
+    snapshot.playerPoints.clear();
+    snapshot.entities.clear();
+    for (const auto& x : game.asteroids) {
+        uint8_t info = static_cast<uint8_t>(static_cast<uint32_t>(x.GetSizeType()) | static_cast<uint32_t>(x.GetSpeedType()) << 2);
+        snapshot.entities.push_back(MakeEntity(ENTITY_ASTEROID | (x.GetId() & ~ENTITY_KIND), game.GetPosition(x), x.GetDirection(), x.GetVelocity(), info));
+    }
+    for (uint32_t i = 0; i < game.players.size(); i++) {
+        const Player& player = game.players[i];
+        snapshot.playerPoints.push_back(player.GetPoints());
+        uint8_t lifes = static_cast<uint8_t>(std::min<uint32_t>(player.GetLifes(), 255));
+        snapshot.entities.push_back(MakeEntity(ENTITY_PLAYER | i, player.GetPosition(), player.GetDirection(), player.GetSpeed(), lifes));
+        for (const auto& x : player.bullets) {
+            Point velocity = { x.GetSpeed() * cosf(x.GetDirection()), x.GetSpeed() * sinf(x.GetDirection()) };
+            uint32_t id = ENTITY_BULLET | i << BULLET_OWNERSHIFT | (x.GetId() & BULLET_IDMASK);
+            snapshot.entities.push_back(MakeEntity(id, x.GetPosition(), x.GetDirection(), velocity, static_cast<uint8_t>(i)));
+        }
+    }
+    std::sort(snapshot.entities.begin(), snapshot.entities.end(), [](const NetEntity& a, const NetEntity& b) {
+        return a.id < b.id;
+    });
+    return;
+}
+
+// Writes only the entities that differ from the baseline, field by field
+static void Encode(const NetSnapshot& snapshot, const NetSnapshot* base, uint32_t ackedInput, std::vector<uint8_t>& out) {
+    static const NetEntity zero = {};
+    out.clear();
+    WriteU8(out, PACKET_SNAPSHOT);
+    WriteU32(out, snapshot.seq);
+    WriteU32(out, base ? base->seq : 0);
+    WriteU32(out, ackedInput);
+    WriteF32(out, snapshot.time);
+    WriteU8(out, static_cast<uint8_t>(snapshot.state));
+    WriteU8(out, static_cast<uint8_t>(snapshot.type));
+    WriteVar(out, snapshot.points);
+    WriteVar(out, snapshot.maxPoints);
+    WriteVar(out, snapshot.playerPoints.size());
+    for (auto x : snapshot.playerPoints) {
+        WriteVar(out, x);
+    }
+
+    size_t countPos = out.size();
+    WriteU32(out, 0);
+    uint32_t changed = 0, prevId = 0;
+    size_t b = 0;
+    size_t baseSize = base ? base->entities.size() : 0;
+    for (const auto& e : snapshot.entities) {
+        while (b < baseSize && base->entities[b].id < e.id) {
+            b++;
+        }
+        bool found = b < baseSize && base->entities[b].id == e.id;
+        const NetEntity& from = found ? base->entities[b] : zero;
+        uint8_t mask = found ? 0 : FIELD_NEW;
+        mask |= (e.x != from.x) ? FIELD_X : 0;
+        mask |= (e.y != from.y) ? FIELD_Y : 0;
+        mask |= (e.dir != from.dir) ? FIELD_DIR : 0;
+        mask |= (e.vx != from.vx) ? FIELD_VX : 0;
+        mask |= (e.vy != from.vy) ? FIELD_VY : 0;
+        mask |= (e.info != from.info) ? FIELD_INFO : 0;
+        if (mask == 0) {
+            continue;
+        }
+        WriteVar(out, e.id - prevId);
+        prevId = e.id;
+        WriteU8(out, mask);
+        // Differences wrap in 16 bits, so small moves take one byte
+        if (mask & FIELD_X) {
+            WriteSigned(out, static_cast<int16_t>(e.x - from.x));
+        }
+        if (mask & FIELD_Y) {
+            WriteSigned(out, static_cast<int16_t>(e.y - from.y));
+        }
+        if (mask & FIELD_DIR) {
+            WriteSigned(out, static_cast<int16_t>(e.dir - from.dir));
+        }
+        if (mask & FIELD_VX) {
+            WriteSigned(out, e.vx - from.vx);
+        }
+        if (mask & FIELD_VY) {
+            WriteSigned(out, e.vy - from.vy);
+        }
+        if (mask & FIELD_INFO) {
+            WriteU8(out, e.info);
+        }
+        changed++;
+    }
+    for (int i = 0; i < 4; i++) {
+        out[countPos + i] = static_cast<uint8_t>(changed >> (8 * i));
+    }
+
+    // Entities of the baseline that are gone
+    countPos = out.size();
+    WriteU32(out, 0);
+    uint32_t removed = 0;
+    prevId = 0;
+    size_t s = 0;
+    for (size_t i = 0; i < baseSize; i++) {
+        uint32_t id = base->entities[i].id;
+        while (s < snapshot.entities.size() && snapshot.entities[s].id < id) {
+            s++;
+        }
+        if (s < snapshot.entities.size() && snapshot.entities[s].id == id) {
+            continue;
+        }
+        WriteVar(out, id - prevId);
+        prevId = id;
+        removed++;
+    }
+    for (int i = 0; i < 4; i++) {
+        out[countPos + i] = static_cast<uint8_t>(removed >> (8 * i));
+    }
+    return;
+}
+
+// Rebuilds a snapshot from its baseline in history, fails if the baseline is gone
+static bool Decode(const uint8_t data[], size_t size, const NetSnapshot history[], NetSnapshot& out, uint32_t& ackedInput) {
+    ByteReader reader(data, size);
+    if (reader.U8() != PACKET_SNAPSHOT) {
+        return false;
+    }
+    uint32_t seq = reader.U32();
+    uint32_t baseSeq = reader.U32();
+    ackedInput = reader.U32();
+    const NetSnapshot* base = nullptr;
+    if (baseSeq != 0) {
+        base = &history[baseSeq % NET_HISTORY];
+        if (base->seq != baseSeq || base == &out) {
+            return false;
+        }
+    }
+    out.seq = 0;
+    out.time = reader.F32();
+    out.state = static_cast<GameState>(reader.U8());
+    out.type = static_cast<GameType>(reader.U8());
+    out.points = reader.Var();
+    out.maxPoints = reader.Var();
+    uint64_t players = reader.Var();
+    if (!reader.IsValid() || players > 255) {
+        return false;
+    }
+    out.playerPoints.resize(static_cast<size_t>(players));
+    for (auto& x : out.playerPoints) {
+        x = reader.Var();
+    }
+
+    if (base) {
+        out.entities = base->entities;
+    }
+    else {
+        out.entities.clear();
+    }
+    size_t baseCount = out.entities.size();
+    uint32_t changed = reader.U32(), id = 0;
+    for (uint32_t i = 0; i < changed && reader.IsValid(); i++) {
+        id += static_cast<uint32_t>(reader.Var());
+        uint8_t mask = reader.U8();
+        NetEntity* e = nullptr;
+        if (mask & FIELD_NEW) {
+            out.entities.push_back(NetEntity());
+            e = &out.entities.back();
+            e->id = id;
+        }
+        else {
+            auto it = std::lower_bound(out.entities.begin(), out.entities.begin() + baseCount, id, [](const NetEntity& a, uint32_t b) {
+                return a.id < b;
+            });
+            if (it == out.entities.begin() + baseCount || it->id != id) {
+                return false;
+            }
+            e = &*it;
+        }
+        if (mask & FIELD_X) {
+            e->x = static_cast<uint16_t>(e->x + reader.Signed());
+        }
+        if (mask & FIELD_Y) {
+            e->y = static_cast<uint16_t>(e->y + reader.Signed());
+        }
+        if (mask & FIELD_DIR) {
+            e->dir = static_cast<uint16_t>(e->dir + reader.Signed());
+        }
+        if (mask & FIELD_VX) {
+            e->vx = static_cast<int16_t>(e->vx + reader.Signed());
+        }
+        if (mask & FIELD_VY) {
+            e->vy = static_cast<int16_t>(e->vy + reader.Signed());
+        }
+        if (mask & FIELD_INFO) {
+            e->info = reader.U8();
+        }
+    }
+
+    uint32_t removed = reader.U32();
+    id = 0;
+    for (uint32_t i = 0; i < removed && reader.IsValid(); i++) {
+        id += static_cast<uint32_t>(reader.Var());
+        auto it = std::lower_bound(out.entities.begin(), out.entities.begin() + baseCount, id, [](const NetEntity& a, uint32_t b) {
+            return a.id < b;
+        });
+        if (it != out.entities.begin() + baseCount && it->id == id) {
+            // Marked here and dropped below, erasing now would shift the sorted range
+            it->id = ENTITY_KIND;
+        }
+    }
+    if (!reader.IsValid()) {
+        return false;
+    }
+    out.entities.erase(std::remove_if(out.entities.begin(), out.entities.end(), [](const NetEntity& e) {
+        return e.id == ENTITY_KIND;
+    }), out.entities.end());
+    std::sort(out.entities.begin(), out.entities.end(), [](const NetEntity& a, const NetEntity& b) {
+        return a.id < b.id;
+    });
+    out.seq = seq;
+    return true;
+}
+
+bool operator==(const NetAddress& a, const NetAddress& b) {
+    return a.ip == b.ip && a.port == b.port;
+}
+
+// Class UdpSocket
+// Public UdpSocket
+UdpSocket::UdpSocket() {
+    handle = -1;
+    return;
+}
+
+UdpSocket::~UdpSocket() {
+    Close();
+    return;
+}
+
+bool UdpSocket::IsOpen() const {
+    return handle != -1;
+}
+
+bool UdpSocket::Open(uint16_t port) {
+    Close();
+#ifdef _WIN32
+    static bool started = false;
+    if (!started) {
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+            return false;
+        }
+        started = true;
+    }
+#endif
+    SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s == INVALID_SOCKET) {
+        return false;
+    }
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        closesocket(s);
+        return false;
+    }
+#ifdef _WIN32
+    u_long nonBlocking = 1;
+    ioctlsocket(s, FIONBIO, &nonBlocking);
+#else
+    fcntl(s, F_SETFL, O_NONBLOCK);
+#endif
+    handle = static_cast<intptr_t>(s);
+    return true;
+}
+
+void UdpSocket::Close() {
+    if (handle != -1) {
+        closesocket(static_cast<SOCKET>(handle));
+        handle = -1;
+    }
+    return;
+}
+
+bool UdpSocket::Send(const NetAddress& to, const uint8_t data[], size_t size) {
+    if (handle == -1) {
+        return false;
+    }
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(to.ip);
+    addr.sin_port = htons(to.port);
+    int sent = sendto(static_cast<SOCKET>(handle), reinterpret_cast<const char*>(data), static_cast<int>(size), 0,
+        reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    return sent == static_cast<int>(size);
+}
+
+int UdpSocket::Receive(NetAddress& from, uint8_t data[], size_t capacity) {
+    if (handle == -1) {
+        return -1;
+    }
+    sockaddr_in addr = {};
+    socklen_t addrSize = sizeof(addr);
+    int size = recvfrom(static_cast<SOCKET>(handle), reinterpret_cast<char*>(data), static_cast<int>(capacity), 0,
+        reinterpret_cast<sockaddr*>(&addr), &addrSize);
+    if (size < 0) {
+        return -1;
+    }
+    from.ip = ntohl(addr.sin_addr.s_addr);
+    from.port = ntohs(addr.sin_port);
+    return size;
+}
+
+// Class LinkConditioner
+// Public LinkConditioner
+LinkConditioner::LinkConditioner() {
+    Configure(0.0f, 0.0f, 0.0f);
+    seed = 2463534242u;
+    return;
+}
+
+float LinkConditioner::GetLatency() const {
+    return latency;
+}
+
+float LinkConditioner::GetLoss() const {
+    return loss;
+}
+
+void LinkConditioner::Configure(float argLatency, float argJitter, float argLoss) {
+    latency = argLatency;
+    jitter = argJitter;
+    loss = argLoss;
+    return;
+}
+
+void LinkConditioner::Flush(UdpSocket& socket, float now) {
+    // Jitter may deliver packets out of order, exactly like a real link
+    auto it = std::remove_if(queue.begin(), queue.end(), [&](const Packet& x) {
+        if (x.time > now) {
+            return false;
+        }
+        socket.Send(x.to, x.data.data(), x.data.size());
+        return true;
+    });
+    queue.erase(it, queue.end());
+    return;
+}
+
+void LinkConditioner::Send(UdpSocket& socket, const NetAddress& to, const std::vector<uint8_t>& data, float now) {
+    if (loss > 0 && Random() < loss) {
+        return;
+    }
+    if (latency <= 0 && jitter <= 0) {
+        socket.Send(to, data.data(), data.size());
+        return;
+    }
+    queue.push_back({ now + latency + jitter * Random(), to, data });
+    return;
+}
+
+// Private LinkConditioner
+float LinkConditioner::Random() {
+    return XorShiftUnit(seed);
+}
+
+// Class NetServer
+// Public NetServer
+NetServer::NetServer() {
+    for (auto& x : history) {
+        x.seq = 0;
+    }
+    traffic = {};
+    seq = 0;
+    maxPlayers = 0;
+    clock = 0;
+    return;
+}
+
+uint32_t NetServer::GetClientCount() const {
+    return static_cast<uint32_t>(clients.size());
+}
+
+LinkConditioner& NetServer::GetConditioner() {
+    return conditioner;
+}
+
+const NetTraffic& NetServer::GetTraffic() const {
+    return traffic;
+}
+
+bool NetServer::HasClient(uint32_t player) const {
+    return std::any_of(clients.begin(), clients.end(), [&](const Client& x) {
+        return x.player == player;
+    });
+}
+
+bool NetServer::IsRunning() const {
+    return socket.IsOpen();
+}
+
+bool NetServer::Start(uint16_t port, uint32_t argMaxPlayers) {
+    Stop();
+    maxPlayers = argMaxPlayers;
+    traffic = {};
+    return socket.Open(port);
+}
+
+void NetServer::Stop() {
+    for (const auto& x : clients) {
+        uint8_t bye = PACKET_DISCONNECT;
+        socket.Send(x.address, &bye, 1);
+    }
+    clients.clear();
+    socket.Close();
+    for (auto& x : history) {
+        x.seq = 0;
+    }
+    seq = 0;
+    return;
+}
+
+void NetServer::Receive(float dt) {
+    if (!IsRunning()) {
+        return;
+    }
+    ScopedTimer timer(Phase::NETWORK);
+    clock += dt;
+    packet.resize(NET_MAXPACKET);
+    NetAddress from;
+    int size;
+    while ((size = socket.Receive(from, packet.data(), packet.size())) > 0) {
+        instrumentation.AddCount(Counter::NET_RECEIVED, size);
+        auto client = std::find_if(clients.begin(), clients.end(), [&](const Client& x) {
+            return x.address == from;
+        });
+        ByteReader reader(packet.data(), size);
+        uint8_t type = reader.U8();
+        if (type == PACKET_CONNECT) {
+            if (client == clients.end()) {
+                // Player 0 is the host, remote players take the lowest free slot
+                uint32_t slot = 1;
+                while (std::any_of(clients.begin(), clients.end(), [&](const Client& x) { return x.player == slot; })) {
+                    slot++;
+                }
+                if (slot >= maxPlayers) {
+                    continue;
+                }
+                clients.push_back({ from, slot, 0, 0, 0, false, false, clock });
+                client = clients.end() - 1;
+            }
+            std::vector<uint8_t> accept = { PACKET_ACCEPT, static_cast<uint8_t>(client->player) };
+            conditioner.Send(socket, from, accept, clock);
+        }
+        else if (client == clients.end()) {
+            continue;
+        }
+        else if (type == PACKET_INPUT) {
+            uint32_t inputSeq = reader.U32();
+            uint32_t ack = reader.U32();
+            uint8_t count = reader.U8();
+            if (!reader.IsValid()) {
+                continue;
+            }
+            client->lastHeard = clock;
+            client->ackedSnapshot = std::max(client->ackedSnapshot, ack);
+            if (inputSeq <= client->inputSeq) {
+                continue;
+            }
+            // Inputs come newest first, the ones after inputSeq are new to us
+            uint32_t fresh = std::min<uint32_t>(count, inputSeq - client->inputSeq);
+            for (uint32_t i = 0; i < fresh; i++) {
+                uint8_t bits = reader.U8();
+                if (i == 0) {
+                    client->input = bits;
+                }
+                client->shoot |= (bits & INPUT_SHOOT) != 0;
+            }
+            client->inputSeq = inputSeq;
+            client->fresh = true;
+        }
+        else if (type == PACKET_DISCONNECT) {
+            clients.erase(client);
+        }
+    }
+    clients.erase(std::remove_if(clients.begin(), clients.end(), [&](const Client& x) {
+        return clock - x.lastHeard > NET_TIMEOUT;
+    }), clients.end());
+    conditioner.Flush(socket, clock);
+    return;
+}
+
+void NetServer::SubmitInputs(Rollback& rollback) {
+    ScopedTimer timer(Phase::NETWORK);
+    for (auto& x : clients) {
+        if (!x.fresh) {
+            continue;
+        }
+        const NetSnapshot& seen = history[x.ackedSnapshot % NET_HISTORY];
+        uint32_t tick = (x.ackedSnapshot != 0 && seen.seq == x.ackedSnapshot) ? seen.tick : rollback.GetTick();
+        tick = std::max(rollback.GetOldestTick(), std::min(tick, rollback.GetTick()));
+        // A tap between two ticks still fires
+        rollback.SetInput(tick, x.player, x.input | (x.shoot ? INPUT_SHOOT : 0));
+        x.shoot = false;
+        x.fresh = false;
+    }
+    return;
+}
+
+void NetServer::SendSnapshots(const GameManager& game, uint32_t tick) {
+    if (!IsRunning()) {
+        return;
+    }
+    ScopedTimer timer(Phase::NETWORK);
+    seq++;
+    NetSnapshot& snapshot = history[seq % NET_HISTORY];
+    Capture(game, clock, snapshot);
+    snapshot.seq = seq;
+    snapshot.tick = tick;
+    for (const auto& x : clients) {
+        const NetSnapshot* base = nullptr;
+        if (x.ackedSnapshot != 0 && seq - x.ackedSnapshot < NET_HISTORY && history[x.ackedSnapshot % NET_HISTORY].seq == x.ackedSnapshot) {
+            base = &history[x.ackedSnapshot % NET_HISTORY];
+        }
+        Encode(snapshot, base, x.inputSeq, packet);
+        if (packet.size() <= NET_MAXPACKET) {
+            conditioner.Send(socket, x.address, packet, clock);
+        }
+        else if (SendFragments(x.address)) {
+            traffic.fragmentedCount++;
+        }
+        else {
+            // The client keeps its baseline and gets a delta against it once the field thins out
+            traffic.droppedCount++;
+            continue;
+        }
+        instrumentation.AddCount(Counter::NET_SENT, packet.size());
+        if (base) {
+            traffic.deltaBytes += packet.size();
+            traffic.deltaCount++;
+        }
+        else {
+            traffic.fullBytes += packet.size();
+            traffic.fullCount++;
+        }
+    }
+    instrumentation.SetCount(Counter::NET_CLIENTS, clients.size());
+    conditioner.Flush(socket, clock);
+    return;
+}
+
+// Private NetServer
+bool NetServer::SendFragments(const NetAddress& to) {
+    uint32_t count = static_cast<uint32_t>((packet.size() + FRAGMENT_PAYLOAD - 1) / FRAGMENT_PAYLOAD);
+    if (count > NET_MAXFRAGMENTS) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        size_t begin = i * static_cast<size_t>(FRAGMENT_PAYLOAD);
+        size_t end = std::min(packet.size(), begin + FRAGMENT_PAYLOAD);
+        fragment.clear();
+        WriteU8(fragment, PACKET_FRAGMENT);
+        WriteU32(fragment, seq);
+        WriteU8(fragment, static_cast<uint8_t>(i));
+        WriteU8(fragment, static_cast<uint8_t>(count));
+        fragment.insert(fragment.end(), packet.begin() + begin, packet.begin() + end);
+        conditioner.Send(socket, to, fragment, clock);
+    }
+    return true;
+}
+
+// Class NetClient
+// Public NetClient
+NetClient::NetClient() {
+    for (auto& x : history) {
+        x.seq = 0;
+    }
+    server = { 0, 0 };
+    connected = false;
+    accepted = false;
+    player = 0;
+    inputSeq = 0;
+    latestSnapshot = 0;
+    assemblySeq = 0;
+    assemblyCount = 0;
+    assemblyMask = 0;
+    assemblySize = 0;
+    clock = 0;
+    lastHeard = 0;
+    lastConnect = 0;
+    renderTime = 0;
+    return;
+}
+
+LinkConditioner& NetClient::GetConditioner() {
+    return conditioner;
+}
+
+const GameManager& NetClient::GetView() const {
+    return view;
+}
+
+bool NetClient::IsConnected() const {
+    return connected;
+}
+
+bool NetClient::Connect(const NetAddress& argServer) {
+    Disconnect();
+    if (!socket.Open(0)) {
+        return false;
+    }
+    server = argServer;
+    view = GameManager();
+    view.Replicate(GameState::MAINMENU, GameType::MULTIPLAYER, 0, 0);
+    connected = true;
+    accepted = false;
+    clock = 0;
+    lastHeard = 0;
+    lastConnect = -CONNECT_RETRY;
+    return true;
+}
+
+void NetClient::Disconnect() {
+    if (connected) {
+        uint8_t bye = PACKET_DISCONNECT;
+        socket.Send(server, &bye, 1);
+    }
+    socket.Close();
+    connected = false;
+    accepted = false;
+    pending.clear();
+    for (auto& x : history) {
+        x.seq = 0;
+    }
+    inputSeq = 0;
+    latestSnapshot = 0;
+    assemblySeq = 0;
+    assemblyMask = 0;
+    return;
+}
+
+void NetClient::Update(float dt, uint8_t input) {
+    if (!connected) {
+        return;
+    }
+    ScopedTimer timer(Phase::NETWORK);
+    clock += dt;
+    packet.resize(NET_MAXPACKET);
+    NetAddress from;
+    int size;
+    while ((size = socket.Receive(from, packet.data(), packet.size())) > 0) {
+        instrumentation.AddCount(Counter::NET_RECEIVED, size);
+        if (!(from == server)) {
+            continue;
+        }
+        if (packet[0] == PACKET_ACCEPT && size >= 2 && !accepted) {
+            accepted = true;
+            player = packet[1];
+            lastHeard = clock;
+        }
+        else if (packet[0] == PACKET_SNAPSHOT && accepted) {
+            ReceiveSnapshot(packet.data(), size);
+        }
+        else if (packet[0] == PACKET_FRAGMENT && accepted) {
+            ReceiveFragment(packet.data(), size);
+        }
+        else if (packet[0] == PACKET_DISCONNECT) {
+            Disconnect();
+            return;
+        }
+    }
+
+    if (!accepted) {
+        if (clock - lastConnect >= CONNECT_RETRY) {
+            lastConnect = clock;
+            conditioner.Send(socket, server, { PACKET_CONNECT }, clock);
+        }
+    }
+    else {
+        // Own ship reacts at once, the server confirms it later
+        pending.push_back({ ++inputSeq, input, dt });
+        if (pending.size() > NET_HISTORY) {
+            pending.pop_front();
+        }
+        if (view.GetState() == GameState::GAME && player < view.players.size() && view.players[player].IsAlive()) {
+            ApplyPlayerInput(view.players[player], input & ~INPUT_SHOOT, dt);
+            view.players[player].Move(dt, view.GetField());
+        }
+        packet.clear();
+        WriteU8(packet, PACKET_INPUT);
+        WriteU32(packet, inputSeq);
+        WriteU32(packet, latestSnapshot);
+        uint8_t count = static_cast<uint8_t>(std::min<size_t>(INPUT_REDUNDANCY, pending.size()));
+        WriteU8(packet, count);
+        for (uint8_t i = 0; i < count; i++) {
+            WriteU8(packet, pending[pending.size() - 1 - i].bits);
+        }
+        conditioner.Send(socket, server, packet, clock);
+        instrumentation.AddCount(Counter::NET_SENT, packet.size());
+    }
+    conditioner.Flush(socket, clock);
+    UpdateView(dt);
+    if (clock - lastHeard > NET_TIMEOUT) {
+        Disconnect();
+    }
+    return;
+}
+
+// Private NetClient
+void NetClient::Predict(const NetSnapshot& snapshot, uint32_t ackedInput) {
+    auto it = std::lower_bound(snapshot.entities.begin(), snapshot.entities.end(), ENTITY_PLAYER | player, [](const NetEntity& a, uint32_t b) {
+        return a.id < b;
+    });
+    if (it == snapshot.entities.end() || it->id != (ENTITY_PLAYER | player) || player >= view.players.size()) {
+        return;
+    }
+    // Start from the server state and replay what the server has not seen yet
+    Player& own = view.players[player];
+    own.Replicate({ DequantizePosition(it->x), DequantizePosition(it->y) }, DequantizeDirection(it->dir),
+        { DequantizeVelocity(it->vx), DequantizeVelocity(it->vy) }, it->info, snapshot.playerPoints[player]);
+    while (!pending.empty() && pending.front().seq <= ackedInput) {
+        pending.pop_front();
+    }
+    if (snapshot.state == GameState::GAME && own.IsAlive()) {
+        for (const auto& x : pending) {
+            ApplyPlayerInput(own, x.bits & ~INPUT_SHOOT, x.dt);
+            own.Move(x.dt, view.GetField());
+        }
+    }
+    return;
+}
+
+// Fragments of a newer snapshot drop the one being put together, so a lost fragment
+// costs that snapshot only
+void NetClient::ReceiveFragment(const uint8_t data[], size_t size) {
+    ByteReader reader(data, size);
+    reader.U8();
+    uint32_t seq = reader.U32();
+    uint32_t index = reader.U8();
+    uint32_t count = reader.U8();
+    size_t payload = size - std::min<size_t>(size, FRAGMENT_HEADER);
+    // Only the last fragment may be short
+    if (!reader.IsValid() || count > NET_MAXFRAGMENTS || index >= count || payload > FRAGMENT_PAYLOAD ||
+        (index + 1 < count && payload != FRAGMENT_PAYLOAD) || seq <= latestSnapshot || seq < assemblySeq) {
+        return;
+    }
+    if (seq != assemblySeq) {
+        assemblySeq = seq;
+        assemblyCount = count;
+        assemblyMask = 0;
+        assembly.resize(count * static_cast<size_t>(FRAGMENT_PAYLOAD));
+    }
+    if (count != assemblyCount || (assemblyMask & (1u << index))) {
+        return;
+    }
+    std::copy(data + FRAGMENT_HEADER, data + size, assembly.begin() + index * static_cast<size_t>(FRAGMENT_PAYLOAD));
+    assemblyMask |= 1u << index;
+    if (index + 1 == count) {
+        assemblySize = index * static_cast<size_t>(FRAGMENT_PAYLOAD) + payload;
+    }
+    if (assemblyMask == (1u << count) - 1) {
+        ReceiveSnapshot(assembly.data(), assemblySize);
+    }
+    return;
+}
+
+void NetClient::ReceiveSnapshot(const uint8_t data[], size_t size) {
+    if (size < 5) {
+        return;
+    }
+    uint32_t seq = data[1] | data[2] << 8 | data[3] << 16 | static_cast<uint32_t>(data[4]) << 24;
+    if (seq <= latestSnapshot) {
+        return;
+    }
+    NetSnapshot& snapshot = history[seq % NET_HISTORY];
+    uint32_t ackedInput;
+    if (!Decode(data, size, history, snapshot, ackedInput)) {
+        snapshot.seq = 0;
+        return;
+    }
+    if (latestSnapshot == 0) {
+        renderTime = snapshot.time - NET_INTERPDELAY;
+    }
+    latestSnapshot = seq;
+    lastHeard = clock;
+    view.Replicate(snapshot.state, snapshot.type, snapshot.points, snapshot.maxPoints);
+    while (view.players.size() < snapshot.playerPoints.size()) {
+        view.players.push_back(Player(snapshot.type, static_cast<uint32_t>(view.players.size()), static_cast<uint32_t>(snapshot.playerPoints.size())));
+    }
+    if (view.players.size() > snapshot.playerPoints.size()) {
+        view.players.erase(view.players.begin() + snapshot.playerPoints.size(), view.players.end());
+    }
+    Predict(snapshot, ackedInput);
+    return;
+}
+
+void NetClient::UpdateView(float dt) {
+    if (latestSnapshot == 0) {
+        return;
+    }
+    const NetSnapshot& latest = history[latestSnapshot % NET_HISTORY];
+    renderTime += dt;
+    float target = latest.time - NET_INTERPDELAY;
+    if (std::fabs(renderTime - target) > 2.5f * NET_INTERPDELAY) {
+        // Resynchronize after a stall instead of fast-forwarding through it
+        renderTime = target;
+    }
+
+    // Pick the pair of snapshots around renderTime
+    const NetSnapshot* from = &latest;
+    const NetSnapshot* to = &latest;
+    for (uint32_t s = latestSnapshot; s > 0 && latestSnapshot - s < NET_HISTORY; s--) {
+        const NetSnapshot& x = history[s % NET_HISTORY];
+        if (x.seq != s) {
+            continue;
+        }
+        from = &x;
+        if (x.time <= renderTime) {
+            break;
+        }
+        to = &x;
+    }
+    float alpha = (to->time > from->time) ? (renderTime - from->time) / (to->time - from->time) : 1.0f;
+    alpha = std::max(0.0f, std::min(1.0f, alpha));
+
+    view.asteroids.clear();
+    for (auto& x : view.players) {
+        x.ClearBullets();
+    }
+    size_t f = 0;
+    for (const auto& e : to->entities) {
+        while (f < from->entities.size() && from->entities[f].id < e.id) {
+            f++;
+        }
+        const NetEntity& a = (f < from->entities.size() && from->entities[f].id == e.id) ? from->entities[f] : e;
+        Point pa = { DequantizePosition(a.x), DequantizePosition(a.y) };
+        Point field = view.GetField();
+        Point delta = ShortestDelta(pa, { DequantizePosition(e.x), DequantizePosition(e.y) }, field);
+        Point pos = { fmodf(pa.x + delta.x * alpha + field.x, field.x), fmodf(pa.y + delta.y * alpha + field.y, field.y) };
+        int turn = static_cast<int>(static_cast<int16_t>(e.dir - a.dir) * alpha);
+        float dir = DequantizeDirection(static_cast<uint16_t>((a.dir + turn) & 0xFFFF));
+        switch (e.id & ENTITY_KIND) {
+        case ENTITY_ASTEROID:
+            view.asteroids.push_back(Asteroid(static_cast<Asteroid::AsteroidSpeed>(e.info >> 2), static_cast<Asteroid::AsteroidSize>(e.info & 3), pos, dir, view.GetTime()));
+            break;
+        case ENTITY_PLAYER:
+            if ((e.id & ~ENTITY_KIND) != player && (e.id & ~ENTITY_KIND) < view.players.size()) {
+                uint32_t i = e.id & ~ENTITY_KIND;
+                view.players[i].Replicate(pos, dir, { DequantizeVelocity(e.vx), DequantizeVelocity(e.vy) }, e.info, latest.playerPoints[i]);
+            }
+            break;
+        case ENTITY_BULLET:
+            if (e.info < view.players.size()) {
+                view.players[e.info].AddBullet(Player::Bullet(pos, dir));
+            }
+            break;
+        }
+    }
+    return;
+}
@@ -0,0 +1,186 @@
+#pragma once
+#include "Game.h"
+#include "Rollback.h"
+#include <stdint.h>
+#include <vector>
+#include <deque>
+
+// Network constants
+constexpr uint16_t NET_PORT = 27015;
+constexpr uint32_t NET_LOCALHOST = 0x7F000001;
+// Snapshots kept on both sides as delta baselines
+constexpr uint32_t NET_HISTORY = 64;
+// Client renders remote entities this far in the past to always have two snapshots
+constexpr float NET_INTERPDELAY = 0.1f;
+constexpr float NET_TIMEOUT = 3.0f;
+// Largest datagram sent, a larger snapshot goes out in fragments of this size
+constexpr uint32_t NET_MAXPACKET = 65000;
+// Fragments of one snapshot at most, a larger one is not sent and counted as dropped
+constexpr uint32_t NET_MAXFRAGMENTS = 16;
+
+// IPv4 address and port in host byte order
+struct NetAddress {
+    uint32_t ip;
+    uint16_t port;
+};
+bool operator==(const NetAddress& a, const NetAddress& b);
+
+// Non-blocking UDP socket
+class UdpSocket {
+public:
+    UdpSocket();
+    ~UdpSocket();
+
+    bool IsOpen() const;
+
+    bool Open(uint16_t port);
+    void Close();
+    bool Send(const NetAddress& to, const uint8_t data[], size_t size);
+    // Returns the size of the received datagram or -1 if there is none
+    int Receive(NetAddress& from, uint8_t data[], size_t capacity);
+private:
+    intptr_t handle;
+};
+
+// Holds back and drops outgoing packets to emulate a bad link on localhost
+class LinkConditioner {
+public:
+    LinkConditioner();
+
+    float GetLatency() const;
+    float GetLoss() const;
+
+    void Configure(float argLatency, float argJitter, float argLoss);
+    void Flush(UdpSocket& socket, float now);
+    void Send(UdpSocket& socket, const NetAddress& to, const std::vector<uint8_t>& data, float now);
+private:
+    struct Packet {
+        float time;
+        NetAddress to;
+        std::vector<uint8_t> data;
+    };
+
+    std::vector<Packet> queue;
+    float latency, jitter, loss;
+    uint32_t seed;
+
+    float Random();
+};
+
+// Latency, jitter and loss presets of the conditioner, cycled with L in the game
+constexpr float NET_LINKPRESETS[][3] = { { 0.0f, 0.0f, 0.0f }, { 0.05f, 0.02f, 0.02f }, { 0.15f, 0.05f, 0.1f } };
+constexpr uint32_t NET_LINKPRESETCOUNT = sizeof(NET_LINKPRESETS) / sizeof(NET_LINKPRESETS[0]);
+
+// Quantized entity: position in 1/32 px, velocity in 1/64 px/s, direction in 1/65536 turn
+struct NetEntity {
+    uint32_t id;
+    uint16_t x, y, dir;
+    int16_t vx, vy;
+    uint8_t info;
+};
+
+struct NetSnapshot {
+    uint32_t seq;
+    // Rollback tick the server was at, not sent
+    uint32_t tick;
+    float time;
+    GameState state;
+    GameType type;
+    uint64_t points, maxPoints;
+    std::vector<uint64_t> playerPoints;
+    // Sorted by id
+    std::vector<NetEntity> entities;
+};
+
+// Snapshot bytes a server sent since it started. Full snapshots go to clients without a
+// usable baseline, joining ones or ones that fell too far behind.
+struct NetTraffic {
+    uint64_t fullBytes, deltaBytes;
+    uint32_t fullCount, deltaCount;
+    // Snapshots too large for one datagram, and too large for NET_MAXFRAGMENTS of them
+    uint32_t fragmentedCount, droppedCount;
+};
+
+// Authoritative side: runs the GameManager and sends every client a delta snapshot per tick
+class NetServer {
+public:
+    NetServer();
+
+    uint32_t GetClientCount() const;
+    LinkConditioner& GetConditioner();
+    const NetTraffic& GetTraffic() const;
+    // Player 0 is the host, any other slot may be taken by a client
+    bool HasClient(uint32_t player) const;
+    bool IsRunning() const;
+
+    bool Start(uint16_t port, uint32_t argMaxPlayers);
+    void Stop();
+    // Handles connects and input packets, call once per frame in every state
+    void Receive(float dt);
+    // Hands the latest remote inputs to the rollback at the tick each client was looking at,
+    // so a remote player's reaction is applied where it was meant. Call before Advance.
+    void SubmitInputs(Rollback& rollback);
+    // Captures the state after the tick and sends it delta compressed against each client's ack
+    void SendSnapshots(const GameManager& game, uint32_t tick);
+private:
+    struct Client {
+        NetAddress address;
+        uint32_t player;
+        uint32_t inputSeq;
+        uint32_t ackedSnapshot;
+        uint8_t input;
+        bool shoot, fresh;
+        float lastHeard;
+    };
+
+    UdpSocket socket;
+    LinkConditioner conditioner;
+    std::vector<Client> clients;
+    NetSnapshot history[NET_HISTORY];
+    NetTraffic traffic;
+    std::vector<uint8_t> packet, fragment;
+    uint32_t seq, maxPlayers;
+    float clock;
+
+    bool SendFragments(const NetAddress& to);
+};
+
+// Remote side: predicts its own ship and interpolates everything else
+class NetClient {
+public:
+    NetClient();
+
+    LinkConditioner& GetConditioner();
+    const GameManager& GetView() const;
+    bool IsConnected() const;
+
+    bool Connect(const NetAddress& server);
+    void Disconnect();
+    void Update(float dt, uint8_t input);
+private:
+    struct Input {
+        uint32_t seq;
+        uint8_t bits;
+        float dt;
+    };
+
+    UdpSocket socket;
+    LinkConditioner conditioner;
+    NetAddress server;
+    GameManager view;
+    NetSnapshot history[NET_HISTORY];
+    std::deque<Input> pending;
+    std::vector<uint8_t> packet;
+    // Snapshot being put together from its fragments, a bit per fragment received
+    std::vector<uint8_t> assembly;
+    uint32_t assemblySeq, assemblyCount, assemblyMask;
+    size_t assemblySize;
+    bool connected, accepted;
+    uint32_t player, inputSeq, latestSnapshot;
+    float clock, lastHeard, lastConnect, renderTime;
+
+    void Predict(const NetSnapshot& snapshot, uint32_t ackedInput);
+    void ReceiveFragment(const uint8_t data[], size_t size);
+    void ReceiveSnapshot(const uint8_t data[], size_t size);
+    void UpdateView(float dt);
+};
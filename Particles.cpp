@@ -0,0 +1,156 @@
+#include "Particles.h"
+#include "Compositor.h"
+#include "Random.h"
+#include <algorithm>
+#include <cmath>
+
+// Particles per effect and how long they glow
+constexpr uint32_t DEBRISPERSIZE = 2;
+constexpr float DEBRISLIFE = 1.2f;
+constexpr float DEBRISSPREAD = 60.0f;
+constexpr uint32_t EXPLOSIONCOUNT = 300;
+constexpr float EXPLOSIONLIFE = 1.5f;
+constexpr float EXPLOSIONSPREAD = 120.0f;
+constexpr uint32_t THRUSTCOUNT = 6;
+constexpr float THRUSTLIFE = 0.35f;
+constexpr float THRUSTSPREAD = 25.0f;
+constexpr float THRUSTSPEED = 90.0f;
+constexpr uint32_t THRUSTCOLOR = 0x00FFA040;
+
+// Class ParticleSystem
+// Public ParticleSystem
+ParticleSystem::ParticleSystem() {
+    x.resize(PARTICLE_CAPACITY);
+    y.resize(PARTICLE_CAPACITY);
+    vx.resize(PARTICLE_CAPACITY);
+    vy.resize(PARTICLE_CAPACITY);
+    life.resize(PARTICLE_CAPACITY);
+    fade.resize(PARTICLE_CAPACITY);
+    color.resize(PARTICLE_CAPACITY);
+    count = 0;
+    random = 0x9E3779B9;
+    return;
+}
+
+// Public ParticleSystem info
+uint32_t ParticleSystem::GetCount() const {
+    return count;
+}
+
+// Public ParticleSystem update
+void ParticleSystem::Clear() {
+    count = 0;
+    return;
+}
+
+void ParticleSystem::Emit(Point pos, Point speed, float spread, uint32_t number, float argLife, uint32_t argColor) {
+    number = std::min(number, PARTICLE_CAPACITY - count);
+    for (uint32_t i = count; i < count + number; i++) {
+        float angle = NextRandom() * 2 * GAME_PI;
+        float velocity = spread * (0.2f + 0.8f * NextRandom());
+        x[i] = pos.x;
+        y[i] = pos.y;
+        vx[i] = speed.x + velocity * cosf(angle);
+        vy[i] = speed.y + velocity * sinf(angle);
+        // Some die earlier so a burst thins out instead of vanishing at once
+        life[i] = argLife * (0.5f + 0.5f * NextRandom());
+        fade[i] = 1.0f / life[i];
+        // Additive light: alpha zero over premultiplied color channels
+        color[i] = argColor & 0x00FFFFFF;
+    }
+    count += number;
+    return;
+}
+
+void ParticleSystem::Emit(const std::vector<Effect>& effects) {
+    for (const auto& effect : effects) {
+        switch (effect.type) {
+        case EffectType::DEBRIS:
+            Emit(effect.pos, effect.speed, DEBRISSPREAD, DEBRISPERSIZE * static_cast<uint32_t>(effect.size), DEBRISLIFE, effect.color);
+            break;
+        case EffectType::EXPLOSION:
+            Emit(effect.pos, effect.speed, EXPLOSIONSPREAD, EXPLOSIONCOUNT / 2, EXPLOSIONLIFE, effect.color);
+            Emit(effect.pos, effect.speed, EXPLOSIONSPREAD / 2, EXPLOSIONCOUNT / 2, EXPLOSIONLIFE, 0x00FFFFFF);
+            break;
+        case EffectType::THRUST: {
+            // Out of the back of the ship
+            Point back = { -cosf(effect.dir), -sinf(effect.dir) };
+            Point pos = { effect.pos.x + back.x * effect.size * 0.6f, effect.pos.y + back.y * effect.size * 0.6f };
+            Point speed = { effect.speed.x + back.x * THRUSTSPEED, effect.speed.y + back.y * THRUSTSPEED };
+            Emit(pos, speed, THRUSTSPREAD, THRUSTCOUNT, THRUSTLIFE, THRUSTCOLOR);
+            break;
+        }
+        // Only heard
+        case EffectType::SHOT:
+            break;
+        }
+    }
+    return;
+}
+
+void ParticleSystem::Update(float dt, Point field) {
+    float* __restrict px = x.data();
+    float* __restrict py = y.data();
+    const float* __restrict pvx = vx.data();
+    const float* __restrict pvy = vy.data();
+    float* __restrict plife = life.data();
+    const float width = field.x, height = field.y;
+    for (uint32_t i = 0; i < count; i++) {
+        float nx = px[i] + pvx[i] * dt;
+        float ny = py[i] + pvy[i] * dt;
+        nx += (nx < 0) ? width : 0.0f;
+        nx -= (nx >= width) ? width : 0.0f;
+        ny += (ny < 0) ? height : 0.0f;
+        ny -= (ny >= height) ? height : 0.0f;
+        px[i] = nx;
+        py[i] = ny;
+        plife[i] -= dt;
+    }
+    // Compaction keeps the order, so older particles stay behind newer ones
+    uint32_t alive = 0;
+    while (alive < count && life[alive] > 0) {
+        alive++;
+    }
+    // Copies unconditionally and only advances past live ones, random deaths would defeat a branch
+    for (uint32_t i = alive; i < count; i++) {
+        x[alive] = x[i];
+        y[alive] = y[i];
+        vx[alive] = vx[i];
+        vy[alive] = vy[i];
+        life[alive] = life[i];
+        fade[alive] = fade[i];
+        color[alive] = color[i];
+        alive += (life[i] > 0) ? 1 : 0;
+    }
+    count = alive;
+    return;
+}
+
+void ParticleSystem::Draw(const Canvas& canvas) const {
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t px, py;
+        if (canvas.window) {
+            Point p = ToCanvas(canvas, { x[i], y[i] });
+            if (p.x < 0 || p.y < 0 || p.x >= canvas.width || p.y >= canvas.height) {
+                continue;
+            }
+            px = static_cast<uint32_t>(p.x);
+            py = static_cast<uint32_t>(p.y);
+        }
+        else {
+            // Rounding at the edge can land exactly on the size
+            px = std::min(static_cast<uint32_t>(x[i] * canvas.scale), static_cast<uint32_t>(canvas.width - 1));
+            py = std::min(static_cast<uint32_t>(y[i] * canvas.scale), static_cast<uint32_t>(canvas.height - 1));
+        }
+        // Red and blue scaled in one multiply, green in another
+        uint32_t scale = static_cast<uint32_t>(std::min(life[i] * fade[i], 1.0f) * 256);
+        uint32_t light = (((color[i] & 0x00FF00FF) * scale >> 8) & 0x00FF00FF) | (((color[i] & 0x0000FF00) * scale >> 8) & 0x0000FF00);
+        AddPixel(CanvasPixel(canvas, px, py), light);
+    }
+    return;
+}
+
+// Private ParticleSystem
+float ParticleSystem::NextRandom() {
+    return XorShiftUnit(random);
+}
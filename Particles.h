@@ -0,0 +1,38 @@
+#pragma once
+#include "Game.h"
+#include <stdint.h>
+#include <vector>
+
+// Particle constants
+constexpr uint32_t PARTICLE_CAPACITY = 1 << 17;
+
+// Points of light for debris, explosions and engine thrust. The particles live in fixed
+// arrays per field (structure of arrays) that are allocated once, so the update is a set of
+// plain loops the compiler vectorizes and dead particles are compacted in a single pass.
+// Purely visual: nothing feeds back into the game, so particles are neither replicated
+// nor part of a snapshot.
+class ParticleSystem {
+public:
+    ParticleSystem();
+
+    // Info
+    uint32_t GetCount() const;
+
+    // Update
+    void Clear();
+    // Spawns up to number particles at pos moving with speed plus a random velocity of up to spread
+    void Emit(Point pos, Point speed, float spread, uint32_t number, float argLife, uint32_t argColor);
+    void Emit(const std::vector<Effect>& effects);
+    // Moves the particles, wrapping them at the field of the game
+    void Update(float dt, Point field);
+
+    // Adds the light of every particle to the buffer, fading with its remaining life. A window
+    // only gets the particles it shows.
+    void Draw(const Canvas& canvas) const;
+private:
+    std::vector<float> x, y, vx, vy, life, fade;
+    std::vector<uint32_t> color;
+    uint32_t count, random;
+
+    float NextRandom();
+};
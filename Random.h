@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+
+// Repeatable noise for the effects, the link conditioner and the benchmarks. The game's
+// rand() is reserved for the deterministic level setup, these keep their own state.
+
+// xorshift32, the state must not start at zero
+inline uint32_t XorShift32(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// The top 24 bits of the next value as a float in [0, 1)
+inline float XorShiftUnit(uint32_t& state) {
+    return (XorShift32(state) >> 8) * (1.0f / 16777216);
+}
@@ -0,0 +1,109 @@
+#include "Rollback.h"
+#include <algorithm>
+#include <cstring>
+
+constexpr uint32_t NOTICK = UINT32_MAX;
+
+// Class Rollback
+// Public Rollback
+Rollback::Rollback() {
+    Reset();
+    return;
+}
+
+uint32_t Rollback::GetOldestTick() const {
+    return (tick > ROLLBACK_WINDOW) ? tick - ROLLBACK_WINDOW : 0;
+}
+
+uint32_t Rollback::GetTick() const {
+    return tick;
+}
+
+void Rollback::Reset() {
+    for (auto& x : frames) {
+        x.tick = NOTICK;
+    }
+    memset(next, 0, sizeof(next));
+    nextConfirmed = 0;
+    tick = 0;
+    dirtyTick = NOTICK;
+    return;
+}
+
+bool Rollback::SetInput(uint32_t argTick, uint32_t player, uint8_t input) {
+    if (player >= ROLLBACK_PLAYERS || argTick > tick || argTick < GetOldestTick()) {
+        return false;
+    }
+    uint64_t bit = 1ull << player;
+    if (argTick < tick) {
+        Frame& frame = frames[argTick % ROLLBACK_WINDOW];
+        if (frame.tick != argTick) {
+            return false;
+        }
+        frame.confirmed |= bit;
+        if (frame.inputs[player] != input) {
+            frame.inputs[player] = input;
+            dirtyTick = std::min(dirtyTick, argTick);
+        }
+        // Later ticks were predicted from this one
+        for (uint32_t t = argTick + 1; t < tick; t++) {
+            Frame& later = frames[t % ROLLBACK_WINDOW];
+            if (later.confirmed & bit) {
+                return true;
+            }
+            if (later.inputs[player] != input) {
+                later.inputs[player] = input;
+                dirtyTick = std::min(dirtyTick, t);
+            }
+        }
+    }
+    else {
+        nextConfirmed |= bit;
+    }
+    if (argTick == tick || !(nextConfirmed & bit)) {
+        next[player] = input;
+    }
+    return true;
+}
+
+uint32_t Rollback::Advance(GameManager& game, float dt) {
+    uint32_t resimulated = 0;
+    if (dirtyTick < tick) {
+        game.LoadSnapshot(frames[dirtyTick % ROLLBACK_WINDOW].state.data(), frames[dirtyTick % ROLLBACK_WINDOW].state.size());
+        for (uint32_t t = dirtyTick; t < tick; t++) {
+            Frame& frame = frames[t % ROLLBACK_WINDOW];
+            if (t != dirtyTick) {
+                game.SaveSnapshot(frame.state);
+            }
+            Simulate(game, frame);
+            resimulated++;
+        }
+    }
+    dirtyTick = NOTICK;
+
+    Frame& frame = frames[tick % ROLLBACK_WINDOW];
+    frame.tick = tick;
+    frame.dt = dt;
+    frame.confirmed = nextConfirmed;
+    memcpy(frame.inputs, next, sizeof(next));
+    game.SaveSnapshot(frame.state);
+    Simulate(game, frame);
+    tick++;
+    // The inputs stay in next as the prediction for the coming tick
+    nextConfirmed = 0;
+    return resimulated;
+}
+
+// Private Rollback
+void Rollback::Simulate(GameManager& game, const Frame& frame) const {
+    if (game.GetState() != GameState::GAME) {
+        return;
+    }
+    for (uint32_t i = 0; i < game.players.size() && i < ROLLBACK_PLAYERS; i++) {
+        if (game.players[i].IsAlive()) {
+            ApplyPlayerInput(game.players[i], frame.inputs[i], frame.dt);
+        }
+    }
+    game.UpdateTimeGame(frame.dt);
+    return;
+}
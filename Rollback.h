@@ -0,0 +1,43 @@
+#pragma once
+#include "Game.h"
+#include <stdint.h>
+#include <vector>
+
+// Rollback constants
+constexpr uint32_t ROLLBACK_WINDOW = 16;
+constexpr uint32_t ROLLBACK_PLAYERS = GAME_MAXPLAYERS;
+
+// Keeps the state before each of the last ROLLBACK_WINDOW ticks together with the inputs
+// used for it. An input that arrives late for a past tick rewinds the game to that tick and
+// re-simulates up to the present within the same frame. Unknown inputs are predicted by
+// repeating the last known input of the player.
+class Rollback {
+public:
+    Rollback();
+
+    uint32_t GetOldestTick() const;
+    uint32_t GetTick() const;
+
+    // Forgets the history, call whenever the game is changed from outside
+    void Reset();
+    // Returns false if the tick has already left the window or is in the future
+    bool SetInput(uint32_t argTick, uint32_t player, uint8_t input);
+    // Re-simulates the ticks whose inputs changed, then simulates tick GetTick().
+    // Returns the number of re-simulated ticks.
+    uint32_t Advance(GameManager& game, float dt);
+private:
+    struct Frame {
+        uint32_t tick;
+        float dt;
+        uint64_t confirmed;
+        uint8_t inputs[ROLLBACK_PLAYERS];
+        std::vector<uint8_t> state;
+    };
+
+    Frame frames[ROLLBACK_WINDOW];
+    uint8_t next[ROLLBACK_PLAYERS];
+    uint64_t nextConfirmed;
+    uint32_t tick, dirtyTick;
+
+    void Simulate(GameManager& game, const Frame& frame) const;
+};
@@ -0,0 +1,135 @@
+#include "Scalar.h"
+#include <cstdlib>
+
+// atan(2^-i) in Q2.30
+static const int64_t CORDIC_ANGLES[] = {
+    843314857, 497837829, 263043837, 133525159, 67021687, 33543516, 16775851, 8388437,
+    4194283, 2097149, 1048576, 524288, 262144, 131072, 65536, 32768,
+    16384, 8192, 4096, 2048, 1024, 512, 256, 128,
+    64, 32, 16, 8, 4, 2
+};
+constexpr int CORDIC_STEPS = sizeof(CORDIC_ANGLES) / sizeof(CORDIC_ANGLES[0]);
+// Inverse of the CORDIC gain, pi / 2 and pi in Q2.30, one turn per radian in Q0.32
+constexpr int64_t CORDIC_GAIN = 652032874;
+constexpr int64_t HALFPI = 1686629713;
+constexpr int64_t PI = 3373259426;
+constexpr int64_t TURNSPERRADIAN = 683565276;
+
+// Sine of a whole turn in Q16.16, one entry more so interpolation never wraps
+static int32_t sineTable[FIXED_TRIGSIZE + 1];
+
+// Rotates (gain, 0) by angle in [0, pi / 2], in Q2.30 and without a single float
+static int64_t CordicSine(int64_t angle) {
+    int64_t x = CORDIC_GAIN, y = 0;
+    for (int i = 0; i < CORDIC_STEPS; i++) {
+        int64_t dx = y >> i, dy = x >> i;
+        if (angle >= 0) {
+            x -= dx;
+            y += dy;
+            angle -= CORDIC_ANGLES[i];
+        }
+        else {
+            x += dx;
+            y -= dy;
+            angle += CORDIC_ANGLES[i];
+        }
+    }
+    return y;
+}
+
+static bool BuildSineTable() {
+    const uint32_t QUARTER = FIXED_TRIGSIZE / 4;
+    for (uint32_t i = 0; i <= QUARTER; i++) {
+        int32_t value = static_cast<int32_t>((CordicSine(HALFPI * i / QUARTER) + (1 << 13)) >> 14);
+        sineTable[i] = value;
+        sineTable[2 * QUARTER - i] = value;
+        sineTable[2 * QUARTER + i] = -value;
+        sineTable[(4 * QUARTER - i) % FIXED_TRIGSIZE] = -value;
+    }
+    sineTable[FIXED_TRIGSIZE] = sineTable[0];
+    return true;
+}
+
+// Bit by bit integer square root, rounded down
+static uint64_t RootOf(uint64_t value) {
+    uint64_t root = 0;
+    uint64_t bit = 1ull << 62;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+static bool sineTableBuilt = BuildSineTable();
+
+// Struct ScalarMath<Fixed>
+Fixed ScalarMath<Fixed>::Sin(Fixed angle) {
+    // Turns in Q0.32, the integer part falls off with the cast
+    uint32_t turns = static_cast<uint32_t>((static_cast<int64_t>(angle.GetRaw()) * TURNSPERRADIAN) >> 16);
+    uint32_t index = turns >> (32 - FIXED_TRIGBITS);
+    int64_t fraction = (turns >> (32 - FIXED_TRIGBITS - 16)) & 0xFFFF;
+    int32_t a = sineTable[index], b = sineTable[index + 1];
+    return Fixed::FromRaw(a + static_cast<int32_t>(((b - a) * fraction) >> 16));
+}
+
+Fixed ScalarMath<Fixed>::Cos(Fixed angle) {
+    return Sin(angle + Fixed::FromRaw(static_cast<int32_t>(HALFPI >> 14)));
+}
+
+Fixed ScalarMath<Fixed>::Sqrt(Fixed value) {
+    if (value.GetRaw() <= 0) {
+        return Fixed();
+    }
+    // The root of raw * 2^16 is the root in Q16.16
+    return Fixed::FromRaw(static_cast<int32_t>(RootOf(static_cast<uint64_t>(value.GetRaw()) << 16)));
+}
+
+Fixed ScalarMath<Fixed>::Length(Fixed x, Fixed y) {
+    // Squares of the raw values are Q32.32 and their root is Q16.16 again
+    uint64_t ax = static_cast<uint64_t>(std::abs(static_cast<int64_t>(x.GetRaw())));
+    uint64_t ay = static_cast<uint64_t>(std::abs(static_cast<int64_t>(y.GetRaw())));
+    return Fixed::FromRaw(static_cast<int32_t>(RootOf(ax * ax + ay * ay)));
+}
+
+Fixed ScalarMath<Fixed>::Atan2(Fixed y, Fixed x) {
+    int64_t vx = x.GetRaw(), vy = y.GetRaw();
+    if (vx == 0 && vy == 0) {
+        return Fixed();
+    }
+    // Into the right half-plane, where vectoring converges, remembering the half turn
+    int64_t angle = 0;
+    if (vx < 0) {
+        angle = (vy >= 0) ? PI : -PI;
+        vx = -vx;
+        vy = -vy;
+    }
+    // Scaled up so the shifted terms keep their bits for small vectors
+    while (vx < (1ll << 40) && vy < (1ll << 40) && vy > -(1ll << 40)) {
+        vx <<= 1;
+        vy <<= 1;
+    }
+    for (int i = 0; i < CORDIC_STEPS; i++) {
+        int64_t dx = vy >> i, dy = vx >> i;
+        if (vy > 0) {
+            vx += dx;
+            vy -= dy;
+            angle += CORDIC_ANGLES[i];
+        }
+        else {
+            vx -= dx;
+            vy += dy;
+            angle -= CORDIC_ANGLES[i];
+        }
+    }
+    return Fixed::FromRaw(static_cast<int32_t>((angle + (1 << 13)) >> 14));
+}
@@ -0,0 +1,228 @@
+#pragma once
+#include <stdint.h>
+#include <cmath>
+
+// Scalar constants
+constexpr int32_t FIXED_ONE = 1 << 16;
+// Entries of the sine table over one turn, a power of two
+constexpr uint32_t FIXED_TRIGBITS = 12;
+constexpr uint32_t FIXED_TRIGSIZE = 1 << FIXED_TRIGBITS;
+
+// Q16.16 fixed point: -32768 to 32768 with a step of 1/65536. Every operation is integer
+// arithmetic, so a simulation on it ends in the same bits on every compiler and CPU.
+// Products and quotients go through 64 bits, products round down and quotients toward zero.
+class Fixed {
+public:
+    Fixed();
+    Fixed(int value);
+    static Fixed FromRaw(int32_t value);
+    static Fixed FromFloat(float value);
+
+    // Info
+    int32_t GetRaw() const;
+    float ToFloat() const;
+
+    // Arithmetic
+    Fixed operator-() const;
+    Fixed operator+(Fixed x) const;
+    Fixed operator-(Fixed x) const;
+    Fixed operator*(Fixed x) const;
+    Fixed operator/(Fixed x) const;
+    Fixed& operator+=(Fixed x);
+    Fixed& operator-=(Fixed x);
+    Fixed& operator*=(Fixed x);
+    Fixed& operator/=(Fixed x);
+
+    // Comparison
+    bool operator==(Fixed x) const;
+    bool operator!=(Fixed x) const;
+    bool operator<(Fixed x) const;
+    bool operator>(Fixed x) const;
+    bool operator<=(Fixed x) const;
+    bool operator>=(Fixed x) const;
+private:
+    int32_t raw;
+};
+
+// The math the simulation needs, one specialization per scalar type. Every function of
+// the float one is the libm call the game always made, so code templated on the scalar
+// compiles to the same instructions as the float code it replaced.
+template <class T>
+struct ScalarMath;
+
+template <>
+struct ScalarMath<float> {
+    static float FromFloat(float value);
+    static float ToFloat(float value);
+    static int ToInt(float value);
+    static float Sin(float angle);
+    static float Cos(float angle);
+    static float Sqrt(float value);
+    static float Length(float x, float y);
+    static float Atan2(float y, float x);
+    // Into [0, size), also for values far outside
+    static float Wrap(float value, float size);
+};
+
+// Sine from a table with linear interpolation, atan2 and the square root on integers.
+// The table is built with integer CORDIC at startup, so it is the same everywhere too.
+template <>
+struct ScalarMath<Fixed> {
+    static Fixed FromFloat(float value);
+    static float ToFloat(Fixed value);
+    static int ToInt(Fixed value);
+    static Fixed Sin(Fixed angle);
+    static Fixed Cos(Fixed angle);
+    static Fixed Sqrt(Fixed value);
+    // Without squaring in Q16.16, which would overflow from a length of 181 on
+    static Fixed Length(Fixed x, Fixed y);
+    static Fixed Atan2(Fixed y, Fixed x);
+    static Fixed Wrap(Fixed value, Fixed size);
+};
+
+// Class Fixed
+inline Fixed::Fixed() : raw(0) {
+}
+
+inline Fixed::Fixed(int value) : raw(value * FIXED_ONE) {
+}
+
+inline Fixed Fixed::FromRaw(int32_t value) {
+    Fixed x;
+    x.raw = value;
+    return x;
+}
+
+inline Fixed Fixed::FromFloat(float value) {
+    return FromRaw(static_cast<int32_t>(std::floor(value * FIXED_ONE + 0.5f)));
+}
+
+inline int32_t Fixed::GetRaw() const {
+    return raw;
+}
+
+inline float Fixed::ToFloat() const {
+    return static_cast<float>(raw) / FIXED_ONE;
+}
+
+inline Fixed Fixed::operator-() const {
+    return FromRaw(-raw);
+}
+
+inline Fixed Fixed::operator+(Fixed x) const {
+    return FromRaw(raw + x.raw);
+}
+
+inline Fixed Fixed::operator-(Fixed x) const {
+    return FromRaw(raw - x.raw);
+}
+
+inline Fixed Fixed::operator*(Fixed x) const {
+    return FromRaw(static_cast<int32_t>((static_cast<int64_t>(raw) * x.raw) >> 16));
+}
+
+inline Fixed Fixed::operator/(Fixed x) const {
+    return FromRaw(static_cast<int32_t>(static_cast<int64_t>(raw) * FIXED_ONE / x.raw));
+}
+
+inline Fixed& Fixed::operator+=(Fixed x) {
+    return *this = *this + x;
+}
+
+inline Fixed& Fixed::operator-=(Fixed x) {
+    return *this = *this - x;
+}
+
+inline Fixed& Fixed::operator*=(Fixed x) {
+    return *this = *this * x;
+}
+
+inline Fixed& Fixed::operator/=(Fixed x) {
+    return *this = *this / x;
+}
+
+inline bool Fixed::operator==(Fixed x) const {
+    return raw == x.raw;
+}
+
+inline bool Fixed::operator!=(Fixed x) const {
+    return raw != x.raw;
+}
+
+inline bool Fixed::operator<(Fixed x) const {
+    return raw < x.raw;
+}
+
+inline bool Fixed::operator>(Fixed x) const {
+    return raw > x.raw;
+}
+
+inline bool Fixed::operator<=(Fixed x) const {
+    return raw <= x.raw;
+}
+
+inline bool Fixed::operator>=(Fixed x) const {
+    return raw >= x.raw;
+}
+
+// Struct ScalarMath<float>
+inline float ScalarMath<float>::FromFloat(float value) {
+    return value;
+}
+
+inline float ScalarMath<float>::ToFloat(float value) {
+    return value;
+}
+
+inline int ScalarMath<float>::ToInt(float value) {
+    return static_cast<int>(value);
+}
+
+inline float ScalarMath<float>::Sin(float angle) {
+    return sinf(angle);
+}
+
+inline float ScalarMath<float>::Cos(float angle) {
+    return cosf(angle);
+}
+
+inline float ScalarMath<float>::Sqrt(float value) {
+    return sqrtf(value);
+}
+
+inline float ScalarMath<float>::Length(float x, float y) {
+    return sqrtf(x * x + y * y);
+}
+
+inline float ScalarMath<float>::Atan2(float y, float x) {
+    return atan2f(y, x);
+}
+
+inline float ScalarMath<float>::Wrap(float value, float size) {
+    value = fmodf(value, size);
+    if (value < 0) {
+        value += size;
+    }
+    return value;
+}
+
+// Struct ScalarMath<Fixed>
+inline Fixed ScalarMath<Fixed>::FromFloat(float value) {
+    return Fixed::FromFloat(value);
+}
+
+inline float ScalarMath<Fixed>::ToFloat(Fixed value) {
+    return value.ToFloat();
+}
+
+inline int ScalarMath<Fixed>::ToInt(Fixed value) {
+    return value.GetRaw() / FIXED_ONE;
+}
+
+inline Fixed ScalarMath<Fixed>::Wrap(Fixed value, Fixed size) {
+    int32_t raw = value.GetRaw() % size.GetRaw();
+    if (raw < 0) {
+        raw += size.GetRaw();
+    }
+    return Fixed::FromRaw(raw);
+}
@@ -0,0 +1,102 @@
+#include "Snapshot.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+// Class SnapshotWriter
+// Public SnapshotWriter
+SnapshotWriter::SnapshotWriter(std::vector<uint8_t>& argData) : data(argData) {
+    // Work in the whole capacity and trim in Finish, growing one field at a time is slow
+    data.resize(std::max<size_t>(data.capacity(), 4096));
+    pos = 0;
+    Write(SnapshotHeader({ SNAPSHOT_MAGIC, SNAPSHOT_VERSION, 0, 0 }));
+    return;
+}
+
+// Stores the payload size in the header
+void SnapshotWriter::Finish() {
+    data.resize(pos);
+    uint32_t size = static_cast<uint32_t>(pos - sizeof(SnapshotHeader));
+    memcpy(data.data() + offsetof(SnapshotHeader, size), &size, sizeof(size));
+    return;
+}
+
+// Class SnapshotReader
+// Public SnapshotReader
+SnapshotReader::SnapshotReader(const uint8_t argData[], size_t argSize) {
+    data = argData;
+    size = argSize;
+    pos = 0;
+    valid = true;
+    SnapshotHeader header = Read<SnapshotHeader>();
+    valid = valid && header.magic == SNAPSHOT_MAGIC && header.version == SNAPSHOT_VERSION &&
+        header.size == size - sizeof(SnapshotHeader);
+    return;
+}
+
+bool SnapshotReader::IsValid() const {
+    return valid;
+}
+
+size_t SnapshotReader::GetRemaining() const {
+    return size - pos;
+}
+
+void SnapshotReader::Fail() {
+    valid = false;
+    return;
+}
+
+bool ReadSnapshotFile(const std::string& name, std::vector<uint8_t>& data) {
+    std::ifstream input(name, std::ios::binary);
+    if (!input.is_open()) {
+        return false;
+    }
+    input.seekg(0, std::ios::end);
+    std::streamoff size = input.tellg();
+    if (size < static_cast<std::streamoff>(sizeof(SnapshotHeader))) {
+        return false;
+    }
+    input.seekg(0, std::ios::beg);
+    data.resize(static_cast<size_t>(size));
+    input.read(reinterpret_cast<char*>(data.data()), size);
+    return input.good();
+}
+
+bool WriteSnapshotFile(const std::string& name, const std::vector<uint8_t>& data) {
+    return ReplaceFileContents(name, data.data(), data.size());
+}
+
+// Writes next to the target and moves it over the old file in one step, so a crash leaves
+// either the old file or the new one behind, never a torn one or none
+bool ReplaceFileContents(const std::string& name, const void* data, size_t size) {
+    std::string temp = name + ".tmp";
+    {
+        std::ofstream output(temp, std::ios::binary | std::ios::trunc);
+        if (!output.is_open()) {
+            return false;
+        }
+        output.write(static_cast<const char*>(data), size);
+        if (!output.good()) {
+            output.close();
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+#ifdef _WIN32
+    // rename does not replace an existing file on Windows
+    bool moved = MoveFileExA(temp.c_str(), name.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    bool moved = std::rename(temp.c_str(), name.c_str()) == 0;
+#endif
+    if (!moved) {
+        std::remove(temp.c_str());
+    }
+    return moved;
+}
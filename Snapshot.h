@@ -0,0 +1,79 @@
+#pragma once
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+// Binary snapshot of the whole game: a fixed header followed by the fields of every object
+// in native (little-endian) byte order. Bump the version whenever the field list changes.
+constexpr uint32_t SNAPSHOT_MAGIC = 0x52545341; // "ASTR"
+constexpr uint16_t SNAPSHOT_VERSION = 5;
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t size;
+};
+
+// Fills a byte vector, reusing its capacity so steady-state saves do not allocate
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(std::vector<uint8_t>& argData);
+
+    template <class T>
+    void Write(const T& value);
+    // Trims the vector to the written size, call once at the end
+    void Finish();
+private:
+    std::vector<uint8_t>& data;
+    size_t pos;
+};
+
+// Reads back what SnapshotWriter wrote, running past the end only clears the valid flag
+class SnapshotReader {
+public:
+    SnapshotReader(const uint8_t argData[], size_t argSize);
+
+    bool IsValid() const;
+    size_t GetRemaining() const;
+
+    // For sanity checks of the caller
+    void Fail();
+    template <class T>
+    T Read();
+private:
+    const uint8_t* data;
+    size_t size, pos;
+    bool valid;
+};
+
+bool ReadSnapshotFile(const std::string& name, std::vector<uint8_t>& data);
+bool WriteSnapshotFile(const std::string& name, const std::vector<uint8_t>& data);
+// Replaces the file with the bytes at once: a crash leaves the old contents or the new ones
+bool ReplaceFileContents(const std::string& name, const void* data, size_t size);
+
+template <class T>
+void SnapshotWriter::Write(const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "only plain values go into a snapshot");
+    if (data.size() - pos < sizeof(T)) {
+        data.resize(data.size() * 2);
+    }
+    memcpy(data.data() + pos, &value, sizeof(T));
+    pos += sizeof(T);
+    return;
+}
+
+template <class T>
+T SnapshotReader::Read() {
+    static_assert(std::is_trivially_copyable<T>::value, "only plain values come from a snapshot");
+    T value = {};
+    if (!valid || size - pos < sizeof(T)) {
+        valid = false;
+        return value;
+    }
+    memcpy(&value, data + pos, sizeof(T));
+    pos += sizeof(T);
+    return value;
+}
@@ -0,0 +1,121 @@
+#include "SpatialGrid.h"
+#include <cmath>
+
+// Class SpatialGrid
+// Public SpatialGrid
+SpatialGrid::SpatialGrid() {
+    Reset(1.0f, 1.0f, 1.0f);
+    return;
+}
+
+// Public SpatialGrid info
+uint32_t SpatialGrid::GetCellCount() const {
+    return static_cast<uint32_t>(cols * rows);
+}
+
+uint32_t SpatialGrid::GetItemCount() const {
+    return static_cast<uint32_t>(itemCell.size());
+}
+
+// Public SpatialGrid build
+void SpatialGrid::Reset(float argWidth, float argHeight, float minCellSize) {
+    width = argWidth;
+    height = argHeight;
+    cols = std::max(3, static_cast<int>(width / minCellSize));
+    rows = std::max(3, static_cast<int>(height / minCellSize));
+    cellWidth = width / cols;
+    cellHeight = height / rows;
+    // An empty grid, queries before the first Build see no items
+    cellStart.assign(static_cast<size_t>(cols) * rows + 1, 0);
+    itemCell.clear();
+    sorted.clear();
+    stage = BuildStage::DONE;
+    stageDone = 0;
+    return;
+}
+
+void SpatialGrid::Clear() {
+    // The cells are left for the sort to zero, once
+    itemCell.clear();
+    stage = BuildStage::ZERO;
+    stageDone = 0;
+    return;
+}
+
+void SpatialGrid::Reserve(uint32_t items) {
+    itemCell.reserve(items);
+    sorted.reserve(items);
+    return;
+}
+
+uint32_t SpatialGrid::Insert(float x, float y) {
+    itemCell.push_back(static_cast<uint32_t>(CellY(y) * cols + CellX(x)));
+    return static_cast<uint32_t>(itemCell.size() - 1);
+}
+
+void SpatialGrid::Build() {
+    BuildPart(0xFFFFFFFF);
+    return;
+}
+
+bool SpatialGrid::BuildPart(uint32_t budget) {
+    // Counting sort of the items by cell, stable so the pair order is deterministic. The
+    // counts are summed in place into the cell ends and the items placed from the last one
+    // back, which leaves the cell starts: two passes over the cells and none to copy them.
+    uint32_t items = static_cast<uint32_t>(itemCell.size());
+    uint32_t cells = static_cast<uint32_t>(cellStart.size());
+    uint64_t cellBudget = static_cast<uint64_t>(budget) * SPATIALGRID_CELLSPERITEM;
+    while (stage != BuildStage::DONE && budget > 0) {
+        switch (stage) {
+        case BuildStage::ZERO: {
+            uint32_t end = static_cast<uint32_t>(std::min<uint64_t>(cells, stageDone + cellBudget));
+            std::fill(cellStart.begin() + stageDone, cellStart.begin() + end, 0);
+            budget -= std::min(budget, (end - stageDone + SPATIALGRID_CELLSPERITEM - 1) / SPATIALGRID_CELLSPERITEM);
+            stageDone = end;
+            break;
+        }
+        case BuildStage::COUNT: {
+            uint32_t end = std::min(items, stageDone + std::min(budget, items));
+            for (uint32_t i = stageDone; i < end; i++) {
+                cellStart[itemCell[i]]++;
+            }
+            budget -= end - stageDone;
+            stageDone = end;
+            break;
+        }
+        case BuildStage::PREFIX: {
+            uint32_t begin = std::max(stageDone, 1u);
+            uint32_t end = static_cast<uint32_t>(std::min<uint64_t>(cells, begin + cellBudget));
+            for (uint32_t i = begin; i < end; i++) {
+                cellStart[i] += cellStart[i - 1];
+            }
+            budget -= std::min(budget, (end - stageDone + SPATIALGRID_CELLSPERITEM - 1) / SPATIALGRID_CELLSPERITEM);
+            stageDone = end;
+            break;
+        }
+        case BuildStage::SCATTER: {
+            sorted.resize(items);
+            uint32_t end = std::min(items, stageDone + std::min(budget, items));
+            for (uint32_t i = items - stageDone; i > items - end; i--) {
+                sorted[--cellStart[itemCell[i - 1]]] = i - 1;
+            }
+            budget -= end - stageDone;
+            stageDone = end;
+            break;
+        }
+        case BuildStage::DONE:
+            break;
+        }
+        uint32_t size = (stage == BuildStage::ZERO || stage == BuildStage::PREFIX) ? cells : items;
+        if (stageDone == size) {
+            stage = static_cast<BuildStage>(static_cast<int>(stage) + 1);
+            stageDone = 0;
+        }
+        cellBudget = static_cast<uint64_t>(budget) * SPATIALGRID_CELLSPERITEM;
+    }
+    return stage == BuildStage::DONE;
+}
+
+uint64_t SpatialGrid::GetBuildCost(uint32_t items) const {
+    return 2 * static_cast<uint64_t>(items) + 2 * (cellStart.size() / SPATIALGRID_CELLSPERITEM + 1);
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// Spatial grid constants
+// Cells of a pass over the cells costing about as much as one item in BuildPart
+constexpr uint32_t SPATIALGRID_CELLSPERITEM = 16;
+
+// Uniform grid over the wrapped field. It is rebuilt every tick with a counting sort,
+// so after the first frames neither Build nor the queries allocate. A grid too large to
+// sort in one tick is built with BuildPart a budget at a time while another is queried.
+// Items are bucketed by their center: the cell size must be at least the largest
+// interaction distance, then the 3x3 neighbourhood is enough for pair tests.
+class SpatialGrid {
+public:
+    SpatialGrid();
+
+    // Info
+    uint32_t GetCellCount() const;
+    uint32_t GetItemCount() const;
+
+    // Build
+    void Reset(float argWidth, float argHeight, float minCellSize);
+    void Clear();
+    // Makes room for that many items, so building up to them does not allocate
+    void Reserve(uint32_t items);
+    uint32_t Insert(float x, float y);
+    void Build();
+    // Does about budget items of the sort once every item is inserted and returns true when
+    // the grid can be queried again, which it must not be in between
+    bool BuildPart(uint32_t budget);
+    // Budget BuildPart needs in all for that many items
+    uint64_t GetBuildCost(uint32_t items) const;
+
+    // Calls f(i, j) once for every pair of items in the same or adjacent cells
+    template <class F>
+    void ForEachPair(F f) const;
+    // Same for the pairs owned by the cells [begin, end) in row-major order. Disjoint
+    // ranges visit disjoint pairs, so they can run on different threads.
+    template <class F>
+    void ForEachPairInCells(uint32_t begin, uint32_t end, F f) const;
+
+    // Calls f(i) for every item whose cell intersects the square [x - r, x + r] x [y - r, y + r]
+    template <class F>
+    void Query(float x, float y, float r, F f) const;
+    // Same for the box [x - rx, x + rx] x [y - ry, y + ry], every item once even if the box is larger than the field
+    template <class F>
+    void QueryBox(float x, float y, float rx, float ry, F f) const;
+
+private:
+    enum class BuildStage {
+        ZERO,
+        COUNT,
+        PREFIX,
+        SCATTER,
+        DONE
+    };
+
+    float width, height, cellWidth, cellHeight;
+    int cols, rows;
+    std::vector<uint32_t> itemCell;
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> sorted;
+    BuildStage stage;
+    uint32_t stageDone;
+
+    int CellX(float x) const;
+    int CellY(float y) const;
+    int Wrap(int value, int m) const;
+    template <class F>
+    void ForEachPairWith(uint32_t cell, uint32_t other, F& f) const;
+};
+
+inline int SpatialGrid::Wrap(int value, int m) const {
+    value %= m;
+    return (value >= 0) ? value : value + m;
+}
+
+inline int SpatialGrid::CellX(float x) const {
+    return Wrap(static_cast<int>(std::floor(x / cellWidth)), cols);
+}
+
+inline int SpatialGrid::CellY(float y) const {
+    return Wrap(static_cast<int>(std::floor(y / cellHeight)), rows);
+}
+
+template <class F>
+void SpatialGrid::ForEachPairWith(uint32_t cell, uint32_t other, F& f) const {
+    for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; i++) {
+        for (uint32_t j = cellStart[other]; j < cellStart[other + 1]; j++) {
+            f(sorted[i], sorted[j]);
+        }
+    }
+}
+
+template <class F>
+void SpatialGrid::ForEachPair(F f) const {
+    ForEachPairInCells(0, GetCellCount(), f);
+}
+
+template <class F>
+void SpatialGrid::ForEachPairInCells(uint32_t begin, uint32_t end, F f) const {
+    // Half stencil: every unordered pair of neighbouring cells is visited once,
+    // which holds as long as the grid has at least 3 cells on each axis
+    for (uint32_t cell = begin; cell < end; cell++) {
+        int cx = static_cast<int>(cell % cols), cy = static_cast<int>(cell / cols);
+        for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; i++) {
+            for (uint32_t j = i + 1; j < cellStart[cell + 1]; j++) {
+                f(sorted[i], sorted[j]);
+            }
+        }
+        int down = Wrap(cy + 1, rows);
+        ForEachPairWith(cell, cy * cols + Wrap(cx + 1, cols), f);
+        ForEachPairWith(cell, down * cols + Wrap(cx - 1, cols), f);
+        ForEachPairWith(cell, down * cols + cx, f);
+        ForEachPairWith(cell, down * cols + Wrap(cx + 1, cols), f);
+    }
+}
+
+template <class F>
+void SpatialGrid::Query(float x, float y, float r, F f) const {
+    QueryBox(x, y, r, r, f);
+}
+
+template <class F>
+void SpatialGrid::QueryBox(float x, float y, float rx, float ry, F f) const {
+    int x0 = static_cast<int>(std::floor((x - rx) / cellWidth));
+    int y0 = static_cast<int>(std::floor((y - ry) / cellHeight));
+    int spanX = std::min(static_cast<int>(std::floor((x + rx) / cellWidth)) - x0 + 1, cols);
+    int spanY = std::min(static_cast<int>(std::floor((y + ry) / cellHeight)) - y0 + 1, rows);
+    for (int j = 0; j < spanY; j++) {
+        int row = Wrap(y0 + j, rows) * cols;
+        for (int i = 0; i < spanX; i++) {
+            uint32_t cell = row + Wrap(x0 + i, cols);
+            for (uint32_t k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+                f(sorted[k]);
+            }
+        }
+    }
+}
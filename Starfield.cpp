@@ -0,0 +1,57 @@
+#include "Starfield.h"
+#include "Random.h"
+#include <algorithm>
+#include <cmath>
+
+// Far to near: star count, share of the offset, brightness and size in pixels
+static const uint32_t STARCOUNTS[STARFIELD_LAYERS] = { 400, 160, 60 };
+static const float STARPARALLAX[STARFIELD_LAYERS] = { 0.05f, 0.15f, 0.35f };
+static const uint32_t STARBRIGHTNESS[STARFIELD_LAYERS] = { 90, 160, 255 };
+static const int STARSIZES[STARFIELD_LAYERS] = { 1, 1, 2 };
+
+// Class Starfield
+Starfield::Starfield(uint32_t seed) {
+    uint32_t random = seed ? seed : 1;
+    auto next = [&random]() {
+        return XorShift32(random);
+    };
+    for (uint32_t layer = 0; layer < STARFIELD_LAYERS; layer++) {
+        layers[layer].resize(STARCOUNTS[layer]);
+        for (auto& star : layers[layer]) {
+            star.x = static_cast<float>(next() % SCREEN_WIDTH);
+            star.y = static_cast<float>(next() % SCREEN_HEIGHT);
+            // Slightly blue or yellow tint around the layer brightness
+            uint32_t brightness = STARBRIGHTNESS[layer] * (192 + next() % 64) / 255;
+            uint32_t tint = next() % 3;
+            uint32_t red = (tint == 1) ? brightness * 3 / 4 : brightness;
+            uint32_t blue = (tint == 2) ? brightness * 3 / 4 : brightness;
+            star.color = 0xFF000000 | red << 16 | brightness << 8 | blue;
+        }
+    }
+    return;
+}
+
+uint32_t Starfield::GetCount() const {
+    uint32_t count = 0;
+    for (const auto& x : layers) {
+        count += static_cast<uint32_t>(x.size());
+    }
+    return count;
+}
+
+void Starfield::Draw(const Canvas& canvas, Point offset) const {
+    for (uint32_t layer = 0; layer < STARFIELD_LAYERS; layer++) {
+        // Shift of the layer folded into the screen once, stars then only wrap by one screen
+        float shiftX = SCREEN_WIDTH - std::fmod(offset.x * STARPARALLAX[layer], static_cast<float>(SCREEN_WIDTH));
+        float shiftY = SCREEN_HEIGHT - std::fmod(offset.y * STARPARALLAX[layer], static_cast<float>(SCREEN_HEIGHT));
+        int size = std::max(1, static_cast<int>(STARSIZES[layer] * canvas.scale + 0.5f));
+        for (const auto& star : layers[layer]) {
+            int x = static_cast<int>((star.x + shiftX) * canvas.scale);
+            int y = static_cast<int>((star.y + shiftY) * canvas.scale);
+            for (int row = 0; row < size; row++) {
+                BlendWrappedSpan(canvas, x, y + row, size, star.color);
+            }
+        }
+    }
+    return;
+}
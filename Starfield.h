@@ -0,0 +1,28 @@
+#pragma once
+#include "Compositor.h"
+#include "Game.h"
+#include <stdint.h>
+#include <vector>
+
+// Starfield constants
+constexpr uint32_t STARFIELD_LAYERS = 3;
+
+// Procedural background of point stars in a few layers. Each layer wraps around the screen
+// and moves by its own fraction of the offset, so nearer layers pass by faster. Generated
+// once from a seed, a few kilobytes instead of a full-screen image.
+class Starfield {
+public:
+    explicit Starfield(uint32_t seed);
+
+    uint32_t GetCount() const;
+
+    // Offset is in game coordinates, usually drift over time plus the followed position
+    void Draw(const Canvas& canvas, Point offset) const;
+private:
+    struct Star {
+        float x, y;
+        uint32_t color;
+    };
+
+    std::vector<Star> layers[STARFIELD_LAYERS];
+};
@@ -0,0 +1,51 @@
+// Turns a capture recorded with the V key back into frames.
+//
+//   CaptureDecode <capture> <prefix>        writes <prefix>00000.bmp, <prefix>00001.bmp, ...
+//   CaptureDecode <capture> <file> --raw    writes all frames one after another as 32-bit pixels
+//
+// Build it next to the game sources, e.g. cl /O2 /EHsc Tools\CaptureDecode.cpp Capture.cpp
+#include "../BitmapFile.h"
+#include "../Capture.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: %s <capture> <prefix> [--raw]\n", argv[0]);
+        return 1;
+    }
+    bool raw = argc > 3 && std::strcmp(argv[3], "--raw") == 0;
+    CaptureReader reader;
+    if (!reader.Open(argv[1])) {
+        std::fprintf(stderr, "%s is not a capture\n", argv[1]);
+        return 1;
+    }
+    std::ofstream output;
+    if (raw) {
+        output.open(argv[2], std::ios::binary | std::ios::trunc);
+        if (!output.is_open()) {
+            std::fprintf(stderr, "cannot write %s\n", argv[2]);
+            return 1;
+        }
+    }
+    uint32_t frames = 0;
+    while (reader.Next()) {
+        const std::vector<uint32_t>& pixels = reader.GetPixels();
+        if (raw) {
+            output.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * sizeof(uint32_t));
+        }
+        else {
+            char number[16];
+            std::snprintf(number, sizeof(number), "%05u.bmp", frames);
+            if (!WriteBitmapFile(argv[2] + std::string(number), pixels, reader.GetWidth(), reader.GetHeight())) {
+                std::fprintf(stderr, "cannot write frame %u\n", frames);
+                return 1;
+            }
+        }
+        frames++;
+    }
+    std::printf("%u frames of %ux%u\n", frames, reader.GetWidth(), reader.GetHeight());
+    return 0;
+}